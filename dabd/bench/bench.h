@@ -0,0 +1,109 @@
+/* bench.h -- timing and allocation counting of the dabd benchmarks
+ *
+ * Every benchmark prints one JSON line per result:
+ *
+ *   {"bench":"dispatch/new","ops":1600000,"ns_per_op":53.1,"allocs_per_op":0}
+ *
+ * "make bench" collects them in bench/results.jsonl, bench/compare.sh
+ * compares two such files, e.g. of two versions of dabd.
+ *
+ * The allocations are counted by replacing the global operator new, so
+ * this header has to be included by exactly one translation unit: the
+ * one with main() of the benchmark. They are never inlined, otherwise
+ * gcc would see the malloc()/free() behind new/delete.
+ */
+
+#ifndef DABD_BENCH_H
+#define DABD_BENCH_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <streambuf>
+
+static std::atomic<long> bench_allocs(0);
+
+__attribute__((noinline))
+void *operator new(std::size_t size) {
+    bench_allocs.fetch_add(1, std::memory_order_relaxed);
+    void *p = std::malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+__attribute__((noinline))
+void *operator new[](std::size_t size) {
+    return operator new(size);
+}
+__attribute__((noinline))
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+__attribute__((noinline))
+void operator delete[](void *p) noexcept {
+    std::free(p);
+}
+__attribute__((noinline))
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+__attribute__((noinline))
+void operator delete[](void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+/* keeps the compiler from optimizing a result away */
+template<typename T>
+static inline void BenchKeep(const T &value) {
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+/* measures the time and the allocations between Start() and Stop() */
+class BenchTimer {
+public:
+    void Start() {
+        m_allocs = bench_allocs.load(std::memory_order_relaxed);
+        m_t0 = std::chrono::steady_clock::now();
+    }
+    void Stop(const char *name, long ops) {
+        auto t1 = std::chrono::steady_clock::now();
+        long allocs = bench_allocs.load(std::memory_order_relaxed) - m_allocs;
+        double ns = std::chrono::duration<double, std::nano>(t1 - m_t0).count();
+        std::printf("{\"bench\":\"%s\",\"ops\":%ld,"
+                    "\"ns_per_op\":%.1f,\"allocs_per_op\":%.2f}\n",
+                    name, ops, ns / ops, (double)allocs / ops);
+        std::fflush(stdout);
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_t0;
+    long                                  m_allocs = 0;
+};
+
+/* runs fn() ops times */
+template<typename Fn>
+static void BenchRun(const char *name, long ops, Fn fn) {
+    BenchTimer timer;
+    fn(); // warm up caches and lazy allocations
+    timer.Start();
+    for (long i = 0; i < ops; i++) {
+        fn();
+    }
+    timer.Stop(name, ops);
+}
+
+/* a stream buffer which drops everything, e.g. the messages of KeyStone */
+class BenchNullBuf : public std::streambuf {
+protected:
+    int overflow(int c) override {
+        return c;
+    }
+    std::streamsize xsputn(const char *s, std::streamsize n) override {
+        return n;
+    }
+};
+
+#endif // DABD_BENCH_H
@@ -0,0 +1,116 @@
+/* bench_dabd.cpp -- internals of dabd.cpp on the simulated MonkeyBoard
+ *
+ *   blockname:    KeyStone::DABBlockName() and DABBlockIndex()
+ *   wchar_t2char: KeyStone::wchar_t2char() of a board label
+ *   programlist:  DABProgramList() formatting of the scanned programs,
+ *                 the messages go into a stream buffer which drops them
+ *   execute:      ExecuteCommand() of a whole command line: parsing,
+ *                 dispatching and the KeyStone call
+ *   callstats:    a library call without and with its latency recorded
+ *
+ * Linked against sim/libkeystonesim.a with its real clock and no
+ * latency, so the serial round trips of the board aren't part of the
+ * results. The short scan time keeps the scan of DoScan() quick.
+ */
+
+#include <cstdlib>
+#include <fstream>
+
+#define main dabd_main
+#include "../dabd.cpp"
+#undef main
+
+#include "bench.h"
+
+#define BENCH_ITERATIONS 100000
+#define BENCH_LIST_ITERATIONS 2000
+#define BENCH_SCANTIME_MS 20
+#define BENCH_CONFIG "/tmp/bench_dabd.conf"
+
+static const char *execlines[] = {
+    "get volume",
+    "get programname 3",
+    "set volume 9",
+    "get signalstrength",
+    "nonsense",
+};
+#define EXECLINES (sizeof(execlines) / sizeof(execlines[0]))
+
+int main() {
+    BenchNullBuf sink;
+    std::ostream out(&sink);
+    KeyStone dabradio(VERBOSITY_DETAIL, &sink);
+    char buf[KEYSTONE_BUFFER_SIZE];
+    wchar_t wbuf[KEYSTONE_BUFFER_SIZE] = {};
+    int idx = 0;
+
+    // the programs of the built-in radio of the simulator, DoScan()
+    // writes dabd_services.db into the current directory
+    std::ofstream config(BENCH_CONFIG);
+    config << "clock real\n"
+           << "latency * 0\n"
+           << "scantime " << BENCH_SCANTIME_MS << "\n"
+           << "ensemble 5C 0x10bc 80 12 \"DR Deutschland\"\n"
+           << "service 5C 0xd210 0 9 1 128 \"Deutschlandfunk\"\n"
+           << "service 5C 0xd220 0 9 1 128 \"Dlf Kultur\"\n"
+           << "service 5C 0xd230 0 11 1 96 \"Dlf Nova\"\n"
+           << "service 5C 0x15dc 0 11 0 96 \"Radio BOB!\"\n"
+           << "ensemble 11D 0x10d1 62 40 \"Bayern\"\n"
+           << "service 11D 0xd311 0 10 1 96 \"Bayern 1 München\"\n"
+           << "service 11D 0xd313 0 10 1 96 \"Bayern 3\"\n"
+           << "service 11D 0xd314 0 14 0 128 \"BR-KLASSIK\"\n";
+    config.close();
+    setenv("KEYSTONESIM_CONFIG", BENCH_CONFIG, 1);
+    if (dabradio.OpenSerial() != RES_PASS || dabradio.DoScan() != RES_PASS) {
+        std::printf("bench_dabd: no programs on the simulated board\n");
+        return 1;
+    }
+
+    BenchRun("blockname/name", BENCH_ITERATIONS, [&]() {
+        std::string name = KeyStone::DABBlockName(idx++ % DAB_MUXBLOCKS);
+        BenchKeep(name);
+    });
+    BenchRun("blockname/index", BENCH_ITERATIONS, [&]() {
+        static const std::string_view names[] = {"5A", "11D", "13F", "X"};
+        int block = KeyStone::DABBlockIndex(names[idx++ % 4]);
+        BenchKeep(block);
+    });
+
+    wcsncpy(wbuf, L"Deutschlandfunk Kultur", KEYSTONE_BUFFER_SIZE - 1);
+    BenchRun("wchar_t2char/ascii", BENCH_ITERATIONS, [&]() {
+        dabradio.wchar_t2char(wbuf, buf);
+        BenchKeep(buf);
+    });
+    wcsncpy(wbuf, L"Bayern 1 München", KEYSTONE_BUFFER_SIZE - 1);
+    BenchRun("wchar_t2char/nonascii", BENCH_ITERATIONS, [&]() {
+        dabradio.wchar_t2char(wbuf, buf);
+        BenchKeep(buf);
+    });
+
+    CallStats stats(keystonefunctions, KS_FUNCTIONS);
+    BenchRun("callstats/direct", BENCH_ITERATIONS, [&]() {
+        char volume = ::GetVolume();
+        BenchKeep(volume);
+    });
+    BenchRun("callstats/timed", BENCH_ITERATIONS, [&]() {
+        char volume = stats.Call(KS_GetVolume, ::GetVolume);
+        BenchKeep(volume);
+    });
+
+    BenchRun("programlist/list", BENCH_LIST_ITERATIONS, [&]() {
+        dabradio.DABProgramList();
+    });
+
+    for (size_t l = 0; l < EXECLINES; l++) {
+        std::string name = std::string("execute/") + execlines[l];
+        for (char &c : name) {
+            c = c == ' ' ? '_' : c;
+        }
+        BenchRun(name.c_str(), BENCH_ITERATIONS, [&]() {
+            ExecuteCommand(dabradio, execlines[l], "dabd",
+                           VERBOSITY_DETAIL, out);
+        });
+    }
+    dabradio.CloseSerial();
+    return 0;
+}
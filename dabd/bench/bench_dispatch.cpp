@@ -0,0 +1,244 @@
+/* bench_dispatch.cpp -- parse and dispatch of a command line
+ *
+ *   old:  split() into a std::vector<std::string>, an if/else chain of
+ *         std::string comparisons and std::stol() in try/catch
+ *   new:  Tokens (string_views into the line), the perfect hash
+ *         DispatchTable and std::from_chars()
+ *
+ * The handlers only count their calls, so the time is spent in parsing
+ * and dispatching alone.
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../command.h"
+#include "bench.h"
+
+#define BENCH_ITERATIONS 200000
+
+static long calls;
+static long sum;
+
+static const char *lines[] = {
+    "get volume",
+    "get programname 14",
+    "get ensemblename 3",
+    "set volume 9",
+    "playstream 14",
+    "get signalstrength",
+    "get programtext",
+    "list",
+};
+#define LINES (sizeof(lines) / sizeof(lines[0]))
+
+/* copy of the former split() */
+static std::vector<std::string> split(std::string_view s,
+                                      char separator,
+                                      bool addempty) {
+    std::vector<std::string> output;
+    std::string_view::size_type prev_pos = 0, pos = 0;
+
+    while((pos = s.find(separator, pos)) != std::string_view::npos) {
+        std::string substring(s.substr(prev_pos, pos - prev_pos));
+        if (addempty || substring.length()) {
+            output.push_back(substring);
+        }
+        prev_pos = ++pos;
+    }
+    output.emplace_back(s.substr(prev_pos, pos - prev_pos)); // Last word
+    return output;
+}
+
+/* the former parser, shortened to the commands of lines[] */
+static int old_execute(std::string_view line) {
+    std::vector<std::string> param = split(line, ' ', false);
+    size_t param_errpos = 0;
+    long dabindex = 0;
+    int res = 0;
+
+    if (param[0] == "" || param[0].substr(0, 1) == "#") {
+        param[0] = "";
+    } else if (param[0] == "help") {
+        calls++;
+    } else if (param[0] == "open") {
+        calls++;
+    } else if (param[0] == "close") {
+        calls++;
+    } else if (param[0] == "get") {
+        if (param.size() >= 2) {
+            if (param[1] == "playmode") {
+                calls++;
+            } else if (param[1] == "volume") {
+                calls++;
+            } else if (param[1] == "stereo") {
+                calls++;
+            } else if (param[1] == "totalprogram") {
+                calls++;
+            } else if (param[1] == "playindex") {
+                calls++;
+            } else if (param[1] == "playstatus") {
+                calls++;
+            } else if (param[1] == "signalstrength") {
+                calls++;
+            } else if (param[1] == "datarate") {
+                calls++;
+            } else if (param[1] == "samplingrate") {
+                calls++;
+            } else if (param[1] == "programname" ||
+                       param[1] == "programinfo" ||
+                       param[1] == "ensemblename") {
+                if (param.size() >= 3) {
+                    try {
+                        dabindex = std::stol(param[2], &param_errpos);
+                    }
+                    catch (...) {
+                        res = -4;
+                    }
+                    if (param_errpos < param[2].length()) {
+                        res = -4;
+                    }
+                }
+                sum += dabindex;
+                calls++;
+            } else if (param[1] == "programtext") {
+                calls++;
+            } else {
+                res = -4;
+            }
+        } else {
+            res = -4;
+        }
+    } else if (param[0] == "set") {
+        if (param.size() >= 3 && param[1] == "volume") {
+            try {
+                sum += std::stoi(param[2], &param_errpos);
+            }
+            catch (...) {
+                res = -4;
+            }
+            calls++;
+        } else {
+            res = -4;
+        }
+    } else if (param[0] == "scan") {
+        calls++;
+    } else if (param[0] == "list") {
+        calls++;
+    } else if (param[0] == "playstream") {
+        if (param.size() >= 2) {
+            try {
+                sum += std::stoul(param[1], &param_errpos);
+            }
+            catch (...) {
+                res = -4;
+            }
+            calls++;
+        } else {
+            res = -4;
+        }
+    } else {
+        res = -4;
+    }
+    return res;
+}
+
+/* the new parser with the tables of dabd.cpp */
+struct Context {
+    const Tokens &param;
+};
+typedef int (*Handler)(Context &ctx);
+struct Entry {
+    std::string_view name;
+    Handler          handler = nullptr;
+};
+
+static int count(Context &ctx) {
+    calls++;
+    return 0;
+}
+static int channel(Context &ctx) {
+    long dabindex = 0;
+    if (ctx.param.size() >= 3 && !ParseNumber(ctx.param[2], &dabindex)) {
+        return -4;
+    }
+    sum += dabindex;
+    calls++;
+    return 0;
+}
+static int number(Context &ctx) {
+    long value;
+    if (!ParseNumber(ctx.param[ctx.param.size() - 1], &value)) {
+        return -4;
+    }
+    sum += value;
+    calls++;
+    return 0;
+}
+
+static constexpr Entry getproperties[] = {
+    {"playmode", count}, {"volume", count}, {"stereo", count},
+    {"totalprogram", count}, {"playindex", count}, {"playstatus", count},
+    {"signalstrength", count}, {"datarate", count},
+    {"samplingrate", count}, {"programname", channel},
+    {"programtext", count}, {"programinfo", channel},
+    {"ensemblename", channel}, {"frequency", count},
+};
+static constexpr DispatchTable getpropertytable(getproperties);
+static constexpr Entry setproperties[] = {
+    {"playmode", number}, {"volume", number}, {"stereo", number},
+};
+static constexpr DispatchTable setpropertytable(setproperties);
+
+static int get(Context &ctx) {
+    const Entry *property = getpropertytable.Find(ctx.param[1]);
+    return property ? property->handler(ctx) : -4;
+}
+static int set(Context &ctx) {
+    const Entry *property = setpropertytable.Find(ctx.param[1]);
+    return ctx.param.size() >= 3 && property ? property->handler(ctx) : -4;
+}
+
+static constexpr Entry commands[] = {
+    {"help", count}, {"open", count}, {"close", count}, {"get", get},
+    {"set", set}, {"scan", count}, {"list", count},
+    {"playstream", number}, {"stopstream", count}, {"motreset", count},
+    {"motimage", count}, {"ver", count}, {"sleep", number},
+    {"exit", count}, {"quit", count},
+};
+static constexpr DispatchTable commandtable(commands);
+
+static int new_execute(std::string_view line) {
+    Tokens param(line);
+    Context ctx{param};
+    if (param.size() == 0 || param[0][0] == '#') {
+        return 32767;
+    }
+    const Entry *command = commandtable.Find(param[0]);
+    return command ? command->handler(ctx) : -4;
+}
+
+static void report(const char *name, int (*execute)(std::string_view)) {
+    BenchTimer timer;
+    calls = 0;
+    sum = 0;
+    timer.Start();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        for (size_t l = 0; l < LINES; l++) {
+            execute(lines[l]);
+        }
+    }
+    timer.Stop(name, BENCH_ITERATIONS * LINES);
+    if (calls != BENCH_ITERATIONS * (long)LINES) {
+        std::printf("%s: %ld calls instead of %ld\n", name, calls,
+                    BENCH_ITERATIONS * (long)LINES);
+        std::exit(1);
+    }
+}
+
+int main() {
+    report("dispatch/old", old_execute);
+    report("dispatch/new", new_execute);
+    return 0;
+}
@@ -0,0 +1,83 @@
+/* bench_dlshistory.cpp -- keeping and reading the program text history
+ *
+ *   dlshistory/add:     DlsHistory::Add() of a new text, the ring of the
+ *                       service wraps every DLSHISTORY_ENTRIES texts
+ *   dlshistory/history: History() of all texts of a full ring
+ *
+ * The texts alternate between songs ("Artist - Title") and short texts
+ * which aren't songs, so every entry is reused by a text of the other
+ * kind. Before timing, the views History() hands out are checked once
+ * the ring has wrapped: a reused entry must not keep the artist/title
+ * of its former text. A failed check ends the benchmark with exit 1.
+ */
+
+#include <cstdio>
+#include <string>
+
+#include "../dlshistory.h"
+#include "bench.h"
+
+#define BENCH_TEXTS 100000
+#define BENCH_SERVICE 0xd210
+
+static std::string Text(long i) {
+    return i % 2 ? "News " + std::to_string(i)
+                 : "The Artist " + std::to_string(i) + " - A Title";
+}
+
+/* every view lies inside its text, only songs have an artist */
+static bool Check(const DlsHistory &history) {
+    bool ok = true;
+    history.History(BENCH_SERVICE, DLSHISTORY_ENTRIES,
+                    [&](const DlsHistory::Text &text) {
+        const char *end = text.text.data() + text.text.length();
+        bool song = text.text.find(" - ") != std::string_view::npos;
+        ok = ok && song == !text.artist.empty() &&
+             text.artist.data() + text.artist.length() <= end &&
+             text.title.data() + text.title.length() <= end;
+    });
+    return ok;
+}
+
+int main() {
+    DlsHistory history;
+    std::string texts[2 * DLSHISTORY_ENTRIES + 1];
+    long next = 0;
+    bool ok;
+
+    for (long i = 0; i < 2 * DLSHISTORY_ENTRIES + 1; i++) {
+        texts[i] = Text(i);
+    }
+    // one song, then enough texts to reuse its entry for "News"
+    history.Add(BENCH_SERVICE, "Artist - Title", 0);
+    for (long i = 1; i < DLSHISTORY_ENTRIES; i++) {
+        history.Add(BENCH_SERVICE, "filler " + std::to_string(i), i);
+    }
+    history.Add(BENCH_SERVICE, "News", DLSHISTORY_ENTRIES);
+    ok = Check(history);
+    for (long i = 0; i < 2 * DLSHISTORY_ENTRIES + 1; i++) {
+        history.Add(BENCH_SERVICE, texts[i], i);
+    }
+    if (!ok || !Check(history)) {
+        std::printf("bench_dlshistory: a reused entry keeps its old "
+                    "artist/title\n");
+        return 1;
+    }
+
+    // more different texts than entries: every Add() is a new one
+    BenchRun("dlshistory/add", BENCH_TEXTS, [&]() {
+        BenchKeep(history.Add(BENCH_SERVICE,
+                              texts[next % (2 * DLSHISTORY_ENTRIES + 1)],
+                              next));
+        next++;
+    });
+    BenchRun("dlshistory/history", BENCH_TEXTS, [&]() {
+        size_t bytes = 0;
+        history.History(BENCH_SERVICE, DLSHISTORY_ENTRIES,
+                        [&](const DlsHistory::Text &text) {
+            bytes += text.artist.length() + text.title.length();
+        });
+        BenchKeep(bytes);
+    });
+    return 0;
+}
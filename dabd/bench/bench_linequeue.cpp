@@ -0,0 +1,170 @@
+/* bench_linequeue.cpp -- throughput of the stdin command reader
+ *
+ * Pipes 100000 command lines into stdin and measures how fast they
+ * reach the command parser:
+ *   old:  the former reader thread of dabd (std::cin.get() and one
+ *         mutex lock per byte, find() and substr() per line). The
+ *         5 ms sleep of the former main loop is left out, otherwise
+ *         the benchmark would only measure the sleeps.
+ *   new:  LineReader: block read(), lines handed over through the
+ *         LineRing as std::string_view.
+ */
+
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include "../linequeue.h"
+#include "bench.h"
+
+#define BENCH_LINES 100000
+
+static const char *commands[] = {
+    "get signalstrength\n",
+    "get programtext\n",
+    "playstream 14\n",
+    "set volume 9\n",
+    "get programname 3\n",
+};
+
+/* write BENCH_LINES commands into a new pipe which replaces stdin */
+static std::thread start_writer() {
+    int pipefd[2];
+    if (pipe(pipefd)) {
+        perror("pipe");
+        exit(1);
+    }
+    dup2(pipefd[0], STDIN_FILENO);
+    close(pipefd[0]);
+    int wfd = pipefd[1];
+    return std::thread([wfd]() {
+        std::string block;
+        for (int i = 0; i < BENCH_LINES; i++) {
+            block += commands[i % 5];
+            if (block.length() > 8192 || i == BENCH_LINES - 1) {
+                const char *p = block.data();
+                size_t left = block.length();
+                while (left) {
+                    ssize_t n = write(wfd, p, left);
+                    if (n <= 0) {
+                        exit(1);
+                    }
+                    p += n;
+                    left -= n;
+                }
+                block.clear();
+            }
+        }
+        close(wfd);
+    });
+}
+
+/********** copy of the former stdin thread of dabd **********/
+std::mutex  stdinthr_mutex;
+bool        stdinthr_reading;
+std::string stdinthr_buf;
+
+void stdinthr_readparallel() {
+    char c;
+    stdinthr_reading = true;
+    while(stdinthr_reading && std::cin.good()) {
+        std::cin.get(c);
+        stdinthr_mutex.lock();
+        stdinthr_buf += c;
+        stdinthr_mutex.unlock();
+    }
+}
+
+int stdinthr_peek() {
+    int len;
+    stdinthr_mutex.lock();
+    len = stdinthr_buf.length();
+    stdinthr_mutex.unlock();
+    return len;
+}
+
+std::string stdinthr_readline() {
+    std::string lin;
+    auto pos = stdinthr_buf.find("\n");
+    if (pos == std::string::npos) { // buf contains no line feed
+        stdinthr_mutex.lock();
+        lin = stdinthr_buf;
+        stdinthr_buf = "";
+        stdinthr_mutex.unlock();
+    } else {
+        stdinthr_mutex.lock();
+        lin = stdinthr_buf.substr(0, pos + 1);
+        stdinthr_buf = stdinthr_buf.substr(pos + 1);
+        stdinthr_mutex.unlock();
+    }
+    return lin;
+}
+
+static size_t bench_old() {
+    size_t bytes = 0;
+    int lines = 0;
+    std::thread writer = start_writer();
+    std::thread reader(stdinthr_readparallel);
+    while (lines < BENCH_LINES) {
+        if (stdinthr_peek()) {
+            std::string lin = stdinthr_readline();
+            if (lin.length() && lin.back() == '\n') {
+                bytes += lin.length() - 1;
+                lines++;
+            }
+        }
+    }
+    stdinthr_reading = false;
+    writer.join();
+    reader.join();
+    std::cin.clear();
+    return bytes;
+}
+
+/********** LineReader of dabd **********/
+static LineReader stdinreader;
+
+static size_t bench_new() {
+    size_t bytes = 0;
+    int lines = 0;
+    std::string_view lin;
+    std::thread writer = start_writer();
+    while (lines < BENCH_LINES) {
+        ssize_t len = stdinreader.Fill(STDIN_FILENO);
+        if (len <= 0) {
+            stdinreader.Finish();
+        }
+        do {
+            while (stdinreader.Front(&lin)) {
+                bytes += lin.length();
+                lines++;
+                stdinreader.Pop();
+            }
+        } while (stdinreader.Split());
+        if (len <= 0) {
+            break;
+        }
+    }
+    writer.join();
+    return bytes;
+}
+
+static void report(const char *name, size_t (*bench)()) {
+    BenchTimer timer;
+    timer.Start();
+    size_t bytes = bench();
+    timer.Stop(name, BENCH_LINES);
+    if (bytes == 0) {
+        std::printf("%s: no lines read\n", name);
+        std::exit(1);
+    }
+}
+
+int main() {
+    report("linequeue/old", bench_old);
+    report("linequeue/new", bench_new);
+    return 0;
+}
@@ -0,0 +1,119 @@
+/* bench_scan.cpp -- polling a full DAB scan, searching the FM band
+ *
+ *   scan/busyloop: the loop DoScan() had before ScanPoller: frequency,
+ *                  number of programs and play status are asked back
+ *                  to back until the scan is finished
+ *   scan/adaptive: KeyStone::DoScan(), the board is asked about
+ *                  SCANPOLL_PER_BLOCK times per block, then the
+ *                  program list is read
+ *
+ * Both sweep all DAB_MUXBLOCKS blocks of the simulated MonkeyBoard with
+ * its real clock, BENCH_SCANTIME_MS per block and a serial round trip
+ * of BENCH_LATENCY_US. Besides the scan time ("ns_per_op" of one scan)
+ * the library calls and the CPU time of the process are printed as
+ * "calls_per_op" and "cpu_ms_per_op".
+ *
+ *   fm/naive:      every FMSCAN_FINE_STEP of the FM band is tuned to and
+ *                  measured
+ *   fm/coarsefine: KeyStone::DoScan() in FM mode, FmScanner measures
+ *                  the band every FMSCAN_COARSE_STEP and then around
+ *                  the peaks only
+ */
+
+#include <cstdlib>
+#include <fstream>
+
+#include <sys/resource.h>
+
+#define main dabd_main
+#include "../dabd.cpp"
+#undef main
+
+#include "bench.h"
+
+#define BENCH_SCANTIME_MS 100
+#define BENCH_LATENCY_US 500
+#define BENCH_CONFIG "/tmp/bench_scan.conf"
+
+static double CpuMilliseconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec * 1e3 + usage.ru_utime.tv_usec / 1e3 +
+           usage.ru_stime.tv_sec * 1e3 + usage.ru_stime.tv_usec / 1e3;
+}
+
+template<typename Fn>
+static void BenchScan(const char *name, Fn scan) {
+    BenchTimer timer;
+    double cpu = CpuMilliseconds();
+    long calls;
+    timer.Start();
+    calls = scan();
+    timer.Stop(name, 1);
+    std::printf("{\"calls\":\"%s\",\"calls_per_op\":%ld}\n", name, calls);
+    std::printf("{\"cpu\":\"%s\",\"cpu_ms_per_op\":%.1f}\n", name,
+                CpuMilliseconds() - cpu);
+}
+
+int main() {
+    BenchNullBuf sink;
+    KeyStone dabradio(VERBOSITY_DETAIL, &sink);
+
+    std::ofstream config(BENCH_CONFIG);
+    config << "clock real\n"
+           << "latency * " << BENCH_LATENCY_US << "\n"
+           << "scantime " << BENCH_SCANTIME_MS << "\n"
+           << "ensemble 5C 0x10bc 80 12 \"DR Deutschland\"\n"
+           << "service 5C 0xd210 0 9 1 128 \"Deutschlandfunk\"\n"
+           << "ensemble 11D 0x10d1 62 40 \"Bayern\"\n"
+           << "service 11D 0xd311 0 10 1 96 \"Bayern 1 München\"\n"
+           << "fm 88000 70 \"BAYERN 1\"\n"
+           << "fm 97300 85 \"BAYERN 3\"\n"
+           << "fm 104400 40 \"ANTENNE\"\n";
+    config.close();
+    setenv("KEYSTONESIM_CONFIG", BENCH_CONFIG, 1);
+    if (dabradio.OpenSerial() != RES_PASS) {
+        std::printf("bench_scan: can't open the simulated board\n");
+        return 1;
+    }
+
+    BenchScan("scan/busyloop", []() {
+        long calls = 1;
+        ::DABAutoSearch(0, DAB_MUXBLOCKS - 1);
+        do {
+            BenchKeep(::GetFrequency());
+            BenchKeep(::GetTotalProgram());
+            calls += 3;
+        } while (::GetPlayStatus() == 1);
+        return calls;
+    });
+    auto adaptive = [&]() {
+        long calls = 0;
+        for (int id = 0; id < KS_FUNCTIONS; id++) {
+            calls -= dabradio.Stats().Count(id);
+        }
+        dabradio.DoScan();
+        for (int id = 0; id < KS_FUNCTIONS; id++) {
+            calls += dabradio.Stats().Count(id);
+        }
+        return calls;
+    };
+    BenchScan("scan/adaptive", adaptive);
+    
+    BenchScan("fm/naive", []() {
+        long calls = 0;
+        int biterror;
+        for (unsigned long freq = FM_BAND_LOW; freq <= FM_BAND_HIGH;
+                freq += FMSCAN_FINE_STEP) {
+            ::PlayStream(1, freq);
+            BenchKeep(::GetSignalStrength(&biterror));
+            calls += 2;
+        }
+        return calls;
+    });
+    dabradio.SetPlayMode(1);
+    BenchScan("fm/coarsefine", adaptive);
+    dabradio.CloseSerial();
+    unlink(BENCH_CONFIG);
+    return 0;
+}
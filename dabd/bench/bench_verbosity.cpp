@@ -0,0 +1,91 @@
+/* bench_verbosity.cpp -- cost of the messages of DABProgramList() and
+ *                        DoScan() for the VERBOSITY_BUILD of this binary
+ *
+ * The KeyStone runs with the highest verbosity compiled in. Its
+ * messages are written into a stream buffer which counts and drops
+ * them. DoScan() is measured in CPU time because it spends most of its
+ * wall clock time waiting for the board, which runs with its real
+ * clock and a short scan time. Call it via verbosity.sh to compare all
+ * levels. dabd_services.db is written into the current directory!
+ */
+
+#include <ctime>
+#include <fstream>
+
+#define main dabd_main
+#include "../dabd.cpp"
+#undef main
+
+#define BENCH_LIST_ITERATIONS 10000
+#define BENCH_SCANTIME_MS 20
+#define BENCH_CONFIG "/tmp/bench_verbosity.conf"
+
+class CountingBuf : public std::streambuf {
+public:
+    long bytes = 0;
+protected:
+    int overflow(int c) override {
+        bytes++;
+        return c;
+    }
+    std::streamsize xsputn(const char *s, std::streamsize n) override {
+        bytes += n;
+        return n;
+    }
+};
+
+static double cputime_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main() {
+    CountingBuf sink;
+    KeyStone dabradio(VERBOSITY_BUILD, &sink);
+    long listbytes;
+
+    // the programs of the built-in radio of the simulator
+    std::ofstream config(BENCH_CONFIG);
+    config << "clock real\n"
+           << "latency * 0\n"
+           << "scantime " << BENCH_SCANTIME_MS << "\n"
+           << "ensemble 5C 0x10bc 80 12 \"DR Deutschland\"\n"
+           << "service 5C 0xd210 0 9 1 128 \"Deutschlandfunk\"\n"
+           << "service 5C 0xd220 0 9 1 128 \"Dlf Kultur\"\n"
+           << "service 5C 0xd230 0 11 1 96 \"Dlf Nova\"\n"
+           << "service 5C 0x15dc 0 11 0 96 \"Radio BOB!\"\n"
+           << "ensemble 11D 0x10d1 62 40 \"Bayern\"\n"
+           << "service 11D 0xd311 0 10 1 96 \"Bayern 1 München\"\n"
+           << "service 11D 0xd313 0 10 1 96 \"Bayern 3\"\n"
+           << "service 11D 0xd314 0 14 0 128 \"BR-KLASSIK\"\n";
+    config.close();
+    setenv("KEYSTONESIM_CONFIG", BENCH_CONFIG, 1);
+    if (dabradio.OpenSerial() != RES_PASS) {
+        std::cout << "verbosity: OpenSerial failed" << std::endl;
+        return 1;
+    }
+
+    double t0 = cputime_ns();
+    int res = dabradio.DoScan();
+    double t1 = cputime_ns();
+    long scanbytes = sink.bytes;
+
+    sink.bytes = 0;
+    auto t2 = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_LIST_ITERATIONS; i++) {
+        dabradio.DABProgramList();
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    listbytes = sink.bytes / BENCH_LIST_ITERATIONS;
+    double ns = std::chrono::duration<double, std::nano>(t3 - t2).count();
+
+    std::cout << "verbosity/" << VERBOSITY_BUILD << ": "
+              << "DABProgramList " << ns / BENCH_LIST_ITERATIONS
+              << " ns/call (" << listbytes << " bytes), "
+              << "DoScan " << (t1 - t0) / 1000 << " us cpu/call ("
+              << scanbytes << " bytes, res " << res << ")"
+              << std::endl;
+    dabradio.CloseSerial();
+    return 0;
+}
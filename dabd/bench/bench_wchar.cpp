@@ -0,0 +1,83 @@
+/* bench_wchar.cpp -- wchar_t label to UTF-8 conversion
+ *
+ *   old:  the former KeyStone::wchar_t2char(): iconv_open() and
+ *         iconv_close() per label, always KEYSTONE_BUFFER_SIZE bytes
+ *   new:  Utf8Converter with the ASCII fast path and a cached
+ *         iconv descriptor for non-ASCII labels
+ */
+
+#include <cstring>
+#include <string>
+
+#include "../utf8conv.h"
+#include "bench.h"
+
+#define KEYSTONE_BUFFER_SIZE 300
+#define BENCH_ITERATIONS 200000
+
+/* copy of the former conversion (error messages removed) */
+static int old_wchar_t2char(wchar_t *inbuf, char *outbuf) {
+    int res;
+    iconv_t conversion_descriptor;
+    conversion_descriptor = iconv_open("UTF-8", "WCHAR_T");
+    if (conversion_descriptor == (iconv_t)-1) {
+        *outbuf = '\0';
+        return -2;
+    }
+    char *inbufcast = (char*)inbuf;
+    char *outbufptr = outbuf;
+    size_t inbytesleft = KEYSTONE_BUFFER_SIZE;
+    size_t outbytesleft = KEYSTONE_BUFFER_SIZE;
+    iconv(conversion_descriptor,
+          &inbufcast, &inbytesleft,
+          &outbufptr, &outbytesleft);
+    res = iconv_close(conversion_descriptor);
+    return res;
+}
+
+static Utf8Converter converter;
+
+static int new_wchar_t2char(wchar_t *inbuf, char *outbuf) {
+    return converter.Convert(inbuf, KEYSTONE_BUFFER_SIZE,
+                             outbuf, KEYSTONE_BUFFER_SIZE);
+}
+
+static void report(const std::string &name, const wchar_t *label,
+                   int (*conv)(wchar_t*, char*)) {
+    wchar_t wbuf[KEYSTONE_BUFFER_SIZE] = {};
+    char buf[KEYSTONE_BUFFER_SIZE];
+    wcsncpy(wbuf, label, KEYSTONE_BUFFER_SIZE - 1);
+
+    BenchRun(name.c_str(), BENCH_ITERATIONS, [&]() {
+        conv(wbuf, buf);
+        BenchKeep(buf);
+    });
+}
+
+int main() {
+    const wchar_t *labels[] = {
+        L"Radio BOB!",
+        L"Deutschlandfunk Kultur",
+        L"Bayern 3 München",
+    };
+    const char *kinds[] = {"short", "long", "nonascii"};
+    for (int k = 0; k < 3; k++) {
+        const wchar_t *label = labels[k];
+        wchar_t wbuf[KEYSTONE_BUFFER_SIZE] = {};
+        char oldbuf[KEYSTONE_BUFFER_SIZE];
+        char newbuf[KEYSTONE_BUFFER_SIZE];
+        wcsncpy(wbuf, label, KEYSTONE_BUFFER_SIZE - 1);
+        old_wchar_t2char(wbuf, oldbuf);
+        new_wchar_t2char(wbuf, newbuf);
+        if (strcmp(oldbuf, newbuf) != 0) {
+            std::printf("wchar_t2char: results differ: \"%s\" != \"%s\"\n",
+                        oldbuf, newbuf);
+            return 1;
+        }
+        report(std::string("wchar_t2char/old/") + kinds[k], label,
+               old_wchar_t2char);
+        report(std::string("wchar_t2char/new/") + kinds[k], label,
+               new_wchar_t2char);
+    }
+    return 0;
+}
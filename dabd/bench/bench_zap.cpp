@@ -0,0 +1,89 @@
+/* bench_zap.cpp -- zap-to-reply latency of switching DAB programs
+ *
+ *   zap/playstream: "playstream <n>" and "get programname <n>", the way
+ *                   a frontend switched programs before "zap"
+ *   zap/zap:        "zap <n>", the cached program list is checked and
+ *                   ::PlayStream() is the only library call
+ *
+ * Both run BENCH_SWITCHES consecutive switches through ExecuteCommand()
+ * on the simulated MonkeyBoard with its real clock and a serial round
+ * trip of BENCH_LATENCY_US, so the results are dominated by the number
+ * of library calls per switch. These are printed as "calls_per_op".
+ */
+
+#include <cstdlib>
+#include <fstream>
+
+#define main dabd_main
+#include "../dabd.cpp"
+#undef main
+
+#include "bench.h"
+
+#define BENCH_SWITCHES 100
+#define BENCH_LATENCY_US 2000
+#define BENCH_CONFIG "/tmp/bench_zap.conf"
+
+static long LibraryCalls(const KeyStone &dabradio) {
+    long calls = 0;
+    for (int id = 0; id < KS_FUNCTIONS; id++) {
+        calls += dabradio.Stats().Count(id);
+    }
+    return calls;
+}
+
+template<typename Fn>
+static void BenchSwitches(const char *name, KeyStone &dabradio, Fn zap) {
+    BenchTimer timer;
+    long calls;
+    zap(0); // warm up
+    calls = LibraryCalls(dabradio);
+    timer.Start();
+    for (long i = 0; i < BENCH_SWITCHES; i++) {
+        zap(i);
+    }
+    timer.Stop(name, BENCH_SWITCHES);
+    std::printf("{\"calls\":\"%s\",\"calls_per_op\":%.2f}\n", name,
+                (double)(LibraryCalls(dabradio) - calls) / BENCH_SWITCHES);
+}
+
+int main() {
+    BenchNullBuf sink;
+    std::ostream out(&sink);
+    KeyStone dabradio(VERBOSITY_DETAIL, &sink);
+    long programs;
+    char line[64];
+
+    std::ofstream config(BENCH_CONFIG);
+    config << "clock real\n"
+           << "latency * " << BENCH_LATENCY_US << "\n"
+           << "scantime 1\n"
+           << "ensemble 5C 0x10bc 80 12 \"DR Deutschland\"\n"
+           << "service 5C 0xd210 0 9 1 128 \"Deutschlandfunk\"\n"
+           << "service 5C 0xd220 0 9 1 128 \"Dlf Kultur\"\n"
+           << "service 5C 0xd230 0 11 1 96 \"Dlf Nova\"\n"
+           << "ensemble 11D 0x10d1 62 40 \"Bayern\"\n"
+           << "service 11D 0xd311 0 10 1 96 \"Bayern 1 München\"\n"
+           << "service 11D 0xd313 0 10 1 96 \"Bayern 3\"\n";
+    config.close();
+    setenv("KEYSTONESIM_CONFIG", BENCH_CONFIG, 1);
+    if (dabradio.OpenSerial() != RES_PASS || dabradio.DoScan() != RES_PASS ||
+            (programs = dabradio.Services().Size()) <= 0) {
+        std::printf("bench_zap: no programs on the simulated board\n");
+        return 1;
+    }
+
+    BenchSwitches("zap/playstream", dabradio, [&](long i) {
+        snprintf(line, sizeof(line), "playstream %ld", i % programs);
+        ExecuteCommand(dabradio, line, "dabd", VERBOSITY_DETAIL, out);
+        snprintf(line, sizeof(line), "get programname %ld", i % programs);
+        ExecuteCommand(dabradio, line, "dabd", VERBOSITY_DETAIL, out);
+    });
+    BenchSwitches("zap/zap", dabradio, [&](long i) {
+        snprintf(line, sizeof(line), "zap %ld", i % programs);
+        ExecuteCommand(dabradio, line, "dabd", VERBOSITY_DETAIL, out);
+    });
+    dabradio.CloseSerial();
+    unlink(BENCH_CONFIG);
+    return 0;
+}
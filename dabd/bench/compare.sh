@@ -0,0 +1,45 @@
+#!/bin/sh
+# compare.sh -- compare two result files of "make bench"
+#
+# usage: bench/compare.sh <old results.jsonl> <new results.jsonl>
+#
+# Prints ns/op and allocs/op of both files and the ratio new/old of
+# ns/op for every benchmark found in both files.
+
+if [ $# -ne 2 ]; then
+    echo "usage: $0 <old results.jsonl> <new results.jsonl>" >&2
+    exit 1
+fi
+
+awk '
+function field(line, key,    m) {
+    if (match(line, "\"" key "\":[^,}]*")) {
+        m = substr(line, RSTART + length(key) + 3, RLENGTH - length(key) - 3)
+        gsub(/"/, "", m)
+        return m
+    }
+    return ""
+}
+FNR == 1 { file++ }
+/"bench"/ {
+    name = field($0, "bench")
+    ns[file, name] = field($0, "ns_per_op")
+    allocs[file, name] = field($0, "allocs_per_op")
+    if (file == 2) {
+        order[++n] = name
+    }
+}
+END {
+    printf "%-32s %12s %12s %7s %10s %10s\n", "bench", "old ns/op",
+           "new ns/op", "ratio", "old alloc", "new alloc"
+    for (i = 1; i <= n; i++) {
+        name = order[i]
+        if (!((1, name) in ns)) {
+            continue
+        }
+        printf "%-32s %12.1f %12.1f %7.2f %10.2f %10.2f\n", name,
+               ns[1, name], ns[2, name],
+               (ns[1, name] > 0 ? ns[2, name] / ns[1, name] : 0),
+               allocs[1, name], allocs[2, name]
+    }
+}' "$1" "$2"
@@ -0,0 +1,24 @@
+#!/bin/sh
+# verbosity.sh -- size of dabd.o and cost of the messages of
+#                 DABProgramList() and DoScan() for every VERBOSITY_BUILD
+#
+# usage: bench/verbosity.sh <compiler> "<cflags>" "<KeyStone library and -lpthread>"
+#        (called by "make bench-verbosity")
+
+CC=${1:-g++}
+CFLAGS=${2:--ggdb -Wall -std=c++17}
+LIBS=${3:--lkeystonecomm -lpthread}
+SRCDIR=$(pwd)
+TMPDIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMPDIR"' EXIT
+
+for level in 0 1 2 3 4 5 6 7 8; do
+    $CC $CFLAGS -DVERBOSITY_BUILD=$level -c "$SRCDIR/dabd.cpp" \
+        -o "$TMPDIR/dabd.o" || exit 1
+    text=$(size "$TMPDIR/dabd.o" | awk 'NR == 2 { print $1 }')
+    echo "verbosity/$level: dabd.o text $text bytes"
+    $CC $CFLAGS -O2 -DVERBOSITY_BUILD=$level \
+        "$SRCDIR/bench/bench_verbosity.cpp" -o "$TMPDIR/bench" $LIBS || exit 1
+    # DoScan() saves the program list into the current directory
+    (cd "$TMPDIR" && ./bench) || exit 1
+done
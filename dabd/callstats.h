@@ -0,0 +1,181 @@
+/*      dabd -- a DAB radio backend daemon for the Raspberry Pi
+ *                Copyright  (C) 2019 schlizbaeda
+ *
+ * dabd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License
+ * or any later version.
+ *
+ * callstats.h -- latency histograms of the KeyStoneCOMM library calls.
+ *
+ * Every library call is timed with the monotonic clock and counted in
+ * a log-linear histogram of its function: each power of two of
+ * nanoseconds is split into 2^CALLSTATS_SUBBITS linear buckets, so a
+ * percentile is at most 12.5% above the real value. The histograms are
+ * allocated once, recording a call neither allocates nor locks. All
+ * calls have to be made by the same thread (the device worker).
+ */
+
+#ifndef DABD_CALLSTATS_H
+#define DABD_CALLSTATS_H
+
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <time.h>
+
+#include "jsonwriter.h"
+
+#define CALLSTATS_SUBBITS 3  // 8 buckets per power of two
+#define CALLSTATS_MAXBITS 38 // the last bucket starts at 2^38 ns (275 s)
+#define CALLSTATS_BUCKETS \
+    ((CALLSTATS_MAXBITS - CALLSTATS_SUBBITS + 2) << CALLSTATS_SUBBITS)
+
+
+class CallStats {
+public:
+    /* names[id] is the name of the function with the id of Call() */
+    CallStats(const char *const *names, int count)
+        : m_names(names), m_histograms(count) {
+    }
+
+    /* calls function(args...) and records its time, a result false or
+     * < 0 counts as error. */
+    template<typename R, typename... P, typename... A>
+    R Call(int id, R (*function)(P...), A&&... args) {
+        uint64_t t0 = Now();
+        if constexpr (std::is_void_v<R>) {
+            function(std::forward<A>(args)...);
+            Record(id, Now() - t0, false);
+        } else {
+            R result = function(std::forward<A>(args)...);
+            Record(id, Now() - t0, Failed(result));
+            return result;
+        }
+    }
+
+    void Record(int id, uint64_t ns, bool error) {
+        Histogram &h = m_histograms[id];
+        h.count++;
+        h.errors += error;
+        h.max = ns > h.max ? ns : h.max;
+        h.buckets[Bucket(ns)]++;
+    }
+    void Reset() {
+        for (Histogram &h : m_histograms) {
+            h = Histogram();
+        }
+    }
+
+    long Count(int id) const { return m_histograms[id].count; }
+    long Errors(int id) const { return m_histograms[id].errors; }
+    uint64_t Max(int id) const { return m_histograms[id].max; }
+    /* ns, the upper bound of the bucket with the percentile p (0..100) */
+    uint64_t Percentile(int id, double p) const {
+        const Histogram &h = m_histograms[id];
+        long rank = (long)(h.count * p / 100.0 + 0.5);
+        long seen = 0;
+        rank = rank < 1 ? 1 : rank;
+        for (int b = 0; b < CALLSTATS_BUCKETS; b++) {
+            seen += h.buckets[b];
+            if (seen >= rank) {
+                uint64_t upper = BucketEnd(b);
+                return upper < h.max ? upper : h.max;
+            }
+        }
+        return h.max;
+    }
+
+    /* one line per called function, the times in us */
+    void List(std::ostream &out) const {
+        for (int id = 0; id < (int)m_histograms.size(); id++) {
+            if (!Count(id)) {
+                continue;
+            }
+            out << "  " << std::left << std::setw(22) << m_names[id]
+                << std::right << std::fixed << std::setprecision(1)
+                << " count=" << Count(id)
+                << " errors=" << Errors(id)
+                << " p50=" << Percentile(id, 50) / 1000.0
+                << " p90=" << Percentile(id, 90) / 1000.0
+                << " p99=" << Percentile(id, 99) / 1000.0
+                << " max=" << Max(id) / 1000.0 << " us\n";
+        }
+        out << std::defaultfloat;
+    }
+    /* an array "stats" of {"call", "count", "errors", "p50_ns", ...} */
+    void List(JsonWriter *json) const {
+        json->BeginArray("stats");
+        for (int id = 0; id < (int)m_histograms.size(); id++) {
+            if (!Count(id)) {
+                continue;
+            }
+            json->BeginObject();
+            json->String("call", m_names[id]);
+            json->Int("count", Count(id));
+            json->Int("errors", Errors(id));
+            json->Int("p50_ns", Percentile(id, 50));
+            json->Int("p90_ns", Percentile(id, 90));
+            json->Int("p99_ns", Percentile(id, 99));
+            json->Int("max_ns", Max(id));
+            json->EndObject();
+        }
+        json->EndArray();
+    }
+
+private:
+    struct Histogram {
+        long     count = 0;
+        long     errors = 0;
+        uint64_t max = 0;
+        uint32_t buckets[CALLSTATS_BUCKETS] = {};
+    };
+
+    static uint64_t Now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+    template<typename R>
+    static bool Failed(R result) {
+        if constexpr (std::is_same_v<R, bool>) {
+            return !result;
+        } else if constexpr (std::is_same_v<R, char>) {
+            return (signed char)result < 0; // char is unsigned on ARM
+        } else {
+            return result < 0;
+        }
+    }
+
+    /* values below 2^(SUBBITS+1) have a bucket each, above the bucket
+     * is given by the highest bit and the SUBBITS bits below it */
+    static int Bucket(uint64_t ns) {
+        if (ns < (2u << CALLSTATS_SUBBITS)) {
+            return ns;
+        }
+        int msb = 63 - __builtin_clzll(ns);
+        if (msb > CALLSTATS_MAXBITS) {
+            return CALLSTATS_BUCKETS - 1;
+        }
+        int shift = msb - CALLSTATS_SUBBITS;
+        return (shift << CALLSTATS_SUBBITS) + (int)(ns >> shift);
+    }
+    static uint64_t BucketEnd(int b) {
+        if (b < (2 << CALLSTATS_SUBBITS)) {
+            return b;
+        }
+        int shift = (b >> CALLSTATS_SUBBITS) - 1;
+        uint64_t mantissa = (b & ((1 << CALLSTATS_SUBBITS) - 1)) +
+                            (1 << CALLSTATS_SUBBITS);
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    const char *const     *m_names;
+    std::vector<Histogram> m_histograms;
+};
+
+#endif // DABD_CALLSTATS_H
@@ -0,0 +1,160 @@
+/*      dabd -- a DAB radio backend daemon for the Raspberry Pi
+ *                Copyright  (C) 2019 schlizbaeda
+ *
+ * dabd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License
+ * or any later version.
+ *
+ * command.h -- tokenizer and dispatch tables of the command parser.
+ *
+ * Tokens splits a command line into string_views pointing into the
+ * line itself, so parsing a command doesn't allocate any memory.
+ * Numbers are converted by std::from_chars.
+ *
+ * DispatchTable maps a command or property name to its entry with a
+ * perfect hash: the seed of the hash function is searched by the
+ * compiler, so that every name gets a slot of its own. A lookup costs
+ * one hash and one string comparison.
+ */
+
+#ifndef DABD_COMMAND_H
+#define DABD_COMMAND_H
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <system_error>
+
+#define COMMAND_MAX_TOKENS 48 // "scan blocks" takes up to 41 blocks
+
+
+class Tokens {
+public:
+    Tokens() {
+        m_count = 0;
+        m_overflow = false;
+    }
+    Tokens(std::string_view line, char separator = ' ') {
+        Split(line, separator);
+    }
+
+    /* split line at separator, empty tokens are skipped */
+    void Split(std::string_view line, char separator = ' ') {
+        size_t pos = 0;
+        m_count = 0;
+        m_overflow = false;
+        while (pos < line.length()) {
+            size_t end = line.find(separator, pos);
+            if (end == std::string_view::npos) {
+                end = line.length();
+            }
+            if (end > pos) {
+                if (m_count == COMMAND_MAX_TOKENS) {
+                    m_overflow = true;
+                    return;
+                }
+                m_tokens[m_count++] = line.substr(pos, end - pos);
+            }
+            pos = end + 1;
+        }
+    }
+
+    size_t size() const { return m_count; }
+    /* the line had more than COMMAND_MAX_TOKENS tokens */
+    bool Overflow() const { return m_overflow; }
+    /* token i or "" if there are fewer tokens */
+    std::string_view operator[](size_t i) const {
+        return i < m_count ? m_tokens[i] : std::string_view();
+    }
+    /* the rest of the line beginning with token i */
+    std::string_view From(size_t i, std::string_view line) const {
+        if (i >= m_count) {
+            return std::string_view();
+        }
+        return line.substr(m_tokens[i].data() - line.data());
+    }
+
+private:
+    std::string_view m_tokens[COMMAND_MAX_TOKENS];
+    size_t           m_count;
+    bool             m_overflow;
+};
+
+/* Convert the whole token into a number. Returns false (and keeps
+ * *value) if token is empty, out of range or has trailing characters. */
+template <typename T>
+bool ParseNumber(std::string_view token, T *value) {
+    const char *end = token.data() + token.length();
+    std::from_chars_result r = std::from_chars(token.data(), end, *value);
+    return token.length() && r.ec == std::errc() && r.ptr == end;
+}
+
+
+/* Entry needs a member "std::string_view name" and has to be
+ * default constructible in a constant expression */
+template <typename Entry, size_t N>
+class DispatchTable {
+public:
+    constexpr DispatchTable(const Entry (&entries)[N])
+        : m_entries{}, m_slots{}, m_seed(0) {
+        for (size_t i = 0; i < N; i++) {
+            m_entries[i] = entries[i];
+        }
+        for (uint32_t seed = 1; !TrySeed(seed); seed++) {
+            if (seed == 1000000) { // fails to compile
+                throw "DispatchTable: no perfect hash found";
+            }
+        }
+    }
+
+    /* the entry of name or nullptr */
+    const Entry *Find(std::string_view name) const {
+        int idx = m_slots[Hash(name, m_seed) & (SLOTS - 1)] - 1;
+        if (idx >= 0 && m_entries[idx].name == name) {
+            return &m_entries[idx];
+        }
+        return nullptr;
+    }
+
+private:
+    static constexpr size_t Slots() {
+        size_t slots = 1;
+        while (slots < 2 * N) {
+            slots *= 2;
+        }
+        return slots;
+    }
+    static constexpr size_t SLOTS = Slots();
+
+    static constexpr uint32_t Hash(std::string_view s, uint32_t seed) {
+        uint32_t hash = 2166136261u ^ seed; // FNV-1a
+        for (char c : s) {
+            hash = (hash ^ (unsigned char)c) * 16777619u;
+        }
+        return hash ^ (hash >> 15);
+    }
+    constexpr bool TrySeed(uint32_t seed) {
+        for (size_t slot = 0; slot < SLOTS; slot++) {
+            m_slots[slot] = 0;
+        }
+        for (size_t i = 0; i < N; i++) {
+            size_t slot = Hash(m_entries[i].name, seed) & (SLOTS - 1);
+            if (m_slots[slot]) {
+                return false;
+            }
+            m_slots[slot] = (unsigned char)(i + 1);
+        }
+        m_seed = seed;
+        return true;
+    }
+
+    static_assert(N < 255, "DispatchTable: too many entries");
+
+    Entry         m_entries[N];
+    unsigned char m_slots[SLOTS]; // index + 1 of the entry, 0: empty
+    uint32_t      m_seed;
+};
+
+#endif // DABD_COMMAND_H
@@ -0,0 +1,267 @@
+/*      dabd -- a DAB radio backend daemon for the Raspberry Pi
+ *                Copyright  (C) 2019 schlizbaeda
+ *
+ * dabd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License
+ * or any later version.
+ *
+ * controlsocket.h -- many frontends on a Unix domain socket.
+ *
+ * "dabd --socket=<path>" listens on a Unix stream socket. Every client
+ * which connects gets its own LineReader for the command lines and its
+ * own output buffer. All sockets are non-blocking and served by the
+ * reactor of the main thread: a client which stops reading never
+ * blocks dabd, its output is buffered up to CONTROLSOCKET_MAX_OUTPUT
+ * bytes, then it is disconnected.
+ *
+ * Clients are numbered from 1 on, 0 is left for stdin/stdout. A client
+ * is removed by a zero delay timer, so the handlers never see a client
+ * disappear while they are running.
+ */
+
+#ifndef DABD_CONTROLSOCKET_H
+#define DABD_CONTROLSOCKET_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "linequeue.h"
+#include "reactor.h"
+
+#define CONTROLSOCKET_BACKLOG 8
+#define CONTROLSOCKET_MAX_OUTPUT (256 * 1024) // bytes a client may lag
+
+
+class ControlSocket {
+public:
+    /* overlong: the line didn't fit into LINEQUEUE_SLOT_SIZE bytes */
+    typedef std::function<void(int client, std::string_view line,
+                               bool overlong)> LineHandler;
+    typedef std::function<void(int client)> CloseHandler;
+
+    ControlSocket(Reactor &reactor, LineHandler online, CloseHandler onclose)
+        : m_reactor(reactor), m_online(online), m_onclose(onclose) {
+        m_fd = -1;
+        m_nextclient = 1;
+    }
+    ~ControlSocket() {
+        Shutdown();
+    }
+
+    /* Listen on path, a stale socket file is replaced. Returns false
+     * with errno set if that isn't possible. */
+    bool Listen(const std::string &path) {
+        struct sockaddr_un addr = {};
+        struct stat st;
+
+        if (path.length() >= sizeof(addr.sun_path)) {
+            errno = ENAMETOOLONG;
+            return false;
+        }
+        addr.sun_family = AF_UNIX;
+        path.copy(addr.sun_path, path.length());
+        if (::lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+            ::unlink(path.c_str());
+        }
+        m_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                        0);
+        if (m_fd < 0) {
+            return false;
+        }
+        if (::bind(m_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+                ::listen(m_fd, CONTROLSOCKET_BACKLOG) < 0) {
+            int err = errno;
+            ::close(m_fd);
+            m_fd = -1;
+            errno = err;
+            return false;
+        }
+        m_path = path;
+        m_reactor.AddFd(m_fd, POLLIN, [this](int fd, short revents) {
+            Accept();
+        });
+        return true;
+    }
+    /* close all connections and remove the socket file */
+    void Shutdown() {
+        for (auto &entry : m_clients) {
+            if (entry.second->fd >= 0) {
+                m_reactor.RemoveFd(entry.second->fd);
+                ::close(entry.second->fd);
+                entry.second->fd = -1;
+            }
+        }
+        m_clients.clear();
+        if (m_fd >= 0) {
+            m_reactor.RemoveFd(m_fd);
+            ::close(m_fd);
+            ::unlink(m_path.c_str());
+            m_fd = -1;
+        }
+    }
+
+    bool Connected(int client) const {
+        auto it = m_clients.find(client);
+        return it != m_clients.end() && !it->second->closing;
+    }
+    size_t Count() const {
+        return m_clients.size();
+    }
+
+    /* queue data for client and send as much as possible at once */
+    void Write(int client, std::string_view data) {
+        Client *c = Find(client);
+        if (!c || c->closing) {
+            return;
+        }
+        if (c->out.length() + data.length() > CONTROLSOCKET_MAX_OUTPUT) {
+            Remove(client); // doesn't read its replies
+            return;
+        }
+        c->out.append(data.data(), data.length());
+        if (c->out.length() == data.length()) {
+            Flush(client, c);
+        }
+    }
+    /* disconnect client as soon as its output is sent */
+    void Close(int client) {
+        Client *c = Find(client);
+        if (!c || c->closing) {
+            return;
+        }
+        c->closeflushed = true;
+        if (c->out.empty()) {
+            Remove(client);
+        }
+    }
+
+private:
+    struct Client {
+        int         fd = -1;
+        bool        eof = false;          // the client won't send any more
+        bool        closeflushed = false; // Close() after the output
+        bool        closing = false;      // removed by the next timer
+        std::string out;                  // not yet sent
+        LineReader  reader;
+    };
+
+    Client *Find(int client) {
+        auto it = m_clients.find(client);
+        return it == m_clients.end() ? nullptr : it->second.get();
+    }
+
+    void Accept() {
+        int fd;
+        while ((fd = ::accept4(m_fd, nullptr, nullptr,
+                               SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+            int client = m_nextclient++;
+            std::unique_ptr<Client> c(new Client);
+            c->fd = fd;
+            m_clients[client] = std::move(c);
+            m_reactor.AddFd(fd, POLLIN, [this, client](int fd,
+                                                       short revents) {
+                Event(client, revents);
+            });
+        }
+    }
+
+    void Event(int client, short revents) {
+        Client *c = Find(client);
+        if (!c || c->closing) {
+            return;
+        }
+        if (revents & POLLERR) {
+            Remove(client);
+            return;
+        }
+        if (revents & POLLOUT) {
+            Flush(client, c);
+        }
+        if (!c->closing && !c->eof && (revents & (POLLIN | POLLHUP))) {
+            Read(client, c);
+        } else if (!c->closing && (revents & POLLHUP)) {
+            Remove(client); // hung up after its end of file
+        }
+    }
+
+    void Read(int client, Client *c) {
+        std::string_view line;
+        bool overlong;
+        ssize_t len = c->reader.Fill(c->fd);
+        if (len < 0 && (errno == EINTR || errno == EAGAIN)) {
+            return;
+        }
+        if (len <= 0) { // end of file: the replies are still sent
+            c->eof = true;
+            c->reader.Finish();
+            m_reactor.ModifyFd(c->fd, c->out.empty() ? 0 : POLLOUT);
+        }
+        do {
+            while (!c->closing && c->reader.Front(&line, &overlong)) {
+                m_online(client, line, overlong);
+                c->reader.Pop();
+            }
+        } while (!c->closing && c->reader.Split());
+    }
+
+    void Flush(int client, Client *c) {
+        while (!c->out.empty()) {
+            ssize_t n = ::send(c->fd, c->out.data(), c->out.length(),
+                               MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && errno == EAGAIN) {
+                break;
+            }
+            if (n <= 0) {
+                Remove(client);
+                return;
+            }
+            c->out.erase(0, n);
+        }
+        if (c->out.empty() && c->closeflushed) {
+            Remove(client);
+            return;
+        }
+        short events = c->eof ? 0 : POLLIN;
+        m_reactor.ModifyFd(c->fd, c->out.empty() ? events : events | POLLOUT);
+    }
+
+    /* stop serving client now and drop it after the current handler */
+    void Remove(int client) {
+        Client *c = Find(client);
+        if (!c || c->closing) {
+            return;
+        }
+        c->closing = true;
+        c->out.clear();
+        m_reactor.RemoveFd(c->fd);
+        ::close(c->fd);
+        c->fd = -1;
+        m_reactor.AddTimer(0, [this, client]() {
+            m_clients.erase(client);
+            m_onclose(client);
+        });
+    }
+
+    Reactor                                 &m_reactor;
+    LineHandler                              m_online;
+    CloseHandler                             m_onclose;
+    int                                      m_fd;   // listening socket
+    std::string                              m_path;
+    int                                      m_nextclient;
+    std::map<int, std::unique_ptr<Client>>   m_clients;
+};
+
+#endif // DABD_CONTROLSOCKET_H
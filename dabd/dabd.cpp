@@ -21,69 +21,48 @@
  * Development Board Pro with Slideshow which can be found at
  * https://www.monkeyboard.org/products/85-developmentboard
  * 
- * TODO:
- * -----
- *   The MOT slideshow feature isn't implemented yet
- *   because there are some issues. It doesn't work properly!
+ * The MOT slideshow is polled by the main loop while a program with
+ * a slideshow is playing, see slideshow.h.
  */
 
 #define VERSION "0.1"
 
+#include <atomic>
 #include <iomanip>  // Manipulators like std::setw or std::setbase
-#include <iostream> // std::cin and std::cout
-#include <vector>   // "dynamic array" to hold substrings from ::split()
+#include <iostream> // std::cout
+#include <memory>
+#include <sstream>
+#include <string_view>
+#include <vector>
 
-#include <iconv.h>  // https://www.gnu.org/software/libiconv/ 
+#include "callstats.h"
+#include "command.h"
+#include "dlshistory.h"
+#include "epgstore.h"
+#include "fmscan.h"
+#include "jsonwriter.h"
+#include "scanpoller.h"
+#include "servicetable.h"
+#include "telemetry.h"
+#include "utf8conv.h"
 
 
 
-/********** functions for another thread to read from stdin ***********/
-//#include <chrono>
-#include <thread>
-#include <mutex>
+/*********************** event driven main loop ***********************/
+#include <deque>
+#include <map>
 
-std::mutex  stdinthr_mutex;
-bool        stdinthr_reading;
-std::string stdinthr_buf;
+#include <signal.h>
+#include <sys/signalfd.h>
 
-void stdinthr_readparallel() {
-    // create "scoped locking" in C++ style:
-    //std::lock_guard<mutex> lock(stdinthr_mutex); // doesn't work
-    char c;
-    stdinthr_reading = true;
-    while(stdinthr_reading && std::cin.good()) {
-        std::cin.get(c);
-        stdinthr_mutex.lock();
-        stdinthr_buf += c;
-        stdinthr_mutex.unlock();
-    }
-}
-
-int stdinthr_peek() {
-    int len;
-    stdinthr_mutex.lock();
-    len = stdinthr_buf.length();
-    stdinthr_mutex.unlock();
-    return len;
-}
+#include "controlsocket.h"
+#include "devicequeue.h"
+#include "linequeue.h"
+#include "reactor.h"
+#include "script.h"
+#include "slideshow.h"
+#include "subscriptions.h"
 
-std::string stdinthr_readline() {
-    std::string lin;
-    auto pos = stdinthr_buf.find("\n");
-    if (pos == std::string::npos) { // buf contains no line feed
-        stdinthr_mutex.lock();
-        lin = stdinthr_buf;
-        stdinthr_buf = "";
-        stdinthr_mutex.unlock();
-    } else {
-        stdinthr_mutex.lock();
-        lin = stdinthr_buf.substr(0, pos + 1);
-        stdinthr_buf = stdinthr_buf.substr(pos + 1);
-        stdinthr_mutex.unlock();
-    }
-    return lin;
-}
-    
 
 
 
@@ -91,17 +70,26 @@ std::string stdinthr_readline() {
 
 /***************************** DAB radio  *****************************/
 #include "../KeyStoneCOMM/KeyStoneCOMM.h"
+#include "../KSDeviceLibrary/Epg.h"
+
+/* Epg.h declares GetEpg(), but not every libkeystonecomm exports it: *
+ * without it the address is nullptr and there is no programme guide. */
+extern BOOL GetEpg(uint16 u16EnsembleID, uint32 u32ServiceID,
+                   uint8 u8ServCompID, Service *pServ) __attribute__((weak));
 
 
 #define RES_PASS 0
 #define RES_WARN_NOTRUN 1
 #define RES_WARN_OLDTEXT 2
+#define RES_WARN_OLDSLIDE 3
 #define RES_WARN_NONE 32767
 #define RES_ERR_FAIL -1
 #define RES_ERR_OPEN -2
 #define RES_ERR_CLOSE -3
 #define RES_ERR_SYNTAX -4
 #define RES_ERR_TODO -5
+#define RES_ERR_TIMEOUT -6
+#define RES_ERR_CANCEL -7
 
 #define VERBOSITY_NONE 0
 #define VERBOSITY_FUNCT 1
@@ -113,36 +101,158 @@ std::string stdinthr_readline() {
 #define VERBOSITY_PROGRESS 7
 #define VERBOSITY_DEBUG 8
 
+/* Messages above VERBOSITY_BUILD aren't compiled in at all, e.g.      *
+ * "make VERBOSITY=4" keeps the errors and warnings only. The text of  *
+ * a message is formatted inside "if (VERBOSE(level)) { ... }" only,   *
+ * i.e. when it is really written.                                     */
+#ifndef VERBOSITY_BUILD
+#define VERBOSITY_BUILD VERBOSITY_DEBUG
+#endif
+#define VERBOSITY_ENABLED(level, verbosity) \
+    ((level) <= VERBOSITY_BUILD && (verbosity) >= (level))
+/* inside class KeyStone: nothing is written without an output buffer */
+#define VERBOSE(level) \
+    (VERBOSITY_ENABLED(level, m_verbosity) && m_out.rdbuf())
+
 
 #define DAB_MUXBLOCKS 41
 #define KEYSTONE_BUFFER_SIZE 300
+#define KEYSTONE_APPTYPE_SLIDESHOW 1 // GetApplicationType() of MOT slides
+#define KEYSTONE_PRESETS 10          // preset slots per mode (DAB, FM)
+#define PRESET_UNKNOWN -2            // not read since OpenSerial()
+
+/* the functions of KeyStoneCOMM.h and Epg.h, each call is timed by m_calls */
+#define KEYSTONE_FUNCTIONS(X) \
+    X(CommVersion) X(OpenRadioPort) X(HardResetRadio) X(IsSysReady) \
+    X(CloseRadioPort) X(SetVolume) X(PlayStream) X(StopStream) \
+    X(VolumePlus) X(VolumeMinus) X(VolumeMute) X(GetVolume) \
+    X(GetPlayMode) X(GetPlayStatus) X(GetTotalProgram) X(NextStream) \
+    X(PrevStream) X(GetPlayIndex) X(GetSignalStrength) X(GetProgramType) \
+    X(GetProgramText) X(GetProgramName) X(GetPreset) X(SetPreset) \
+    X(DABAutoSearch) X(DABAutoSearchNoClear) X(GetEnsembleName) \
+    X(GetDataRate) X(SetStereoMode) X(GetFrequency) X(GetStereoMode) \
+    X(GetStereo) X(ClearDatabase) X(SetBBEEQ) X(GetBBEEQ) X(SetHeadroom) \
+    X(GetHeadroom) X(GetApplicationType) X(GetProgramInfo) X(MotQuery) \
+    X(GetImage) X(MotReset) X(GetDABSignalQuality) X(GetServCompType) \
+    X(SyncRTC) X(GetRTC) X(GetSamplingRate) X(GetEpg)
+
+#define KEYSTONE_ENUM(function) KS_##function,
+#define KEYSTONE_NAME(function) #function,
+enum KeyStoneFunction { KEYSTONE_FUNCTIONS(KEYSTONE_ENUM) KS_FUNCTIONS };
+static const char *keystonefunctions[] = {
+    KEYSTONE_FUNCTIONS(KEYSTONE_NAME)
+};
+
+/* inside class KeyStone: KEYSTONE_CALL(GetVolume) instead of ::GetVolume() */
+#define KEYSTONE_CALL(function, ...) \
+    m_calls.Call(KS_##function, ::function, ##__VA_ARGS__)
 
 class KeyStone {
 public:
-    KeyStone(int verbosity) {
+    KeyStone(int verbosity, std::streambuf *out = std::cout.rdbuf())
+        : m_out(out), m_calls(keystonefunctions, KS_FUNCTIONS) {
         m_verbosity = verbosity;
+        m_cancel = false;
         m_serialopen = false;
         m_serialname = "/dev/ttyACM0";
         m_playmode = (char)0; // DAB mode
+        m_playing = -1;
+        m_fmfreq = 0;
+        m_motprogram = -1;
+        m_epgnext = 0;
+        ForgetPresets();
+        m_servicedbname = "dabd_services.db";
+        m_fmservicedbname = "dabd_fmservices.db";
         
         m_programtext = "";
+        
+        // program list of the last session, confirmed by OpenSerial()
+        if (m_services.Load(m_servicedbname)) {
+            if (VERBOSE(VERBOSITY_DETAIL)) {
+                m_out << "loaded " << m_services.Size()
+                      << " programs from " << m_servicedbname
+                      << std::endl;
+            }
+        }
+        // the board keeps no FM list: the last FM scan is the list
+        if (m_fmservices.Load(m_fmservicedbname)) {
+            m_fmservices.SetValid(true);
+            if (VERBOSE(VERBOSITY_DETAIL)) {
+                m_out << "loaded " << m_fmservices.Size()
+                      << " FM stations from " << m_fmservicedbname
+                      << std::endl;
+            }
+        }
+        
+        if (m_utf8.OpenError() && VERBOSE(VERBOSITY_ERR)) {
+            // only non-ASCII characters need the iconv descriptor
+            if (m_utf8.OpenError() == EINVAL) {
+                m_out << "*ERR:  wchar_t2string: "
+                      << "conversion from \"WCHAR_T\" to \"UTF-8\" "
+                      << "not available."
+                      << std::endl;
+            } else {
+                m_out << "*ERR:  wchar_t2string: "
+                      << "iconv_open(\"UTF-8\", \"WCHAR_T\"); failed."
+                      << std::endl;
+            }
+        }
     }
     ~KeyStone() {
         int res;
         if (m_serialopen) {
             res = CloseSerial();
             if (res < RES_PASS) {
-                std::cout << "*TODO: close anyway due to fatal error!!!"
-                          << std::endl;
+                m_out << "*TODO: close anyway due to fatal error!!!"
+                      << std::endl;
             }
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: Serial closing was initiated by "
-                          << "the destructor ~KeyStone()!"
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: Serial closing was initiated by "
+                      << "the destructor ~KeyStone()!"
+                      << std::endl;
             }
         }
     }
     
+    /* all messages are written into this stream buffer,        *
+     * nullptr discards them. Returns the previous stream buffer. */
+    std::streambuf *SetOutput(std::streambuf *buf) {
+        return m_out.rdbuf(buf);
+    }
+    /* Cancel() may be called from another thread: a running scan    *
+     * stops as soon as possible and returns RES_ERR_CANCEL.           */
+    void Cancel() {
+        m_cancel = true;
+    }
+    void ClearCancel() {
+        m_cancel = false;
+    }
+    /* DoScan() and DoScanBlocks() call handler for every finished     *
+     * block with the programs found so far and the ms the block and   *
+     * the whole scan took. It runs on the thread of the scan.         */
+    typedef std::function<void(int block, long programs,
+                               long blocktime, long elapsed)> ScanHandler;
+    void SetScanProgress(ScanHandler handler) {
+        m_scanprogress = handler;
+    }
+    /* the program list read by ReadServiceTable() */
+    const ServiceTable &Services() const {
+        return m_services;
+    }
+    /* the FM stations of the last FM scan, DABIndex() is the frequency  *
+     * in kHz                                                            */
+    const ServiceTable &FmServices() const {
+        return m_fmservices;
+    }
+    /* 0==DAB, 1==FM: the mode of the last PlayStream() or GetPlayMode() */
+    char PlayMode() const {
+        return m_playmode;
+    }
+    /* SerialOpen() and PlayMode() may be asked by any thread */
+    bool SerialOpen() const {
+        return m_serialopen;
+    }
+    
     static std::string DABBlockName(int idx) {
         std::string blockname;
         switch (idx) {
@@ -200,64 +310,34 @@ public:
         }
         return blockname;
     }
+    static int DABBlockIndex(std::string_view blockname) {
+        // reverse of DABBlockName(), -1 for an unknown block name
+        for (int idx = 0; idx < DAB_MUXBLOCKS; idx++) {
+            if (blockname == DABBlockName(idx)) {
+                return idx;
+            }
+        }
+        return -1;
+    }
     
     int wchar_t2char(wchar_t *inbuf, char *outbuf) {
         /* This method converts a wchar_t* (wide char string)         *
          * returned by several functions of the KeyStoneCOMM.h        *
-         * library, into a C++ string (std::string).                  *
-         * It uses the GNU library libiconv for this purpose:         *
-         * https://www.gnu.org/software/libiconv/                     */
+         * library, into a UTF-8 C string. The converter is created   *
+         * once in the constructor and stops at the terminating '\0'. */
         int res;
-        iconv_t conversion_descriptor;
         
-        char *fromcode = (char*)"WCHAR_T";
-        char *tocode = (char*)"UTF-8";
-
-        conversion_descriptor = iconv_open(tocode, fromcode);
-        if (conversion_descriptor == (iconv_t)-1) {
-            /* something went wrong: */
-            if (errno == EINVAL) {
-                if (m_verbosity >= VERBOSITY_ERR) {
-                    std::cout << "*ERR:  wchar_t2string: "
-                              << "conversion from \""
-                              << fromcode << "\" to \""
-                              << tocode << "\" not available."
-                              << std::endl;
-                }
-                res = -2;
-            } else {
-                if (m_verbosity >= VERBOSITY_ERR) {
-                    std::cout << "*ERR:  wchar_t2string: "
-                              << "iconv_open(\"" << tocode << "\", \""
-                              << fromcode << "\"); failed."
-                              << std::endl;
-                }
-                res = -3;
-            }
-            /* Terminate an empty output string. */
-            *outbuf = '\0';        
-        } else {
-            /* iconv_open(...) passed: Do the conversion: */
-            char *inbufcast = (char*)inbuf;
-            char *outbufptr = outbuf;
-            size_t inbytesleft = KEYSTONE_BUFFER_SIZE;
-            size_t outbytesleft = KEYSTONE_BUFFER_SIZE;    
-//            size_t nconv;            
-//            nconv = iconv(cd, &inbufcast, &inbytesleft,
-//                          &outbufptr, &outbytesleft);
-            iconv(conversion_descriptor,
-                  &inbufcast, &inbytesleft,
-                  &outbufptr, &outbytesleft);
-            res = iconv_close(conversion_descriptor);
-            if (res) {
-                if (m_verbosity >= VERBOSITY_ERR) {
-                    std::cout << "*ERR:  wchar_t2string: "
-                              << "iconv_close(); failed."
-                              << std::endl;
-                }
+        res = m_utf8.Convert(inbuf, KEYSTONE_BUFFER_SIZE,
+                             outbuf, KEYSTONE_BUFFER_SIZE);
+        if (res < 0) {
+            if (VERBOSE(VERBOSITY_ERR)) {
+                m_out << "*ERR:  wchar_t2string: "
+                      << "iconv(); failed."
+                      << std::endl;
             }
+            return res;
         }
-        return res;
+        return RES_PASS;
     }
     
     
@@ -265,30 +345,32 @@ public:
         int res;
         if (m_serialopen) {
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: OpenSerial not executed because "
-                          << m_serialname << " is already open."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: OpenSerial not executed because "
+                      << m_serialname << " is already open."
+                      << std::endl;
             }
         } else { // m_serialopen==false
-            if (m_verbosity >= VERBOSITY_DETAIL) {
-                std::cout << "opening " << m_serialname << "..."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_DETAIL)) {
+                m_out << "opening " << m_serialname << "..."
+                      << std::endl;
             }
-            m_serialopen = ::OpenRadioPort((char*)m_serialname.data(),
-                                           true);
+            m_serialopen = KEYSTONE_CALL(OpenRadioPort,
+                                         (char*)m_serialname.data(), true);
             res = m_serialopen ? RES_PASS : RES_ERR_OPEN;
             if (res >= RES_PASS) {
-                if (m_verbosity >= VERBOSITY_MSG) {
-                    std::cout << "*MSG:  OpenSerial: "
-                              << m_serialname << " opened."
-                              << std::endl;
+                if (VERBOSE(VERBOSITY_MSG)) {
+                    m_out << "*MSG:  OpenSerial: "
+                          << m_serialname << " opened."
+                          << std::endl;
                 }
+                CheckServiceTable();
+                ForgetPresets(); // read again when they are used
             } else {
-                if (m_verbosity >= VERBOSITY_ERR) {
-                    std::cout << "*ERR:  OpenSerial: "
-                              << m_serialname << " opening failed."
-                              << std::endl;
+                if (VERBOSE(VERBOSITY_ERR)) {
+                    m_out << "*ERR:  OpenSerial: "
+                          << m_serialname << " opening failed."
+                          << std::endl;
                 }
             }
         }
@@ -297,29 +379,31 @@ public:
     int CloseSerial() {
         int res;
         if (m_serialopen) {
-            res = ::CloseRadioPort();
+            res = KEYSTONE_CALL(CloseRadioPort);
             if (res) {
                 m_serialopen = false;
+                m_playing = -1;
+                m_motprogram = -1;
                 res = RES_PASS;
-                if (m_verbosity >= VERBOSITY_MSG) {
-                    std::cout << "*MSG:  CloseSerial: "
-                              << m_serialname << " closed."
-                              << std::endl;
+                if (VERBOSE(VERBOSITY_MSG)) {
+                    m_out << "*MSG:  CloseSerial: "
+                          << m_serialname << " closed."
+                          << std::endl;
                 }
             } else {
                 res = RES_ERR_CLOSE;
-                if (m_verbosity >= VERBOSITY_ERR) {
-                    std::cout << "*ERR:  CloseSerial: "
-                              << m_serialname << " closing failed."
-                              << std::endl;
+                if (VERBOSE(VERBOSITY_ERR)) {
+                    m_out << "*ERR:  CloseSerial: "
+                          << m_serialname << " closing failed."
+                          << std::endl;
                 }
             }            
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: CloseSerial not executed because "
-                          << m_serialname << " is already closed."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: CloseSerial not executed because "
+                      << m_serialname << " is already closed."
+                      << std::endl;
             }
         }
         return res;
@@ -329,20 +413,20 @@ public:
         int res;
         if (m_serialopen) {
             res = RES_PASS;
-            m_playmode = ::GetPlayMode();
+            m_playmode = KEYSTONE_CALL(GetPlayMode);
             *mode = m_playmode;
-            if (m_verbosity >= VERBOSITY_MSG) {
-                std::cout << "*MSG:  GetPlayMode=="
-                          << (int)*mode
-                          << " (" << (*mode ? "FM" : "DAB") << ")."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_MSG)) {
+                m_out << "*MSG:  GetPlayMode=="
+                      << (int)*mode
+                      << " (" << (*mode ? "FM" : "DAB") << ")."
+                      << std::endl;
             }
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: GetPlayMode not executed because "
-                          << m_serialname << " is closed."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: GetPlayMode not executed because "
+                      << m_serialname << " is closed."
+                      << std::endl;
             }
         }
         return res;
@@ -352,23 +436,23 @@ public:
         if (m_serialopen) {
             res = RES_PASS;
             m_playmode = mode;
-            if (m_verbosity >= VERBOSITY_FUNCT) {
-                std::cout << "*TODO: "
-                          << "switch play mode (FM/DAB) when playing..."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_FUNCT)) {
+                m_out << "*TODO: "
+                      << "switch play mode (FM/DAB) when playing..."
+                      << std::endl;
             }
-            if (m_verbosity >= VERBOSITY_MSG) {
-                std::cout << "*MSG:  SetPlayMode=="
-                          << (int)mode
-                          << " (" << (mode ? "FM" : "DAB") << ")."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_MSG)) {
+                m_out << "*MSG:  SetPlayMode=="
+                      << (int)mode
+                      << " (" << (mode ? "FM" : "DAB") << ")."
+                      << std::endl;
             }
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: SetRadioMode not executed because "
-                          << m_serialname << " is closed."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: SetRadioMode not executed because "
+                      << m_serialname << " is closed."
+                      << std::endl;
             }
         }
         return res;
@@ -378,201 +462,571 @@ public:
         char radiostatus;
         char freq;
         long totalprogram;
-        char oldfreq = -1;
+        int oldfreq = -1; // -1: no block yet (char is unsigned on ARM)
         long oldtotalprogram = -1;
         int res;
         
         if (m_serialopen) {
             if (m_playmode) { // FM mode
-                res = RES_ERR_TODO;
-                if (m_verbosity >= VERBOSITY_ERR) {
-                    std::cout << "*ERR:  TODO: "
-                              << "DoScan FM not implemented yet."
-                              << std::endl;
-                }
-                // TODO!
+                res = DoScanFm();
             } else { // DAB mode
-                if (m_verbosity >= VERBOSITY_DETAIL) {
-                    std::cout << "Searching for DAB stations...";
-                    // clear buffer to write the text immediately:
-                    std::cout.flush();
+                if (VERBOSE(VERBOSITY_DETAIL)) {
+                    m_out << "Searching for DAB stations..."
+                          << std::endl;
                 }
-                if (::DABAutoSearch(0, DAB_MUXBLOCKS - 1) == true) {
+                if (KEYSTONE_CALL(DABAutoSearch, 0, DAB_MUXBLOCKS - 1) == true) {
+                    ScanPoller poller; // paced by the time per block
                     radiostatus = 1;
-                    while (radiostatus == 1) {
-                        freq = ::GetFrequency();
-                        totalprogram = ::GetTotalProgram();
+                    while (radiostatus == 1 && !m_cancel) {
+                        poller.Wait();
+                        freq = KEYSTONE_CALL(GetFrequency);
+                        totalprogram = KEYSTONE_CALL(GetTotalProgram);
+                        if (oldfreq >= 0 && oldfreq != freq) {
+                            ScanProgress(oldfreq, totalprogram,
+                                         poller.Advanced(), poller.Elapsed());
+                        }
                         if (oldfreq != freq ||
                                 oldtotalprogram != totalprogram) {
-                            if (m_verbosity >= VERBOSITY_DETAIL) {
-                                std::cout << "\nScanning index "
-                                          << (int)freq
-                                          << " (DAB multiplex block \""
-                                          << DABBlockName(freq)
-                                          << "\"),"
-                                          << " found " << totalprogram
-                                          << " programs";
-                                // clear buffer to write the text
-                                // immediately:
-                                std::cout.flush();
+                            if (VERBOSE(VERBOSITY_DETAIL)) {
+                                m_out << "Scanning index "
+                                      << (int)freq
+                                      << " (DAB multiplex block \""
+                                      << DABBlockName(freq)
+                                      << "\"),"
+                                      << " found " << totalprogram
+                                      << " programs"
+                                      << std::endl;
                             }
                             oldfreq = freq;
                             oldtotalprogram = totalprogram;
                         }
-                        else {
-                            if (m_verbosity >= VERBOSITY_PROGRESS) {
-                                std::cout << ".";
-                                // clear buffer to write the dots
-                                // immediately:
-                                std::cout.flush();
-                            }
-                        }
-                        radiostatus = ::GetPlayStatus();
+                        radiostatus = KEYSTONE_CALL(GetPlayStatus);
                     }
-                    if (m_verbosity >= VERBOSITY_DETAIL) {
-                        std::cout << std::endl;
+                    if (m_cancel) {
+                        KEYSTONE_CALL(StopStream); // abort the search
+                        m_services.Clear();
+                        if (VERBOSE(VERBOSITY_WARN)) {
+                            m_out << "*WARN: DoScan canceled."
+                                  << std::endl;
+                        }
+                        return RES_ERR_CANCEL;
                     }
                     res = RES_PASS;
-                    totalprogram = ::GetTotalProgram();
-                    if (m_verbosity >= VERBOSITY_MSG) {
-                        std::cout << "*MSG:  DoScan==" << totalprogram
-                                  << " programs found totally."
-                                  << std::endl;
+                    totalprogram = KEYSTONE_CALL(GetTotalProgram);
+                    if (oldfreq >= 0) { // the last block
+                        ScanProgress(oldfreq, totalprogram,
+                                     poller.Advanced(), poller.Elapsed());
                     }
+                    if (VERBOSE(VERBOSITY_MSG)) {
+                        m_out << "*MSG:  DoScan==" << totalprogram
+                              << " programs found totally."
+                              << std::endl;
+                    }
+                    ReadServiceTable(); // the board's program list changed
                 } else {
                     res = RES_ERR_FAIL;
                     // DABAutoSearch failed
-                    if (m_verbosity >= VERBOSITY_ERR) {
-                        std::cout << "*ERR:  "
-                                  << "DoScan.DABAutoSearch failed."
+                    if (VERBOSE(VERBOSITY_ERR)) {
+                        m_out << "*ERR:  "
+                              << "DoScan.DABAutoSearch failed."
+                              << std::endl;
+                    }
+                }
+            }
+        } else { // m_serialopen==false
+            res = RES_WARN_NOTRUN;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: DoScan not executed because "
+                      << m_serialname << " is closed."
+                      << std::endl;
+            }
+        }
+        return res;
+    }
+    
+    int DoScanBlocks(const std::vector<int> &blocks) {
+        /* Scan only the given DAB multiplex blocks one after another  *
+         * without clearing the program list of the board. The new     *
+         * programs of each block are reported as soon as the block    *
+         * is finished.                                                */
+        std::vector<long> newindices;
+        ScanPoller poller;
+        long totalprogram;
+        long blocktime;
+        long row;
+        int res;
+        
+        if (m_serialopen) {
+            if (m_playmode) { // FM mode
+                res = RES_ERR_FAIL;
+                if (VERBOSE(VERBOSITY_ERR)) {
+                    m_out << "*ERR:  DoScanBlocks: FM has no "
+                          << "multiplex blocks, scan the whole band."
+                          << std::endl;
+                }
+            } else { // DAB mode
+                if (!m_services.Valid()) {
+                    ReadServiceTable(); // known programs before the scan
+                }
+                res = RES_PASS;
+                for (int block : blocks) {
+                    if (m_cancel) {
+                        res = RES_ERR_CANCEL;
+                        if (VERBOSE(VERBOSITY_WARN)) {
+                            m_out << "*WARN: DoScanBlocks canceled "
+                                  << "before block "
+                                  << DABBlockName(block) << "."
+                                  << std::endl;
+                        }
+                        break;
+                    }
+                    if (KEYSTONE_CALL(DABAutoSearchNoClear,
+                                      block, block) != true) {
+                        res = RES_ERR_FAIL;
+                        if (VERBOSE(VERBOSITY_ERR)) {
+                            m_out << "*ERR:  DoScanBlocks."
+                                  << "DABAutoSearchNoClear("
+                                  << block << ") failed."
+                                  << std::endl;
+                        }
+                        continue;
+                    }
+                    while (KEYSTONE_CALL(GetPlayStatus) == 1) { // scanning
+                        if (m_cancel) {
+                            KEYSTONE_CALL(StopStream); // abort the search
+                            break;
+                        }
+                        poller.Wait();
+                    }
+                    if (m_cancel) { // the programs of the block are lost
+                        res = RES_ERR_CANCEL;
+                        if (VERBOSE(VERBOSITY_WARN)) {
+                            m_out << "*WARN: DoScanBlocks canceled "
+                                  << "during block "
+                                  << DABBlockName(block) << "."
+                                  << std::endl;
+                        }
+                        break;
+                    }
+                    blocktime = poller.Advanced();
+                    totalprogram = KEYSTONE_CALL(GetTotalProgram);
+                    newindices.clear();
+                    if (totalprogram != m_services.Size()) {
+                        ReadServiceTable(&newindices);
+                    }
+                    ScanProgress(block, totalprogram, blocktime,
+                                 poller.Elapsed());
+                    if (VERBOSE(VERBOSITY_MSG)) {
+                        m_out << "*MSG:  DoScanBlocks: block "
+                              << DABBlockName(block)
+                              << " (index " << block << "): "
+                              << newindices.size() << " new programs, "
+                              << totalprogram << " programs totally."
+                              << std::endl;
+                    }
+                    if (VERBOSE(VERBOSITY_DETAIL)) {
+                        for (long idx : newindices) {
+                            row = m_services.Find(idx);
+                            m_out << "found index="
+                                  << std::setw(3) << std::setfill(' ')
+                                  << idx << ", "
+                                  << "NAME=\"" << m_services.Name(row)
+                                  << "\", ServiceID="
+                                  << std::setbase(16)
+                                  << std::setw(8)
+                                  << std::setfill('0')
+                                  << m_services.ServiceID(row)
+                                  << std::setbase(10)
+                                  << ", EnsembleName=\""
+                                  << m_services.EnsembleName(row) << "\""
                                   << std::endl;
+                        }
                     }
                 }
             }
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: DoScan not executed because "
-                          << m_serialname << " is closed."
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: DoScanBlocks not executed because "
+                      << m_serialname << " is closed."
+                      << std::endl;
+            }
+        }
+        return res;
+    }
+    
+    int DoScanFm(void) {
+        /* Measure the FM band with FmScanner and keep the stations    *
+         * found in m_fmservices, keyed by their frequency. The board *
+         * is tuned back to the FM frequency played before the scan.   */
+        std::vector<FmScanner::Station> stations;
+        FmScanner scanner;
+        ServiceTable services;
+        ScanPoller poller; // only the clock
+        char name[SERVICE_LABEL_SIZE];
+        int res;
+        
+        if (VERBOSE(VERBOSITY_DETAIL)) {
+            m_out << "Searching for FM stations..."
+                  << std::endl;
+        }
+        res = scanner.Sweep([this](unsigned long freq) {
+                                return TuneFm(freq);
+                            }, &stations);
+        if (res < 0) {
+            RetuneFm();
+            if (res == RES_ERR_CANCEL) {
+                if (VERBOSE(VERBOSITY_WARN)) {
+                    m_out << "*WARN: DoScan canceled."
                           << std::endl;
+                }
+            } else if (VERBOSE(VERBOSITY_ERR)) {
+                m_out << "*ERR:  DoScan: measuring the FM band failed."
+                      << std::endl;
+            }
+            return res;
+        }
+        services.Reserve(stations.size());
+        for (const FmScanner::Station &station : stations) {
+            name[0] = '\0';
+            if (TuneFm(station.freq) >= 0 &&
+                    KEYSTONE_CALL(GetProgramName, (char)1, station.freq,
+                                  1, wbuf)) {
+                m_utf8.Convert(wbuf, KEYSTONE_BUFFER_SIZE,
+                               name, SERVICE_LABEL_SIZE);
+            }
+            services.Add(station.freq, name, "", 0, 0, 0,
+                         KEYSTONE_CALL(GetProgramType, (char)1,
+                                       station.freq),
+                         -1);
+            if (VERBOSE(VERBOSITY_DETAIL)) {
+                m_out << "found FM " << station.freq << " kHz, "
+                      << "NAME=\"" << name << "\", "
+                      << "strength " << station.strength << "%"
+                      << std::endl;
+            }
+        }
+        m_fmservices = services;
+        m_fmservices.SetValid(true);
+        if (!m_fmservices.Save(m_fmservicedbname) &&
+                VERBOSE(VERBOSITY_WARN)) {
+            m_out << "*WARN: DoScan: writing " << m_fmservicedbname
+                  << " failed."
+                  << std::endl;
+        }
+        RetuneFm();
+        if (VERBOSE(VERBOSITY_MSG)) {
+            m_out << "*MSG:  DoScan==" << stations.size()
+                  << " FM stations found totally, "
+                  << scanner.Measurements() << " frequencies measured "
+                  << "in " << poller.Elapsed() << " ms."
+                  << std::endl;
+        }
+        return RES_PASS;
+    }
+    /* Tune to the next strong FM station upwards (direction > 0) or  *
+     * downwards from the tuned one, *freq is its frequency in kHz.    */
+    int Seek(int direction, unsigned long *freq) {
+        FmScanner::Station station;
+        FmScanner scanner;
+        unsigned long from = m_playmode ? m_fmfreq : 0; // 0: band edge
+        int res;
+        *freq = 0;
+        if (!m_serialopen) {
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: Seek not executed because "
+                      << m_serialname << " is closed."
+                      << std::endl;
+            }
+            return RES_WARN_NOTRUN;
+        }
+        m_programtext = ""; // delete buffered program text!
+        res = scanner.Seek([this](unsigned long f) { return TuneFm(f); },
+                           from, direction, &station);
+        if (res == RES_PASS && station.freq) {
+            res = TuneFm(station.freq) >= 0 ? RES_PASS : RES_ERR_FAIL;
+        } else if (res == RES_PASS) { // nothing in the whole band
+            res = RES_ERR_FAIL;
+            if (VERBOSE(VERBOSITY_ERR)) {
+                m_out << "*ERR:  Seek: no FM station "
+                      << (direction > 0 ? "above " : "below ")
+                      << (from ? "the tuned one." : "the band edge.")
+                      << std::endl;
+            }
+        } else if (res == RES_ERR_CANCEL) {
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: Seek canceled."
+                      << std::endl;
             }
+        } else if (VERBOSE(VERBOSITY_ERR)) {
+            m_out << "*ERR:  Seek: measuring the FM band failed."
+                  << std::endl;
+        }
+        if (res != RES_PASS) {
+            RetuneFm(); // back to where the seek started
+            return res;
+        }
+        *freq = m_fmfreq = station.freq;
+        m_playmode = 1; // FM
+        m_playing = -1;
+        if (VERBOSE(VERBOSITY_MSG)) {
+            m_out << "*MSG:  Seek==" << station.freq << " kHz, "
+                  << "strength " << station.strength << "%, "
+                  << scanner.Measurements() << " frequencies measured."
+                  << std::endl;
         }
         return res;
     }
     
-    int DABProgramList(void) {
+    int ReadServiceTable(std::vector<long> *newindices = nullptr) {
+        /* Read name, info and type of all programs from the board    *
+         * into m_services. This is the only place where the program  *
+         * list causes serial traffic.                                *
+         * With newindices the known programs are kept: only their    *
+         * (possibly moved) index is read again. The indices of the   *
+         * programs which weren't known yet are added to newindices.  */
+        ServiceTable services;
         long totalprogram;
         long i;
+        long row;
         int res;
         
         unsigned char ServiceComponentID;
         uint32 ServiceID;
         uint16 EnsembleID;
+        char name[SERVICE_LABEL_SIZE];
+        char ensemblename[SERVICE_LABEL_SIZE];
         
         if (m_serialopen) {
-            totalprogram = ::GetTotalProgram();
+            totalprogram = KEYSTONE_CALL(GetTotalProgram);
             res = totalprogram > 0 ? RES_PASS : RES_ERR_FAIL;
             if (res == RES_PASS) {
-                for(i = 0; i < totalprogram; i++) {
-                    if(::GetProgramName(m_playmode, i, 1, wbuf)) {
-                        wchar_t2char(wbuf, buf);
-                        if (m_verbosity >= VERBOSITY_DETAIL) {
-                            std::cout << "list index=";
-                            std::cout << std::setbase(10)
-                                      << std::setw(3)
-                                      << std::setfill(' ')
-                                      << i << ", ";
-                            std::cout << "NAME=\"" << buf << "\"";
-                        }
-                        
-                        if(::GetProgramInfo(i,
-                                            &ServiceComponentID,
-                                            &ServiceID,
-                                            &EnsembleID)) {
-                            if (m_verbosity >= VERBOSITY_DETAIL) {
-                                std::cout << ", ServiceComponentID="
-                                          << std::setbase(16)
-                                          << std::setw(2)
-                                          << std::setfill('0')
-                                          << (int)ServiceComponentID;
-                                std::cout << ", ServiceID="
-                                          << std::setw(8)
-                                          << ServiceID;
-                                std::cout << ", EnsembleID="
-                                          << std::setw(4)
-                                          << EnsembleID;                                
-                            }
-                        }
-                        else {
-                            res = RES_ERR_FAIL;
-                            if (m_verbosity >= VERBOSITY_ERR) {
-                                std::cout << "*ERR:  DABProgramList."
-                                          << "GetProgramInfo() failed "
-                                          << "for index " << i;
-                            }
-                        }
-                        
-                        if(::GetEnsembleName(i, 1, wbuf)) {
-                            wchar_t2char(wbuf, buf);
-                            if (m_verbosity >= VERBOSITY_DETAIL) {
-                                std::cout << ", EnsembleName=\""
-                                          << buf << "\"";
-                            }
+                services.Reserve(totalprogram);
+                for (i = 0; i < totalprogram; i++) {
+                    ServiceComponentID = 0;
+                    ServiceID = 0;
+                    EnsembleID = 0;
+                    if (!KEYSTONE_CALL(GetProgramInfo, i,
+                                       &ServiceComponentID,
+                                       &ServiceID,
+                                       &EnsembleID)) {
+                        res = RES_ERR_FAIL;
+                        if (VERBOSE(VERBOSITY_ERR)) {
+                            m_out << "*ERR:  ReadServiceTable."
+                                  << "GetProgramInfo() failed "
+                                  << "for index " << i << std::endl;
                         }
-                        else {
-                            res = RES_ERR_FAIL;
-                            if (m_verbosity >= VERBOSITY_ERR) {
-                                std::cout << "*ERR:  DABProgramList."
-                                          << "GetEnsembleInfo() failed "
-                                          << "for index " << i;
-                            }
+                    }
+                    row = newindices == nullptr ? -1 :
+                          m_services.FindServiceID(ServiceID,
+                                                   ServiceComponentID);
+                    if (row >= 0) { // known program: no labels needed
+                        services.Add(i, m_services.Name(row),
+                                     m_services.EnsembleName(row),
+                                     ServiceComponentID, ServiceID,
+                                     EnsembleID,
+                                     m_services.ProgramType(row),
+                                     m_services.ApplicationType(row));
+                        continue;
+                    }
+                    name[0] = '\0';
+                    ensemblename[0] = '\0';
+                    if (KEYSTONE_CALL(GetProgramName,
+                                      (char)0, i, 1, wbuf)) { // DAB
+                        m_utf8.Convert(wbuf, KEYSTONE_BUFFER_SIZE,
+                                       name, SERVICE_LABEL_SIZE);
+                    } else {
+                        res = RES_ERR_FAIL;
+                        if (VERBOSE(VERBOSITY_ERR)) {
+                            m_out << "*ERR:  ReadServiceTable."
+                                  << "GetProgramName() failed "
+                                  << "for index " << i << std::endl;
                         }
                     }
-                    else {
+                    if (KEYSTONE_CALL(GetEnsembleName, i, 1, wbuf)) {
+                        m_utf8.Convert(wbuf, KEYSTONE_BUFFER_SIZE,
+                                       ensemblename, SERVICE_LABEL_SIZE);
+                    } else {
                         res = RES_ERR_FAIL;
-                        if (m_verbosity >= VERBOSITY_ERR) {
-                            std::cout << "*ERR:  DABProgramList."
-                                      << "GetProgramName() failed "
-                                      << "for index " << i;
+                        if (VERBOSE(VERBOSITY_ERR)) {
+                            m_out << "*ERR:  ReadServiceTable."
+                                  << "GetEnsembleName() failed "
+                                  << "for index " << i << std::endl;
                         }
                     }
-                    /* add line feed: */
-                    if (m_verbosity >= VERBOSITY_DETAIL) {
-                        std::cout << std::setbase(10)
-                                  << std::setw(0)
-                                  << std::endl; // line feed
+                    services.Add(i, name, ensemblename,
+                                 ServiceComponentID, ServiceID, EnsembleID,
+                                 KEYSTONE_CALL(GetProgramType, (char)0, i),
+                                 KEYSTONE_CALL(GetApplicationType, i));
+                    if (newindices != nullptr) {
+                        newindices->push_back(i);
                     }
                 }
-                if (m_verbosity >= VERBOSITY_MSG) {
-                    std::cout << "*MSG:  DABProgramList=="
-                              << totalprogram
-                              << " programs found totally"
-                              << (res == RES_PASS ? "" : "(with errors)")
-                              << "." << std::endl;
-                }
-            } else { // GetTotalProgram() failed:
-                if (totalprogram) { // totalprogram < 0
-                    if (m_verbosity >= VERBOSITY_ERR) {
-                        std::cout << "*ERR:  DABProgramList."
-                                  << "GetTotalProgram failed with "
-                                  << "exitcode=="
-                                  << totalprogram << "." << std::endl;
+                m_services = services;
+                // an incomplete table is read again on the next access
+                m_services.SetValid(res == RES_PASS);
+                if (res == RES_PASS &&
+                        !m_services.Save(m_servicedbname)) {
+                    if (VERBOSE(VERBOSITY_WARN)) {
+                        m_out << "*WARN: ReadServiceTable: "
+                              << "writing " << m_servicedbname
+                              << " failed."
+                              << std::endl;
                     }
-                } else { // totalprogram == 0
-                    if (m_verbosity >= VERBOSITY_ERR) {
-                        std::cout << "*ERR:  DABProgramList==0 "
-                                  << "programs found totally."
-                                  << std::endl;
+                }
+                if (VERBOSE(VERBOSITY_DETAIL)) {
+                    m_out << "ReadServiceTable: " << totalprogram
+                          << " programs read from the board"
+                          << (res == RES_PASS ? "" : " (with errors)")
+                          << "." << std::endl;
+                }
+            } else { // GetTotalProgram() failed or no programs stored
+                m_services.Clear();
+                if (VERBOSE(VERBOSITY_ERR)) {
+                    m_out << "*ERR:  ReadServiceTable."
+                          << "GetTotalProgram=="
+                          << totalprogram << "." << std::endl;
+                }
+            }
+        } else { // m_serialopen==false
+            res = RES_WARN_NOTRUN;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: ReadServiceTable not executed "
+                      << "because " << m_serialname << " is closed."
+                      << std::endl;
+            }
+        }
+        return res;
+    }
+    void CheckServiceTable(void) {
+        /* A table kept from the last session (or loaded from          *
+         * m_servicedbname) is used if the board still has the same   *
+         * number of programs. Otherwise it is read on first access.   */
+        long totalprogram;
+        if (m_services.Size() > 0) {
+            totalprogram = KEYSTONE_CALL(GetTotalProgram);
+            if (totalprogram == m_services.Size()) {
+                m_services.SetValid(true);
+                if (VERBOSE(VERBOSITY_DETAIL)) {
+                    m_out << "CheckServiceTable: " << totalprogram
+                          << " known programs are up to date."
+                          << std::endl;
+                }
+            } else {
+                if (VERBOSE(VERBOSITY_DETAIL)) {
+                    m_out << "CheckServiceTable: " << m_services.Size()
+                          << " known programs but " << totalprogram
+                          << " programs on the board."
+                          << std::endl;
+                }
+                m_services.Clear();
+            }
+        }
+    }
+    /* row of the DAB index in m_services, the table is read first if  *
+     * necessary and the board is open in DAB mode. Otherwise the rows *
+     * kept so far are used. Returns -1 if the program is unknown.     */
+    long FindService(long dabindex) {
+        if (!m_services.Valid() && m_serialopen && !m_playmode) {
+            ReadServiceTable();
+        }
+        return m_services.Find(dabindex);
+    }
+    
+    int DABProgramList(void) {
+        long totalprogram;
+        long i;
+        int res;
+        
+        if (m_serialopen) {
+            if (!m_services.Valid()) {
+                ReadServiceTable();
+            }
+            totalprogram = m_services.Size();
+            res = totalprogram > 0 ? RES_PASS : RES_ERR_FAIL;
+            if (res == RES_PASS) {
+                if (VERBOSE(VERBOSITY_DETAIL)) {
+                    for (i = 0; i < totalprogram; i++) {
+                        m_out << "list index="
+                              << std::setbase(10)
+                              << std::setw(3)
+                              << std::setfill(' ')
+                              << m_services.DABIndex(i) << ", "
+                              << "NAME=\"" << m_services.Name(i) << "\""
+                              << ", ServiceComponentID="
+                              << std::setbase(16)
+                              << std::setw(2)
+                              << std::setfill('0')
+                              << (int)m_services.ServiceComponentID(i)
+                              << ", ServiceID="
+                              << std::setw(8)
+                              << m_services.ServiceID(i)
+                              << ", EnsembleID="
+                              << std::setw(4)
+                              << m_services.EnsembleID(i)
+                              << ", EnsembleName=\""
+                              << m_services.EnsembleName(i) << "\""
+                              << std::setbase(10)
+                              << std::setw(0)
+                              << ", ProgramType="
+                              << (int)m_services.ProgramType(i)
+                              << ", ApplicationType="
+                              << (int)m_services.ApplicationType(i)
+                              << std::endl; // line feed
                     }
                 }
+                if (!m_services.Valid()) {
+                    res = RES_ERR_FAIL;
+                }
+                if (VERBOSE(VERBOSITY_MSG)) {
+                    m_out << "*MSG:  DABProgramList=="
+                          << totalprogram
+                          << " programs found totally"
+                          << (res == RES_PASS ? "" : "(with errors)")
+                          << "." << std::endl;
+                }
+            } else { // no programs stored
+                if (VERBOSE(VERBOSITY_ERR)) {
+                    m_out << "*ERR:  DABProgramList==0 "
+                          << "programs found totally."
+                          << std::endl;
+                }
             }
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: DABProgramList not executed "
-                          << "because " << m_serialname << " is closed."
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: DABProgramList not executed "
+                      << "because " << m_serialname << " is closed."
+                      << std::endl;
+            }
+        }
+        return res;
+    }
+    
+    /* the FM stations of the last FM scan, no serial traffic at all */
+    int FMProgramList(void) {
+        long totalprogram = m_fmservices.Size();
+        int res = totalprogram > 0 ? RES_PASS : RES_ERR_FAIL;
+        if (res == RES_PASS) {
+            if (VERBOSE(VERBOSITY_DETAIL)) {
+                for (long i = 0; i < totalprogram; i++) {
+                    m_out << "list FM " << m_fmservices.DABIndex(i)
+                          << " kHz, NAME=\"" << m_fmservices.Name(i) << "\""
+                          << ", ProgramType="
+                          << (int)m_fmservices.ProgramType(i)
                           << std::endl;
+                }
+            }
+            if (VERBOSE(VERBOSITY_MSG)) {
+                m_out << "*MSG:  FMProgramList=="
+                      << totalprogram
+                      << " FM stations found totally."
+                      << std::endl;
             }
+        } else if (VERBOSE(VERBOSITY_ERR)) {
+            m_out << "*ERR:  FMProgramList==0 FM stations, "
+                  << "scan in FM mode first."
+                  << std::endl;
         }
         return res;
     }
@@ -581,18 +1035,18 @@ public:
         int res;
         if (m_serialopen) {
             res = RES_PASS;
-            *volume = ::GetVolume();
-            if (m_verbosity >= VERBOSITY_MSG) {
-                std::cout << "*MSG:  GetVolume=="
-                          << (int)*volume
-                          << std::endl;
+            *volume = KEYSTONE_CALL(GetVolume);
+            if (VERBOSE(VERBOSITY_MSG)) {
+                m_out << "*MSG:  GetVolume=="
+                      << (int)*volume
+                      << std::endl;
             }
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: GetVolume not executed because "
-                          << m_serialname << " is closed."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: GetVolume not executed because "
+                      << m_serialname << " is closed."
+                      << std::endl;
             }
         }
         return res;
@@ -604,48 +1058,48 @@ public:
                 volume -= '0'; // change chars '0'..'9' into byte values
             }
             if (volume <= 16) { // SetVolume(...)
-                res = ::SetVolume(volume) ? RES_PASS : RES_ERR_FAIL;
+                res = KEYSTONE_CALL(SetVolume, volume) ? RES_PASS : RES_ERR_FAIL;
                 if (res == RES_PASS) {
-                    if (m_verbosity >= VERBOSITY_MSG) {
-                        std::cout << "*MSG:  SetVolume=="
-                                  << (int)volume
-                                  << std::endl;
+                    if (VERBOSE(VERBOSITY_MSG)) {
+                        m_out << "*MSG:  SetVolume=="
+                              << (int)volume
+                              << std::endl;
                     }
                 } else { // ::SetVolume(...) failed
-                    if (m_verbosity >= VERBOSITY_ERR) {
-                        std::cout << "*ERR:  SetVolume(" << volume
-                                  << ") failed."
-                                  << std::endl;
+                    if (VERBOSE(VERBOSITY_ERR)) {
+                        m_out << "*ERR:  SetVolume(" << volume
+                              << ") failed."
+                              << std::endl;
                     }
                 }
             } else if (volume == '+') { // VolumePlus()
                 res = RES_ERR_TODO;
-                if (m_verbosity >= VERBOSITY_ERR) {
-                    std::cout << "*ERR:  TODO: implementation of "
-                              << "VolumePlus()..."
-                              << std::endl;
+                if (VERBOSE(VERBOSITY_ERR)) {
+                    m_out << "*ERR:  TODO: implementation of "
+                          << "VolumePlus()..."
+                          << std::endl;
                 }
             } else if (volume == '-') { // VolumeMinus()
                 res = RES_ERR_TODO;
-                if (m_verbosity >= VERBOSITY_ERR) {
-                    std::cout << "*ERR:  TODO: implementation of "
-                              << "VolumeMinus()..."
-                              << std::endl;
+                if (VERBOSE(VERBOSITY_ERR)) {
+                    m_out << "*ERR:  TODO: implementation of "
+                          << "VolumeMinus()..."
+                          << std::endl;
                 }
             } else { // wrong value for volume:
                 res = RES_WARN_NOTRUN;
-                if (m_verbosity >= VERBOSITY_WARN) {
-                    std::cout << "*WARN: SetVolume not executed due to "
-                              << "wrong value " << (int)volume
-                              << std::endl;
+                if (VERBOSE(VERBOSITY_WARN)) {
+                    m_out << "*WARN: SetVolume not executed due to "
+                          << "wrong value " << (int)volume
+                          << std::endl;
                 }
             }
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: SetVolume not executed because "
-                          << m_serialname << " is closed."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: SetVolume not executed because "
+                      << m_serialname << " is closed."
+                      << std::endl;
             }
         }
         return res;
@@ -655,18 +1109,18 @@ public:
         int res;
         if (m_serialopen) {
             res = RES_PASS;
-            *stereo = ::GetStereo();
-            if (m_verbosity >= VERBOSITY_MSG) {
-                std::cout << "*MSG:  GetStereo=="
-                          << (int)*stereo
-                          << std::endl;
+            *stereo = KEYSTONE_CALL(GetStereo);
+            if (VERBOSE(VERBOSITY_MSG)) {
+                m_out << "*MSG:  GetStereo=="
+                      << (int)*stereo
+                      << std::endl;
             }
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: GetStereo not executed because "
-                          << m_serialname << " is closed."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: GetStereo not executed because "
+                      << m_serialname << " is closed."
+                      << std::endl;
             }
         }
         return res;
@@ -675,19 +1129,19 @@ public:
         int res;
         if (m_serialopen) {
             res = RES_PASS;
-            *mode = ::GetStereoMode();
-            if (m_verbosity >= VERBOSITY_MSG) {
-                std::cout << "*MSG:  GetStereoMode=="
-                          << (int)*mode
-                          << " (" << (*mode ? "stereo" : "mono") << ")."
-                          << std::endl;
+            *mode = KEYSTONE_CALL(GetStereoMode);
+            if (VERBOSE(VERBOSITY_MSG)) {
+                m_out << "*MSG:  GetStereoMode=="
+                      << (int)*mode
+                      << " (" << (*mode ? "stereo" : "mono") << ")."
+                      << std::endl;
             }
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: GetStereoMode not executed "
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: GetStereoMode not executed "
                          << "because " << m_serialname << " is closed."
-                          << std::endl;
+                      << std::endl;
             }
         }
         return res;
@@ -695,28 +1149,28 @@ public:
     int SetStereoMode(char mode) {
         int res;
         if (m_serialopen) {
-            res = ::SetStereoMode(mode) ? RES_PASS : RES_ERR_FAIL;
+            res = KEYSTONE_CALL(SetStereoMode, mode) ? RES_PASS : RES_ERR_FAIL;
             if (res == RES_PASS) {
-                if (m_verbosity >= VERBOSITY_MSG) {
-                    std::cout << "*MSG:  SetStereoMode=="
-                              << (int)mode
-                              << " (" << (mode ? "stereo" : "mono")
-                              << ")."
-                              << std::endl;
+                if (VERBOSE(VERBOSITY_MSG)) {
+                    m_out << "*MSG:  SetStereoMode=="
+                          << (int)mode
+                          << " (" << (mode ? "stereo" : "mono")
+                          << ")."
+                          << std::endl;
                 }
             } else { // ::SetVolume(...) failed
-                if (m_verbosity >= VERBOSITY_ERR) {
-                    std::cout << "*ERR:  SetStereoMode(" << mode
-                              << ") failed."
-                              << std::endl;
+                if (VERBOSE(VERBOSITY_ERR)) {
+                    m_out << "*ERR:  SetStereoMode(" << mode
+                          << ") failed."
+                          << std::endl;
                 }
             }
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: SetStereoMode not executed "
-                          << "because " << m_serialname << " is closed."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: SetStereoMode not executed "
+                      << "because " << m_serialname << " is closed."
+                      << std::endl;
             }
         }
         return res;
@@ -732,85 +1186,266 @@ public:
                 res = channel >= 87000 && 
                       channel <= 108000 ? RES_PASS : RES_ERR_FAIL;
                 if (res != RES_PASS) {
-                    if (m_verbosity >= VERBOSITY_ERR) {
-                        std::cout << "*ERR:  FM frequency "
-                                  << (float)channel / 1000.0 
-                                  << " is'nt within 87.0MHz and 108.0MHz."
-                                  << std::endl;
+                    if (VERBOSE(VERBOSITY_ERR)) {
+                        m_out << "*ERR:  FM frequency "
+                              << (float)channel / 1000.0 
+                              << " is'nt within 87.0MHz and 108.0MHz."
+                              << std::endl;
                     }
                 }
             } else { // DAB mode
-                totalprogram = ::GetTotalProgram();
+                totalprogram = KEYSTONE_CALL(GetTotalProgram);
                 res = channel >= 0 && 
                       (long)channel < totalprogram ? RES_PASS : RES_ERR_FAIL;
                 if (res != RES_PASS) {
-                    if (m_verbosity >= VERBOSITY_ERR) {
-                        std::cout << "*ERR:  DAB program " << channel 
-                                  << " is beyond 0 and "
-                                  << totalprogram - 1 << "."
-                                  << std::endl;
+                    if (VERBOSE(VERBOSITY_ERR)) {
+                        m_out << "*ERR:  DAB program " << channel 
+                              << " is beyond 0 and "
+                              << totalprogram - 1 << "."
+                              << std::endl;
                     }
                 }
             }
             
             /* play radio stream: either FM or DAB */
             if (res == RES_PASS) { // start radio stream
-                res = ::PlayStream(m_playmode, channel) ? RES_PASS : RES_ERR_FAIL;
+                res = KEYSTONE_CALL(PlayStream, m_playmode, channel) ? RES_PASS : RES_ERR_FAIL;
                 if (res == RES_PASS) {
-                    if (m_verbosity >= VERBOSITY_MSG) {
-                        std::cout << "*MSG:  "
-                                  << (m_playmode ? "FM" : "DAB")
-                                  << " radio stream started playing."
-                                  << std::endl;
+                    if (VERBOSE(VERBOSITY_MSG)) {
+                        m_out << "*MSG:  "
+                              << (m_playmode ? "FM" : "DAB")
+                              << " radio stream started playing."
+                              << std::endl;
                     }
                     if (m_playmode) { // FM
-                        
+                        m_playing = -1;
+                        m_fmfreq = channel;
                     }
                     else { // DAB mode
+                        m_playing = channel;
                     }
                 }
                 else { // an error occurred
-                    if (m_verbosity >= VERBOSITY_ERR) {
-                        std::cout << "*ERR:  PlayStream(" << m_playmode
-                                  << ", " << channel <<") failed."
-                                  << std::endl;
+                    if (VERBOSE(VERBOSITY_ERR)) {
+                        m_out << "*ERR:  PlayStream(" << (int)m_playmode
+                              << ", " << channel <<") failed."
+                              << std::endl;
                     }
                 }
             }
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: PlayStream not executed because "
-                          << m_serialname << " is closed."
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: PlayStream not executed because "
+                      << m_serialname << " is closed."
+                      << std::endl;
+            }
+        }
+        return res;
+    }
+    /* Fast switch to a DAB program: the index is checked against the  *
+     * cached program list, so ::PlayStream() is the only serial round *
+     * trip. *row is the row of the program in Services().             */
+    int Zap(long dabindex, long *row) {
+        int res;
+        if (m_serialopen) {
+            if (!m_services.Valid()) { // Zap switches to DAB anyway
+                ReadServiceTable();
+            }
+            *row = m_services.Find(dabindex);
+            res = *row >= 0 ? RES_PASS : RES_ERR_FAIL;
+            if (res != RES_PASS) {
+                if (VERBOSE(VERBOSITY_ERR)) {
+                    m_out << "*ERR:  Zap: DAB program " << dabindex
+                          << " is beyond 0 and "
+                          << m_services.Size() - 1 << "."
+                          << std::endl;
+                }
+                return res;
+            }
+            m_programtext = ""; // delete buffered program text!
+            res = KEYSTONE_CALL(PlayStream, (char)0, dabindex) ?
+                  RES_PASS : RES_ERR_FAIL;
+            if (res == RES_PASS) {
+                m_playmode = 0; // DAB
+                m_playing = dabindex;
+                if (VERBOSE(VERBOSITY_MSG)) {
+                    m_out << "*MSG:  Zap==" << dabindex
+                          << ", NAME=\"" << m_services.Name(*row) << "\""
+                          << ", EnsembleName=\""
+                          << m_services.EnsembleName(*row) << "\""
+                          << ", ServiceID="
+                          << std::setbase(16) << std::setw(8)
+                          << std::setfill('0')
+                          << m_services.ServiceID(*row)
+                          << std::setbase(10) << std::setfill(' ')
                           << std::endl;
+                }
+            } else if (VERBOSE(VERBOSITY_ERR)) {
+                m_out << "*ERR:  Zap: PlayStream(0, " << dabindex
+                      << ") failed."
+                      << std::endl;
+            }
+        } else { // m_serialopen==false
+            res = RES_WARN_NOTRUN;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: Zap not executed because "
+                      << m_serialname << " is closed."
+                      << std::endl;
+            }
+        }
+        return res;
+    }
+    /* Store channel (-1: the playing one) of the current play mode in  *
+     * preset slot. The mirror of the slots is updated as well.        */
+    int StorePreset(int slot, long channel) {
+        int res;
+        if (!m_serialopen) {
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: StorePreset not executed because "
+                      << m_serialname << " is closed."
+                      << std::endl;
+            }
+            return RES_WARN_NOTRUN;
+        }
+        if (slot < 0 || slot >= KEYSTONE_PRESETS) {
+            if (VERBOSE(VERBOSITY_ERR)) {
+                m_out << "*ERR:  StorePreset: preset " << slot
+                      << " is beyond 0 and " << KEYSTONE_PRESETS - 1 << "."
+                      << std::endl;
+            }
+            return RES_ERR_FAIL;
+        }
+        if (channel < 0 && m_playmode && m_fmfreq) {
+            channel = m_fmfreq;
+        } else if (channel < 0) {
+            channel = !m_playmode && m_playing >= 0 ?
+                      m_playing : KEYSTONE_CALL(GetPlayIndex);
+        }
+        res = channel >= 0 && KEYSTONE_CALL(SetPreset, m_playmode,
+                                            (char)slot, channel) ?
+              RES_PASS : RES_ERR_FAIL;
+        if (res == RES_PASS) {
+            m_presets[(int)m_playmode][slot] = channel;
+            if (VERBOSE(VERBOSITY_MSG)) {
+                m_out << "*MSG:  StorePreset==" << slot << ", ";
+                PrintPreset(m_playmode, channel);
+                m_out << std::endl;
+            }
+        } else if (VERBOSE(VERBOSITY_ERR)) {
+            m_out << "*ERR:  StorePreset: SetPreset("
+                  << (int)m_playmode << ", " << slot << ", " << channel
+                  << ") failed."
+                  << std::endl;
+        }
+        return res;
+    }
+    /* Play preset slot of mode. Once the slot is known, this is a     *
+     * single PlayStream() without reading anything back.              */
+    int RecallPreset(int slot, char mode, long *channel) {
+        int res;
+        *channel = -1;
+        if (!m_serialopen) {
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: RecallPreset not executed because "
+                      << m_serialname << " is closed."
+                      << std::endl;
+            }
+            return RES_WARN_NOTRUN;
+        }
+        if (slot < 0 || slot >= KEYSTONE_PRESETS) {
+            if (VERBOSE(VERBOSITY_ERR)) {
+                m_out << "*ERR:  RecallPreset: preset " << slot
+                      << " is beyond 0 and " << KEYSTONE_PRESETS - 1 << "."
+                      << std::endl;
+            }
+            return RES_ERR_FAIL;
+        }
+        *channel = Preset(mode, slot);
+        if (*channel < 0) {
+            if (VERBOSE(VERBOSITY_ERR)) {
+                m_out << "*ERR:  RecallPreset: preset " << slot
+                      << " of " << (mode ? "FM" : "DAB") << " is empty."
+                      << std::endl;
             }
+            return RES_ERR_FAIL;
+        }
+        m_programtext = ""; // delete buffered program text!
+        res = KEYSTONE_CALL(PlayStream, mode, *channel) ?
+              RES_PASS : RES_ERR_FAIL;
+        if (res == RES_PASS) {
+            m_playmode = mode;
+            m_playing = mode ? -1 : *channel;
+            m_fmfreq = mode ? *channel : m_fmfreq;
+            if (VERBOSE(VERBOSITY_MSG)) {
+                m_out << "*MSG:  RecallPreset==" << slot << ", ";
+                PrintPreset(mode, *channel);
+                m_out << std::endl;
+            }
+        } else if (VERBOSE(VERBOSITY_ERR)) {
+            m_out << "*ERR:  RecallPreset: PlayStream(" << (int)mode
+                  << ", " << *channel << ") failed."
+                  << std::endl;
         }
         return res;
     }
+    /* all preset slots which aren't empty */
+    int ListPresets() {
+        if (!m_serialopen) {
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: ListPresets not executed because "
+                      << m_serialname << " is closed."
+                      << std::endl;
+            }
+            return RES_WARN_NOTRUN;
+        }
+        for (char mode = 0; mode <= 1; mode++) {
+            for (int slot = 0; slot < KEYSTONE_PRESETS; slot++) {
+                long channel = Preset(mode, slot);
+                if (channel >= 0 && VERBOSE(VERBOSITY_MSG)) {
+                    m_out << "*MSG:  Preset " << slot << ": ";
+                    PrintPreset(mode, channel);
+                    m_out << "\n";
+                }
+            }
+        }
+        m_out.flush();
+        return RES_PASS;
+    }
+    /* slot of mode from the mirror, read from the board the first    *
+     * time after OpenSerial(). Empty slots are < 0.                   */
+    long Preset(char mode, int slot) {
+        long &channel = m_presets[(int)mode][slot];
+        if (channel == PRESET_UNKNOWN) {
+            channel = KEYSTONE_CALL(GetPreset, mode, (char)slot);
+        }
+        return channel;
+    }
     int StopStream() {
         int res;
         if (m_serialopen) {
             m_programtext = ""; // delete buffered program text!
-            res = ::StopStream() ? RES_PASS : RES_ERR_FAIL;
+            res = KEYSTONE_CALL(StopStream) ? RES_PASS : RES_ERR_FAIL;
             if (res == RES_PASS) {
-                if (m_verbosity >= VERBOSITY_MSG) {
-                    std::cout << "*MSG:  "
-                              << (m_playmode ? "FM" : "DAB")
-                              << " radio stream stopped."
-                              << std::endl;
+                m_playing = -1;
+                if (VERBOSE(VERBOSITY_MSG)) {
+                    m_out << "*MSG:  "
+                          << (m_playmode ? "FM" : "DAB")
+                          << " radio stream stopped."
+                          << std::endl;
                 }
             } else {
-                if (m_verbosity >= VERBOSITY_ERR) {
-                    std::cout << "*ERR:  StopStream failed."
-                              << std::endl;
+                if (VERBOSE(VERBOSITY_ERR)) {
+                    m_out << "*ERR:  StopStream failed."
+                          << std::endl;
                 }
             }            
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: StopStream not executed because "
-                          << m_serialname << " is already closed."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: StopStream not executed because "
+                      << m_serialname << " is already closed."
+                      << std::endl;
             }
         }
         return res;
@@ -821,19 +1456,19 @@ public:
         int res;
         if (m_serialopen) {
             res = RES_PASS;
-            *count = ::GetTotalProgram(); 
-            if (m_verbosity >= VERBOSITY_MSG) {
-                std::cout << "*MSG:  GetTotalProgram=="
-                          << *count
-                          << std::endl;
+            *count = KEYSTONE_CALL(GetTotalProgram); 
+            if (VERBOSE(VERBOSITY_MSG)) {
+                m_out << "*MSG:  GetTotalProgram=="
+                      << *count
+                      << std::endl;
             }
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: GetTotalProgram not executed "
-                          << "because " << m_serialname
-                          << " is already closed."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: GetTotalProgram not executed "
+                      << "because " << m_serialname
+                      << " is already closed."
+                      << std::endl;
             }
         }
         return res;
@@ -842,18 +1477,18 @@ public:
         int res;
         if (m_serialopen) {
             res = RES_PASS;
-            *idx = ::GetPlayIndex(); 
-            if (m_verbosity >= VERBOSITY_MSG) {
-                std::cout << "*MSG:  GetPlayIndex=="
-                          << *idx
-                          << std::endl;
+            *idx = KEYSTONE_CALL(GetPlayIndex); 
+            if (VERBOSE(VERBOSITY_MSG)) {
+                m_out << "*MSG:  GetPlayIndex=="
+                      << *idx
+                      << std::endl;
             }
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: GetPlayIndex not executed because "
-                          << m_serialname << " is already closed."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: GetPlayIndex not executed because "
+                      << m_serialname << " is already closed."
+                      << std::endl;
             }
         }
         return res;
@@ -864,8 +1499,8 @@ public:
         
         if (m_serialopen) {
             res = RES_PASS;
-            *status = ::GetPlayStatus(); 
-            if (m_verbosity >= VERBOSITY_MSG) {
+            *status = KEYSTONE_CALL(GetPlayStatus); 
+            if (VERBOSE(VERBOSITY_MSG)) {
                 if (*status == 0) {
                     statustext = "playing stream";
                 } else if (*status == 1) {
@@ -877,18 +1512,18 @@ public:
                 } else { 
                     statustext = "unknown play status";
                 }
-                std::cout << "*MSG:  GetPlayStatus=="
-                          << (int)*status
-                          << " (" << statustext << ")"
-                          << std::endl;
+                m_out << "*MSG:  GetPlayStatus=="
+                      << (int)*status
+                      << " (" << statustext << ")"
+                      << std::endl;
             }
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: GetPlayStatus not executed "
-                          << "because " << m_serialname
-                          << " is already closed."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: GetPlayStatus not executed "
+                      << "because " << m_serialname
+                      << " is already closed."
+                      << std::endl;
             }
         }
         return res;
@@ -897,21 +1532,21 @@ public:
         int res;
         if (m_serialopen) {
             res = RES_PASS;
-            *strength = ::GetSignalStrength(bitError); 
-            if (m_verbosity >= VERBOSITY_MSG) {
-                std::cout << "*MSG:  GetSignalStrength=="
-                          << (int)*strength
-                          << ", bitError=="
-                          << *bitError
-                          << std::endl;
+            *strength = KEYSTONE_CALL(GetSignalStrength, bitError); 
+            if (VERBOSE(VERBOSITY_MSG)) {
+                m_out << "*MSG:  GetSignalStrength=="
+                      << (int)*strength
+                      << ", bitError=="
+                      << *bitError
+                      << std::endl;
             }
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: GetSignalStrength not executed "
-                          << "because " << m_serialname
-                          << " is already closed."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: GetSignalStrength not executed "
+                      << "because " << m_serialname
+                      << " is already closed."
+                      << std::endl;
             }
         }
         return res;
@@ -920,18 +1555,18 @@ public:
         int res;
         if (m_serialopen) {
             res = RES_PASS;
-            *datarate = ::GetDataRate(); 
-            if (m_verbosity >= VERBOSITY_MSG) {
-                std::cout << "*MSG:  GetDataRate=="
-                          << *datarate
-                          << std::endl;
+            *datarate = KEYSTONE_CALL(GetDataRate); 
+            if (VERBOSE(VERBOSITY_MSG)) {
+                m_out << "*MSG:  GetDataRate=="
+                      << *datarate
+                      << std::endl;
             }
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: GetDataRate not executed because "
-                          << m_serialname << " is already closed."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: GetDataRate not executed because "
+                      << m_serialname << " is already closed."
+                      << std::endl;
             }
         }
         return res;
@@ -940,49 +1575,80 @@ public:
         int res;
         if (m_serialopen) {
             res = RES_PASS;
-            *samplingrate = ::GetSamplingRate(); 
-            if (m_verbosity >= VERBOSITY_MSG) {
-                std::cout << "*MSG:  GetSamplingRate = "
-                          << *samplingrate
-                          << std::endl;
+            *samplingrate = KEYSTONE_CALL(GetSamplingRate); 
+            if (VERBOSE(VERBOSITY_MSG)) {
+                m_out << "*MSG:  GetSamplingRate = "
+                      << *samplingrate
+                      << std::endl;
             }
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: GetSamplingRate not executed "
-                          << "because " << m_serialname
-                          << " is already closed."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: GetSamplingRate not executed "
+                      << "because " << m_serialname
+                      << " is already closed."
+                      << std::endl;
+            }
+        }
+        return res;
+    }
+    int GetDABSignalQuality(char *quality) {
+        int res;
+        if (m_serialopen) {
+            res = RES_PASS;
+            *quality = KEYSTONE_CALL(GetDABSignalQuality);
+            if (VERBOSE(VERBOSITY_MSG)) {
+                m_out << "*MSG:  GetDABSignalQuality=="
+                      << (int)*quality
+                      << std::endl;
+            }
+        } else { // m_serialopen==false
+            res = RES_WARN_NOTRUN;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: GetDABSignalQuality not executed "
+                      << "because " << m_serialname
+                      << " is already closed."
+                      << std::endl;
             }
         }
         return res;
     }
     int GetProgramName(long dabindex, std::string *programname) { // returns the name of the indexed DAB program
         int res;
+        long row;
         if (m_serialopen) {
-            res = ::GetProgramName(m_playmode, dabindex, 1, wbuf) ? RES_PASS : RES_ERR_FAIL;
+            if (m_playmode) { // FM mode: not in the service table
+                res = KEYSTONE_CALL(GetProgramName, m_playmode, dabindex, 1, wbuf) ? RES_PASS : RES_ERR_FAIL;
+                if (res == RES_PASS) {
+                    wchar_t2char(wbuf, buf);
+                    *programname = std::string(buf); // create a copy from buf!
+                }
+            } else if ((row = FindService(dabindex)) >= 0) {
+                res = RES_PASS;
+                *programname = m_services.Name(row);
+            } else {
+                res = RES_ERR_FAIL;
+            }
             if (res == RES_PASS) {
-                wchar_t2char(wbuf, buf);
-                *programname = std::string(buf); // create a copy from buf!
-                if (m_verbosity >= VERBOSITY_MSG) {
-                    std::cout << "*MSG:  GetProgramName(" << dabindex
-                              << ")==\"" << *programname << "\""
-                              << std::endl;
+                if (VERBOSE(VERBOSITY_MSG)) {
+                    m_out << "*MSG:  GetProgramName(" << dabindex
+                          << ")==\"" << *programname << "\""
+                          << std::endl;
                 }
             } else {
-                if (m_verbosity >= VERBOSITY_ERR) {
-                    std::cout << "*ERR:  GetProgramName(" << dabindex
-                              << ") failed."
-                              << std::endl;
+                if (VERBOSE(VERBOSITY_ERR)) {
+                    m_out << "*ERR:  GetProgramName(" << dabindex
+                          << ") failed."
+                          << std::endl;
                 }
             }            
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: GetProgramName not executed "
-                          << "because " << m_serialname
-                          << " is already closed."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: GetProgramName not executed "
+                      << "because " << m_serialname
+                      << " is already closed."
+                      << std::endl;
             }
         }
         return res;
@@ -990,12 +1656,13 @@ public:
     int GetProgramText(std::string *programtext) { // returns additional information
         int res;
         int verbosity_level;
-        std::string verbosity_label;
+        const char *verbosity_label;
         
         if (m_serialopen) {
-            if (0 == ::GetProgramText(wbuf)) { // data received
+            if (0 == KEYSTONE_CALL(GetProgramText, wbuf)) { // data received
                 wchar_t2char(wbuf, buf);
                 m_programtext = std::string(buf); // create a copy from buf!
+                AddHistory(m_programtext);
                 res = RES_PASS;
                 verbosity_level = VERBOSITY_MSG;
                 verbosity_label = "*MSG:  ";
@@ -1005,62 +1672,115 @@ public:
                 verbosity_label = "*WARN: ";
             }
             *programtext = m_programtext;
-            if (m_verbosity >= verbosity_level) {
-                std::cout << verbosity_label
-                          << "GetProgramText==\""
-                          << *programtext << "\""
-                          << std::endl;
+            if (VERBOSE(verbosity_level)) {
+                m_out << verbosity_label
+                      << "GetProgramText==\""
+                      << *programtext << "\""
+                      << std::endl;
             }
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: GetProgramText not executed "
-                          << "because " << m_serialname
-                          << " is already closed."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: GetProgramText not executed "
+                      << "because " << m_serialname
+                      << " is already closed."
+                      << std::endl;
             }
         }
         return res;
     }
+    /* the program texts received so far by ServiceID */
+    const DlsHistory &TextHistory() const {
+        return m_history;
+    }
+    /* The last n texts of DAB program dabindex, the newest first.     *
+     * *serviceid is the key of TextHistory().                         */
+    int GetHistory(long dabindex, size_t n, uint32_t *serviceid) {
+        long row = FindService(dabindex);
+        size_t count;
+        *serviceid = 0;
+        if (row < 0) {
+            if (VERBOSE(VERBOSITY_ERR)) {
+                m_out << "*ERR:  GetHistory: DAB program " << dabindex
+                      << " is unknown."
+                      << std::endl;
+            }
+            return RES_ERR_FAIL;
+        }
+        *serviceid = m_services.ServiceID(row);
+        if (VERBOSE(VERBOSITY_MSG)) {
+            m_out << "*MSG:  GetHistory==" << dabindex << ", NAME=\""
+                  << m_services.Name(row) << "\"\n";
+            count = m_history.History(*serviceid, n,
+                [this](const DlsHistory::Text &text) {
+                    PrintText(text);
+                });
+            m_out << "  " << count << " texts"
+                  << std::endl;
+        }
+        return RES_PASS;
+    }
+    /* all received texts containing needle */
+    int SearchNowPlaying(std::string_view needle) {
+        size_t count;
+        if (VERBOSE(VERBOSITY_MSG)) {
+            m_out << "*MSG:  SearchNowPlaying==\"" << needle << "\"\n";
+            count = m_history.Search(needle,
+                [this](uint32_t serviceid, const DlsHistory::Text &text) {
+                    long row = m_services.FindServiceID(serviceid);
+                    m_out << "  " << (row >= 0 ? m_services.DABIndex(row)
+                                              : -1)
+                          << " \"" << (row >= 0 ? m_services.Name(row)
+                                                : std::string_view())
+                          << "\":";
+                    PrintText(text);
+                });
+            m_out << "  " << count << " matches"
+                  << std::endl;
+        }
+        return RES_PASS;
+    }
     int GetProgramInfo(long dabindex,
                        unsigned char *serviceComponentID,
                        uint32 *serviceID,
                        uint16 *ensembleID) { // TODO: short info!
         int res;
+        long row;
         if (m_serialopen) {
-            res = ::GetProgramInfo(dabindex,
-                                   serviceComponentID, 
-                                   serviceID,
-                                   ensembleID) ? RES_PASS : RES_ERR_FAIL;
+            row = FindService(dabindex);
+            res = row >= 0 ? RES_PASS : RES_ERR_FAIL;
             if (res == RES_PASS) {
-                if (m_verbosity >= VERBOSITY_MSG) {
-                    std::cout << "*MSG:  GetProgramInfo("
-                              << dabindex << "): "
-                              << "serviceComponentID=="
+                *serviceComponentID = m_services.ServiceComponentID(row);
+                *serviceID = m_services.ServiceID(row);
+                *ensembleID = m_services.EnsembleID(row);
+                if (VERBOSE(VERBOSITY_MSG)) {
+                    m_out << "*MSG:  GetProgramInfo("
+                          << dabindex << "): "
+                          << "serviceComponentID=="
 //                              << std::setbase(16)
 //                              << std::setw(2)
 //                              << std::setfill('0')
-                              << (int)*serviceComponentID
-                              << ", ServiceID=="
+                          << (int)*serviceComponentID
+                          << ", ServiceID=="
 //                              << std::setw(8)
-                              << *serviceID
-                              << ", EnsembleID=="
+                          << *serviceID
+                          << ", EnsembleID=="
 //                              << std::setw(4)
-                              << *ensembleID
-                              << std::endl;
+                          << *ensembleID
+                          << std::endl;
                 }
             } else {
-                if (m_verbosity >= VERBOSITY_ERR) {
-                    std::cout << "*ERR:  GetProgramInfo failed."
-                              << std::endl;
+                if (VERBOSE(VERBOSITY_ERR)) {
+                    m_out << "*ERR:  GetProgramInfo failed."
+                          << std::endl;
                 }
             }            
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: StopStream not executed because "
-                          << m_serialname << " is already closed."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: StopStream not executed because "
+                      << m_serialname << " is already closed."
+                      << std::endl;
             }
         }
         return res;
@@ -1069,32 +1789,41 @@ public:
                         char namemode,
                         std::string *ensemblename) { // returns the multiplex block name of the indexed DAB program
         int res;
+        long row;
         if (m_serialopen) {
-            res = ::GetEnsembleName(dabindex, namemode, wbuf) ? RES_PASS : RES_ERR_FAIL;
+            if (namemode == 1 && (row = FindService(dabindex)) >= 0) {
+                // the service table holds the names of namemode 1
+                res = RES_PASS;
+                *ensemblename = m_services.EnsembleName(row);
+            } else {
+                res = KEYSTONE_CALL(GetEnsembleName, dabindex, namemode, wbuf) ? RES_PASS : RES_ERR_FAIL;
+                if (res == RES_PASS) {
+                    wchar_t2char(wbuf, buf);
+                    *ensemblename = std::string(buf); // create a copy from buf!
+                }
+            }
             if (res == RES_PASS) {
-                wchar_t2char(wbuf, buf);
-                *ensemblename = std::string(buf); // create a copy from buf!
-                if (m_verbosity >= VERBOSITY_MSG) {
-                    std::cout << "*MSG:  GetEnsembleName(" << dabindex
-                              << ", " << (int)namemode
-                              << ")=\"" << *ensemblename << "\""
-                              << std::endl;
+                if (VERBOSE(VERBOSITY_MSG)) {
+                    m_out << "*MSG:  GetEnsembleName(" << dabindex
+                          << ", " << (int)namemode
+                          << ")=\"" << *ensemblename << "\""
+                          << std::endl;
                 }
             } else {
-                if (m_verbosity >= VERBOSITY_ERR) {
-                    std::cout << "*ERR:  GetEnsembleName(" << dabindex
-                              << ", " << (int)namemode
-                              << ") failed."
-                              << std::endl;
+                if (VERBOSE(VERBOSITY_ERR)) {
+                    m_out << "*ERR:  GetEnsembleName(" << dabindex
+                          << ", " << (int)namemode
+                          << ") failed."
+                          << std::endl;
                 }
             }            
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: GetEnsembleName not executed "
-                          << "because " << m_serialname
-                          << " is already closed."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: GetEnsembleName not executed "
+                      << "because " << m_serialname
+                      << " is already closed."
+                      << std::endl;
             }
         }
         return res;
@@ -1103,536 +1832,2481 @@ public:
         int res;
         if (m_serialopen) {
             res = RES_PASS;
-            *freq = ::GetFrequency();
-            if (m_verbosity >= VERBOSITY_MSG) {
-                std::cout << "*MSG:  Getfrequency=="
-                          << (int)*freq
-                          << std::endl;
+            *freq = KEYSTONE_CALL(GetFrequency);
+            if (VERBOSE(VERBOSITY_MSG)) {
+                m_out << "*MSG:  Getfrequency=="
+                      << (int)*freq
+                      << std::endl;
             }
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: GetFrequency not executed because "
-                          << m_serialname << " is closed."
-                          << std::endl;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: GetFrequency not executed because "
+                      << m_serialname << " is closed."
+                      << std::endl;
             }
         }
         return res;
     }
 
-    /* get slideshow images -- TODO: not implemented yet! */
+    /* get slideshow images */
     int MotReset() { // reset/initialize MOT mode (slideshow)
         int res;
         if (m_serialopen) {
             res = RES_PASS;
-            ::MotReset(MOT_HEADER_MODE);
-            if (m_verbosity >= VERBOSITY_MSG) {
-                std::cout << "*MSG:  MotReset==MOT_HEADER_MODE"
-                          << std::endl;
+            KEYSTONE_CALL(MotReset, MOT_HEADER_MODE);
+            m_motprogram = m_playing;
+            if (VERBOSE(VERBOSITY_MSG)) {
+                m_out << "*MSG:  MotReset==MOT_HEADER_MODE"
+                      << std::endl;
             }
         } else { // m_serialopen==false
             res = RES_WARN_NOTRUN;
-            if (m_verbosity >= VERBOSITY_WARN) {
-                std::cout << "*WARN: MotReset not executed because "
-                          << m_serialname << " is closed."
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: MotReset not executed because "
+                      << m_serialname << " is closed."
+                      << std::endl;
+            }
+        }
+        return res;
+    }
+    /* The file name of a new slide of the playing DAB program and its *
+     * ServiceID. The MOT decoder is reset when the program has        *
+     * changed. Without a playing slideshow the board isn't asked.     */
+    int GetMotSlideshowImage(std::string *image, uint32_t *serviceid) {
+        int res;
+        long row = m_playing >= 0 ? m_services.Find(m_playing) : -1;
+        *serviceid = row >= 0 ? m_services.ServiceID(row) : 0;
+        if (!m_serialopen) {
+            res = RES_WARN_NOTRUN;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: GetMotSlideshowImage not executed "
+                      << "because " << m_serialname << " is closed."
+                      << std::endl;
+            }
+        } else if (m_playmode || row < 0 || m_services.ApplicationType(row) !=
+                                            KEYSTONE_APPTYPE_SLIDESHOW) {
+            res = RES_WARN_NOTRUN;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: GetMotSlideshowImage not executed "
+                      << "because no DAB program with a slideshow "
+                      << "is playing."
+                      << std::endl;
+            }
+        } else {
+            if (m_motprogram != m_playing) { // the slides of a new program
+                KEYSTONE_CALL(MotReset, MOT_HEADER_MODE);
+                m_motprogram = m_playing;
+            }
+            if (KEYSTONE_CALL(MotQuery)) {
+                KEYSTONE_CALL(GetImage, wbuf);
+                wchar_t2char(wbuf, buf);
+                *image = buf;
+                res = image->length() ? RES_PASS : RES_ERR_FAIL;
+                if (res == RES_PASS && VERBOSE(VERBOSITY_MSG)) {
+                    m_out << "*MSG:  GetMotSlideshowImage==\""
+                          << *image << "\""
                           << std::endl;
+                } else if (res != RES_PASS && VERBOSE(VERBOSITY_ERR)) {
+                    m_out << "*ERR:  GetMotSlideshowImage: "
+                          << "GetImage returned no file name."
+                          << std::endl;
+                }
+            } else { // no new slide since the last one
+                res = RES_WARN_OLDSLIDE;
+                if (VERBOSE(VERBOSITY_MSG)) {
+                    m_out << "*MSG:  GetMotSlideshowImage: no new slide."
+                          << std::endl;
+                }
             }
         }
         return res;
     }
-    int GetMotSlideshowImage(std::string *image) {
-        int res = RES_ERR_TODO;
-        if (m_verbosity >= VERBOSITY_ERR) {
-            std::cout << "*ERR:  GetMotSlideshowImage "
-                      << "not implemented yet!"
+    
+    /* Harvest the programme guide of the next program of the list, one *
+     * program per call, the identifiers are those of GetProgramInfo(). *
+     * *serviceid is the harvested service, *count its programmes.     */
+    int HarvestEpg(uint32_t *serviceid, long *count) {
+        int res;
+        *serviceid = 0;
+        *count = 0;
+        if (!m_serialopen) {
+            res = RES_WARN_NOTRUN;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: HarvestEpg not executed because "
+                      << m_serialname << " is closed."
+                      << std::endl;
+            }
+        } else if (!::GetEpg) {
+            res = RES_ERR_TODO;
+            if (VERBOSE(VERBOSITY_ERR)) {
+                m_out << "*ERR:  HarvestEpg: libkeystonecomm doesn't "
+                      << "provide GetEpg()."
+                      << std::endl;
+            }
+        } else if (m_services.Size() == 0) {
+            res = RES_WARN_NOTRUN;
+            if (VERBOSE(VERBOSITY_WARN)) {
+                m_out << "*WARN: HarvestEpg not executed because "
+                      << "there are no programs."
+                      << std::endl;
+            }
+        } else {
+            long row = m_epgnext++ % m_services.Size();
+            *serviceid = m_services.ServiceID(row);
+            if (!m_epgservice) { // 160 kB, allocated once
+                m_epgservice.reset(new Service);
+            }
+            res = KEYSTONE_CALL(GetEpg,
+                                (uint16)m_services.EnsembleID(row),
+                                (uint32)*serviceid,
+                                (uint8)m_services.ServiceComponentID(row),
+                                m_epgservice.get()) ?
+                  RES_PASS : RES_ERR_FAIL;
+            if (res == RES_PASS) {
+                const Service &epg = *m_epgservice;
+                m_epg.Begin(*serviceid);
+                for (int i = 0; i < epg.u16PINum &&
+                                i < MAX_PI_PER_SERVICE; i++) {
+                    const Programe &pi = epg.pstPI[i];
+                    const char *name = (const char*)pi.pu8MediumName;
+                    const char *description = (const char*)pi.pu8Discription;
+                    time_t start = ((time_t)pi.stClock.u32MJD - 40587) * 86400 +
+                                   pi.stClock.u8Hour * 3600 +
+                                   pi.stClock.u8Minute * 60;
+                    m_epg.Add(start,
+                              std::string_view(name,
+                                  strnlen(name, sizeof(pi.pu8MediumName))),
+                              std::string_view(description,
+                                  strnlen(description,
+                                          sizeof(pi.pu8Discription))));
+                }
+                m_epg.End(time(nullptr));
+                *count = m_epg.Size(*serviceid);
+                if (VERBOSE(VERBOSITY_DETAIL)) {
+                    m_out << "HarvestEpg: " << *count
+                          << " programmes of \"" << m_services.Name(row)
+                          << "\""
+                          << std::endl;
+                }
+            } else if (VERBOSE(VERBOSITY_DETAIL)) {
+                m_out << "HarvestEpg: no programme guide of \""
+                      << m_services.Name(row) << "\" received yet"
                       << std::endl;
+            }
         }
-        
-//        if (m_serialopen) {
-////std::cout << "MotQuery==";
-//            if (::MotQuery()) {
-////std::cout << "true\n";
-//                ::GetImage(wbuf);
-//                wchar_t2char(wbuf, buf);
-////std::cout << "slideshow==\"" << buf << "\"" << std::endl;
-//                res = RES_PASS;
-//            } else { // ::MotQuery() failed (result == false)
-//std::cout << ".";
-//std::cout.flush();
-//                res = RES_ERR_FAIL;
-//                if (m_verbosity >= VERBOSITY_ERR) {
-//                    std::cout << "*ERR:  "
-//                              << "GetMotSlideshowImage.MotQuery==0 "
-//                              << "(false)"
-//                              << std::endl;
-//                }
-//            }
-//        } else { // m_serialopen==false
-//            res = RES_WARN_NOTRUN;
-//            if (m_verbosity >= VERBOSITY_WARN) {
-//                std::cout << "*WARN: GetMotSlideshowImage not executed "
-//                          << "because " << m_serialname << " is closed."
-//                          << std::endl;
-//            }
-//        }
         return res;
     }
+    /* The programmes of DAB program dabindex running between from and *
+     * to, with next the one after them as well. [*first, *last) are   *
+     * indices of Epg().Get(*serviceid, ...).                          */
+    int GetEpg(long dabindex, time_t from, time_t to, bool next,
+               uint32_t *serviceid, size_t *first, size_t *last) {
+        long row = FindService(dabindex);
+        char start[32];
+        *serviceid = 0;
+        *first = *last = 0;
+        if (row < 0) {
+            if (VERBOSE(VERBOSITY_ERR)) {
+                m_out << "*ERR:  GetEpg: DAB program " << dabindex
+                      << " is unknown."
+                      << std::endl;
+            }
+            return RES_ERR_FAIL;
+        }
+        *serviceid = m_services.ServiceID(row);
+        m_epg.Range(*serviceid, from, to, first, last);
+        if (next && *last < m_epg.Size(*serviceid)) {
+            (*last)++;
+        }
+        if (VERBOSE(VERBOSITY_MSG)) {
+            m_out << "*MSG:  GetEpg==" << dabindex
+                  << ", ServiceID="
+                  << std::setbase(16) << std::setw(8) << std::setfill('0')
+                  << *serviceid
+                  << std::setbase(10) << std::setfill(' ')
+                  << ", " << *last - *first << " programmes\n";
+            for (size_t i = *first; i < *last; i++) {
+                EpgStore::Programme programme = m_epg.Get(*serviceid, i);
+                struct tm tm;
+                localtime_r(&programme.start, &tm);
+                strftime(start, sizeof(start), "%Y-%m-%d %H:%M", &tm);
+                m_out << "  " << start << " \"" << programme.name << "\"";
+                if (programme.description.length()) {
+                    m_out << " \"" << programme.description << "\"";
+                }
+                m_out << "\n";
+            }
+            m_out.flush();
+        }
+        return RES_PASS;
+    }
+    const EpgStore &Epg() const {
+        return m_epg;
+    }
+    
+    /* One sample of the reception into the telemetry rings, taken by  *
+     * the main loop every TELEMETRY_INTERVAL while the board is open  *
+     * and idle.                                                       */
+    int SampleTelemetry() {
+        int32_t values[TELEMETRY_VALUES];
+        int bitError = 0;
+        if (!m_serialopen) {
+            return RES_WARN_NOTRUN;
+        }
+        values[TELEMETRY_STRENGTH] = KEYSTONE_CALL(GetSignalStrength,
+                                                   &bitError);
+        values[TELEMETRY_BITERROR] = bitError;
+        values[TELEMETRY_QUALITY] = m_playmode ? 0 :
+                                    KEYSTONE_CALL(GetDABSignalQuality);
+        values[TELEMETRY_DATARATE] = KEYSTONE_CALL(GetDataRate);
+        values[TELEMETRY_SAMPLINGRATE] = KEYSTONE_CALL(GetSamplingRate);
+        m_telemetry.Add(time(nullptr), values);
+        return RES_PASS;
+    }
+    /* the telemetry buckets of resolution between from and to */
+    int GetTelemetry(int resolution, time_t from, time_t to,
+                     size_t *first, size_t *last) {
+        char start[32];
+        m_telemetry.Range(resolution, from, to, first, last);
+        if (VERBOSE(VERBOSITY_MSG)) {
+            m_out << "*MSG:  GetTelemetry=="
+                  << Telemetry::ResolutionName(resolution)
+                  << ", " << *last - *first << " of "
+                  << m_telemetry.Size(resolution) << " buckets"
+                  << " (min/avg/max)\n";
+            for (size_t i = *first; i < *last; i++) {
+                const Telemetry::Bucket &bucket = m_telemetry.Get(resolution,
+                                                                  i);
+                time_t t = bucket.start;
+                struct tm tm;
+                localtime_r(&t, &tm);
+                strftime(start, sizeof(start), "%Y-%m-%d %H:%M:%S", &tm);
+                m_out << "  " << start << " n=" << bucket.samples;
+                for (int v = 0; v < TELEMETRY_VALUES; v++) {
+                    m_out << " " << Telemetry::ValueName(v) << "="
+                          << bucket.min[v] << "/" << bucket.Average(v)
+                          << "/" << bucket.max[v];
+                }
+                m_out << "\n";
+            }
+            m_out.flush();
+        }
+        return RES_PASS;
+    }
+    const Telemetry &SignalHistory() const {
+        return m_telemetry;
+    }
+    
+    void ForgetPresets() {
+        for (auto &slots : m_presets) {
+            std::fill(std::begin(slots), std::end(slots), PRESET_UNKNOWN);
+        }
+    }
+    /* "DAB 14 "Radio BOB!"" or "FM 98500 kHz "BAYERN 3"" */
+    void PrintPreset(char mode, long channel) {
+        long row = mode ? m_fmservices.Find(channel)
+                        : m_services.Find(channel);
+        if (mode) {
+            m_out << "FM " << channel << " kHz";
+            if (row >= 0) {
+                m_out << " \"" << m_fmservices.Name(row) << "\"";
+            }
+        } else {
+            m_out << "DAB " << channel;
+            if (row >= 0) {
+                m_out << " \"" << m_services.Name(row) << "\"";
+            }
+        }
+    }
+    /* a finished block of DoScan() or DoScanBlocks() */
+    void ScanProgress(int block, long programs, long blocktime,
+                      long elapsed) {
+        if (m_scanprogress) {
+            m_scanprogress(block, programs, blocktime, elapsed);
+        }
+    }
+    /* tune to the FM frequency freq (kHz) for FmScanner: its signal  *
+     * strength in % or the error which stops the search               */
+    int TuneFm(unsigned long freq) {
+        int biterror;
+        int strength;
+        if (m_cancel) {
+            return RES_ERR_CANCEL;
+        }
+        if (!KEYSTONE_CALL(PlayStream, (char)1, freq)) {
+            return RES_ERR_FAIL;
+        }
+        // the library returns a char, unsigned on ARM: -1 arrives as 255
+        strength = KEYSTONE_CALL(GetSignalStrength, &biterror);
+        return strength != (char)-1 ? strength : RES_ERR_FAIL;
+    }
+    /* after measuring: back to m_fmfreq or silence if there is none */
+    void RetuneFm() {
+        if (m_playmode && m_fmfreq) {
+            KEYSTONE_CALL(PlayStream, (char)1, m_fmfreq);
+        } else {
+            KEYSTONE_CALL(StopStream);
+        }
+    }
+    /* keep a new program text of the playing DAB program */
+    void AddHistory(std::string_view text) {
+        long row;
+        if (m_playmode) { // FM: RDS texts aren't kept
+            return;
+        }
+        if (m_playing < 0) { // started before dabd: ask the board once
+            m_playing = KEYSTONE_CALL(GetPlayIndex);
+        }
+        row = m_playing >= 0 ? m_services.Find(m_playing) : -1;
+        if (row >= 0) {
+            m_history.Add(m_services.ServiceID(row), text, time(nullptr),
+                          m_services.Name(row));
+        }
+    }
+    /* one line of GetHistory() and SearchNowPlaying() */
+    void PrintText(const DlsHistory::Text &text) {
+        char first[32];
+        struct tm tm;
+        localtime_r(&text.first, &tm);
+        strftime(first, sizeof(first), "%Y-%m-%d %H:%M:%S", &tm);
+        m_out << "  " << first << " \"" << text.text << "\"";
+        if (text.artist.length()) {
+            m_out << " artist=\"" << text.artist << "\""
+                  << " title=\"" << text.title << "\"";
+        }
+        m_out << "\n";
+    }
+    
+    /* latencies of all KeyStoneCOMM calls since the start or ResetStats() */
+    const CallStats &Stats() const {
+        return m_calls;
+    }
+    int GetStats() {
+        if (VERBOSE(VERBOSITY_MSG)) {
+            m_out << "*MSG:  GetStats==latencies of the KeyStone calls:\n";
+            m_calls.List(m_out);
+            m_out.flush();
+        }
+        return RES_PASS;
+    }
+    int ResetStats() {
+        m_calls.Reset();
+        if (VERBOSE(VERBOSITY_MSG)) {
+            m_out << "*MSG:  ResetStats==latencies cleared."
+                  << std::endl;
+        }
+        return RES_PASS;
+    }
     
     
 private:
+    std::ostream  m_out;
+    std::atomic<bool> m_cancel; // set by Cancel()
+    ScanHandler   m_scanprogress;
     int           m_verbosity;
-    bool          m_serialopen;
+    std::atomic<bool> m_serialopen; // read by the main thread as well
     std::string   m_serialname;
-    char          m_playmode;   // 0==DAB, 1==FM
+    std::string   m_servicedbname; // persistent copy of m_services
+    std::string   m_fmservicedbname; // persistent copy of m_fmservices
+    std::atomic<char> m_playmode; // 0==DAB, 1==FM, see m_serialopen
+    long          m_playing;    // the playing DAB program or -1
+    unsigned long m_fmfreq;     // the tuned FM frequency in kHz or 0
+    long          m_motprogram; // DAB program of the last MotReset
     
     std::string   m_programtext;
     
+    Utf8Converter m_utf8;       // wchar_t labels to UTF-8
+    ServiceTable  m_services;   // program list of the board
+    ServiceTable  m_fmservices; // FM stations by frequency (kHz)
+    CallStats     m_calls;      // latencies of the library calls
+    EpgStore      m_epg;        // programme guides by ServiceID
+    DlsHistory    m_history;    // program texts by ServiceID
+    Telemetry     m_telemetry;  // the reception over time
+    long          m_presets[2][KEYSTONE_PRESETS]; // DAB/FM slots of the board
+    std::unique_ptr<Service> m_epgservice; // filled by ::GetEpg()
+    long          m_epgnext;    // the next program HarvestEpg() asks for
     wchar_t wbuf[KEYSTONE_BUFFER_SIZE];
     char buf[KEYSTONE_BUFFER_SIZE];
 };
         
 
-std::vector<std::string> split(const std::string &s,
-                               char separator,
-                               bool addempty) {
-    std::vector<std::string> output;
-    std::string::size_type prev_pos = 0, pos = 0;
+/************************* command parser ***************************/
+/* everything a command handler needs to know */
+struct CommandContext {
+    KeyStone        &dabradio;
+    const Tokens    &param;     // param[0] is the command
+    std::string_view line;
+    const char      *progname;
+    int              verbosity;
+    std::ostream    &out;
+    JsonWriter      *json;      // typed results ("--protocol=jsonl") or nullptr
+};
+
+/* handlers return the result code of the command */
+typedef int (*CommandHandler)(CommandContext &ctx);
+
+struct CommandEntry {
+    std::string_view name;
+    CommandHandler   handler = nullptr;
+};
+
 
-    while((pos = s.find(separator, pos)) != std::string::npos) {
-        std::string substring(s.substr(prev_pos, pos - prev_pos));
-        if (addempty || substring.length()) {
-            output.push_back(substring);
+/* The channel of "get programname/programinfo/ensemblename [<cha>]": *
+ * the given one or the currently playing program.                    */
+int ChannelParam(CommandContext &ctx, long *dabindex) {
+    char status;
+    long idx;
+    int res;
+    
+    if (ctx.param.size() >= 3) {
+        return ParseNumber(ctx.param[2], dabindex) ? RES_PASS : RES_ERR_SYNTAX;
+    }
+    *dabindex = -1;
+    res = ctx.dabradio.GetPlayStatus(&status);
+    if (res == RES_PASS && status == 0) {
+        res = ctx.dabradio.GetPlayIndex(&idx);
+        if (res == RES_PASS) {
+            *dabindex = idx;
         }
-        prev_pos = ++pos;
     }
-    output.push_back(s.substr(prev_pos, pos - prev_pos)); // Last word
-    return output;
+    return res;
 }
 
-int main(int argc, char *argv[]) {
-    // create and start a separate thread to read from stdin:
-    stdinthr_buf = "";
-    std::thread stdinthread(stdinthr_readparallel);
-    std::string stdinline;
-    std::vector<std::string> param;
-    
-    int verbosity = VERBOSITY_DEBUG;
-    
-    size_t param_errpos;
-    unsigned long param_ulong;
-    long          param_long;
-    int           param_int;
-    uint32        param_uint32;
-    uint16        param_uint16;
-    unsigned char param_uchar;
-    char          param_char;
-    std::string   param_string;
-    
-    
-    KeyStone dabradio(verbosity);
-    long dabindex;
-    int res;
-    
+/* "set <property> <value>": a number or one of two keywords          */
+int ValueParam(CommandContext &ctx,
+               std::string_view keyword0, char value0,
+               std::string_view keyword1, char value1,
+               char *value) {
+    std::string_view token = ctx.param[2];
+    int number;
     
-    param.push_back("help");
-    while (param[0] != "exit" && param[0] != "quit") {
-        if (stdinthr_peek()) { // is a command available?
-            stdinline = stdinthr_readline();
-            stdinline.erase(stdinline.length() - 1); // remove "\n"
-            param = split(stdinline, ' ', false);    // split parameters
+    if (keyword0.length() && token == keyword0) {
+        *value = value0;
+    } else if (keyword1.length() && token == keyword1) {
+        *value = value1;
+    } else if (ParseNumber(token, &number)) {
+        *value = (char)number;
+    } else {
+        return RES_ERR_SYNTAX;
+    }
+    return RES_PASS;
+}
+
+/* get <property> */
+int CmdGetPlayMode(CommandContext &ctx) {
+    char playmode;
+    int res = ctx.dabradio.GetPlayMode(&playmode);
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->Int("playmode", playmode);
+    }
+    return res;
+}
+int CmdGetVolume(CommandContext &ctx) {
+    char volume;
+    int res = ctx.dabradio.GetVolume(&volume);
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->Int("volume", volume);
+    }
+    return res;
+}
+int CmdGetStereo(CommandContext &ctx) {
+    char stereo;
+    int res = ctx.dabradio.GetStereoMode(&stereo);
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->Int("stereo", stereo);
+    }
+    return res;
+}
+int CmdGetTotalProgram(CommandContext &ctx) {
+    long count;
+    int res = ctx.dabradio.GetTotalProgram(&count);
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->Int("totalprogram", count);
+    }
+    return res;
+}
+int CmdGetPlayIndex(CommandContext &ctx) {
+    char status;
+    long idx;
+    int res;
+    
+    res = ctx.dabradio.GetPlayStatus(&status);
+    if (res == RES_PASS && status == 0) {
+        res = ctx.dabradio.GetPlayIndex(&idx);
+    } else {
+        idx = -1;
+        if (VERBOSITY_ENABLED(VERBOSITY_ERR, ctx.verbosity)) {
+            ctx.out << "*ERR:  GetPlayIndex=="
+                    << idx
+                    << std::endl;
         }
-        
-        /* stdin command parser */
-        res = RES_WARN_NONE;
-        if (param[0] == "" || 
-            param[0].substr(0, 1) == "#") { // empty command or comment
-                // do nothing:
-                param[0] = "";
-        } else if (param[0] == "help") {
-            //res = RES_PASS;
-            if (param.size() == 1 ||
-                (param.size() > 1 && param[1] == "help")) {
-                std::cout << argv[0] << " -- help\n"
-                          << "  help                   show this help screen" << "\n"
-                          << "  help <command>         show detailed help on the given command" << "\n"
-                          << "  open                   open serial connection" << "\n"
-                          << "  close                  close serial connection" << "\n"
-                          << "  get <property>         get detailed information with \"help get\"" << "\n"
-                          << "  set <property> <value> get detailed information with \"help set\"" << "\n"
-                          << "  scan                   scan all receivable programs and stores them" << "\n"
-                          << "  list                   print a list of all stored programs" << "\n"
-                          << "  playstream <channel>   start playing the program <channel>" << "\n"
-                          << "  stopstream             stop playing the current program" << "\n"
-                          << "  #<comment>             a comment line which does nothing" << "\n"
-                          << "  ver                    display the program version (v" << VERSION << ")\n" 
-                          << "  sleep <ms>             delay time in milliseconds" << "\n"
-                          << "  exit || quit           exit/quit this application" << "\n"
-                          << "\n"
-                          << "enter these commands for getting started:\n"
-                          << "-----------------------------------------\n"
-                          << "  open\n"
-                          << "  set volume 9\n"
-                          << "  set stereo 1\n"
-                          << "  # scan     # only if necessary\n"
-                          << "  list\n"
-                          << "  playstream 4\n"
-                          << "  close\n"
-                          << "  quit\n";
-            } else if (param[1] == "open") {
-                std::cout << argv[0] << " -- help " << param[1] << "\n"
-                          << "  open the connection to the MonkeyBoard\n";
-            } else if (param[1] == "close") {
-                std::cout << argv[0] << " -- help " << param[1] << "\n"
-                          << "  close the connection to the MonkeyBoard\n";
-            } else if (param[1] == "get") {
-                std::cout << argv[0] << " -- help " << param[1] << "\n"
-                          << "  get the current value of the given property.\n"
-                          << "\n"
-                          << "Properties:\n"
-                          << "  get playmode           playmode: 0=DAB, 1=FM" << "\n"
-                          << "  get volume             volume: 0..16" << "\n"
-                          << "  get stereo             stereo mode: 0=mono, 1=stereo" << "\n"
-                          << "  get totalprogram       total number of stored programs" << "\n"
-                          << "  get playindex          index of currently playing program: 0..totalprogram-1" << "\n"
-                          << "  get playstatus         playstatus: 0=playing, 1=scanning, 2=?, 3=stopped" << "\n"
-                          << "  get signalstrength     0%..100% (a value below 20% isn't sufficient)" << "\n"
-                          << "  get datarate           data rate in kbit/s" << "\n"
-                          << "  get samplingrate       sampling rate in kHz" << "\n"
-                          << "  get programname <cha>  name of the given channel" << "\n"
-                          << "  get programtext        additional text sent by the radio station" << "\n"
-                          << "  get programinfo <cha>  serviceComponentID, ServiceID, EnsembleID" << "\n"
-                          << "  get ensemblename <cha> name of the DAB multiplex block" << "\n";
-            } else if (param[1] == "set") {
-                std::cout << argv[0] << " -- help " << param[1] << "\n"
-                          << "  set the value of the given property.\n"
-                          << "\n"
-                          << "Properties:\n"
-                          << "  set playmode           playmode: 0=DAB, 1=FM" << "\n"
-                          << "  set volume             volume: 0..16" << "\n"
-                          << "  set stereo             stereo mode: 0=mono, 1=stereo" << "\n";
-            } else if (param[1] == "scan") {
-                std::cout << argv[0] << " -- help " << param[1] << "\n"
-                          << "  scan all DAB multiplex blocks for receivable programs\n"
-                          << "  and store them in the internal memory of the MonkeyBoard\n";
-            } else if (param[1] == "list") {
-                std::cout << argv[0] << " -- help " << param[1] << "\n"
-                          << "  list all programs stored in the internal memory of the MonkeyBoard\n";
-            } else if (param[1] == "playstream") {
-                std::cout << argv[0] << " -- help " << param[1] << "\n"
-                          << "  start playback of the program defined by the given channel\n";
-            } else if (param[1] == "stopstream") {
-                std::cout << argv[0] << " -- help " << param[1] << "\n"
-                          << "  stop playback of the currently playing program\n";
-            } else if (param[1] == "ver") {
-                std::cout << argv[0] << " -- help " << param[1] << "\n"
-                          << "  print the program version to stdout.\n"
-                          << "  The verbosity level must be higher or equal to "
-                          << VERBOSITY_MSG << ".\n";
-            } else if (param[1] == "sleep") {
-                std::cout << argv[0] << " -- help " << param[1] << "\n"
-                          << "  perform a delay of the given value in milliseconds\n"
-                          << "  this may be helpful in command scripts\n";
-            } else if (param[1] == "exit" || param[1] == "quit") {
-                std::cout << argv[0] << " -- help " << param[1] << "\n"
-                          << "  leave this application\n";
-            } else { // unknown help command
-                std::cout << argv[0] << " -- help " << param[1] << "\n"
-                          << "  unknown command \"" << param[1] << "\"\n";
-            }
-            std::cout << std::endl;
-            param[0] = "";
-        } else if (param[0] == "open") {
-            res = dabradio.OpenSerial();
-            param[0] = "";
-        } else if (param[0] == "close") {
-            res = dabradio.CloseSerial();
-            param[0] = "";
-        } else if (param[0] == "get") {
-            if (param.size() >= 2) {
-                if (param[1] == "playmode") {
-                    res = dabradio.GetPlayMode(&param_char);
-                } else if (param[1] == "volume") {
-                    res = dabradio.GetVolume(&param_char);
-                } else if (param[1] == "stereo") {
-                    res = dabradio.GetStereoMode(&param_char);
-                } else if (param[1] == "totalprogram") {
-                    res = dabradio.GetTotalProgram(&param_long);
-                } else if (param[1] == "playindex") {
-                    res = dabradio.GetPlayStatus(&param_char);
-                    if (res == RES_PASS && param_char == 0) {
-                        res = dabradio.GetPlayIndex(&param_long);
-                    } else {
-                        param_long = -1;
-                        if (verbosity >= VERBOSITY_ERR) {
-                            std::cout << "*ERR:  GetPlayIndex=="
-                                      << param_long
-                                      << std::endl;
-                        }
-                    }
-                } else if (param[1] == "playstatus") {
-                    res = dabradio.GetPlayStatus(&param_char);
-                } else if (param[1] == "signalstrength") {
-                    res = dabradio.GetSignalStrength(&param_char,
-                                                     &param_int);
-                } else if (param[1] == "datarate") {
-                    res = dabradio.GetDataRate(&param_int);
-                } else if (param[1] == "samplingrate") {
-                    res = dabradio.GetSamplingRate(&param_int);
-                } else if (param[1] == "programname") {
-                    if (param.size() >= 3) {
-                        try {
-                            dabindex = std::stol(param[2],
-                                                 &param_errpos);
-                        }
-                        catch (...) {
-                            res = RES_ERR_SYNTAX;
-                        }
-                        if (param_errpos < param[2].length()) {
-                            // don't accept partial conversion:
-                            res = RES_ERR_SYNTAX;
-                        }
-                    } else { // no dabindex given
-                        // take the current playing index
-                        dabindex = -1;
-                        res = dabradio.GetPlayStatus(&param_char);
-                        if (res == RES_PASS && param_char == 0) {
-                            res = dabradio.GetPlayIndex(&param_long);
-                            if (res == RES_PASS) {
-                                dabindex = param_long;
-                            }
-                        }
-                    }
-                    if (res != RES_ERR_SYNTAX) {
-                        res = dabradio.GetProgramName(dabindex,
-                                                      &param_string);
-                    }
-                } else if (param[1] == "programtext") {
-                    res = dabradio.GetProgramText(&param_string);
-                } else if (param[1] == "programinfo") {
-                    if (param.size() >= 3) {
-                        try {
-                            dabindex = std::stol(param[2],
-                                                 &param_errpos);
-                        }
-                        catch (...) {
-                            res = RES_ERR_SYNTAX;
-                        }
-                        if (param_errpos < param[2].length()) {
-                            // don't accept partial conversion:
-                            res = RES_ERR_SYNTAX;
-                        }
-                    } else { // no dabindex given
-                        // take the current playing index
-                        dabindex = -1;
-                        res = dabradio.GetPlayStatus(&param_char);
-                        if (res == RES_PASS && param_char == 0) {
-                            res = dabradio.GetPlayIndex(&param_long);
-                            if (res == RES_PASS) {
-                                dabindex = param_long;
-                            }
-                        }
-                    }
-                    if (res != RES_ERR_SYNTAX) {
-                        res = dabradio.GetProgramInfo(dabindex,
-                                                      &param_uchar,
-                                                      &param_uint32,
-                                                      &param_uint16);
-                    }
-                } else if (param[1] == "ensemblename") {
-                    if (param.size() >= 3) {
-                        try {
-                            dabindex = std::stol(param[2],
-                                                 &param_errpos);
-                        }
-                        catch (...) {
-                            res = RES_ERR_SYNTAX;
-                        }
-                        if (param_errpos < param[2].length()) {
-                            // don't accept partial conversion:
-                            res = RES_ERR_SYNTAX;
-                        }
-                    } else { // no dabindex given
-                        // take the current playing index
-                        dabindex = -1;
-                        res = dabradio.GetPlayStatus(&param_char);
-                        if (res == RES_PASS && param_char == 0) {
-                            res = dabradio.GetPlayIndex(&param_long);
-                            if (res == RES_PASS) {
-                                dabindex = param_long;
-                            }
-                        }
-                    }
-                    if (res != RES_ERR_SYNTAX) {
-                        res = dabradio.GetEnsembleName(dabindex,
-                                                       0,
-                                                       &param_string);
+    }
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->Int("playindex", idx);
+    }
+    return res;
+}
+int CmdGetPlayStatus(CommandContext &ctx) {
+    char status;
+    int res = ctx.dabradio.GetPlayStatus(&status);
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->Int("playstatus", status);
+    }
+    return res;
+}
+int CmdGetSignalStrength(CommandContext &ctx) {
+    char strength;
+    int bitError;
+    int res = ctx.dabradio.GetSignalStrength(&strength, &bitError);
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->Int("signalstrength", strength);
+        ctx.json->Int("biterror", bitError);
+    }
+    return res;
+}
+int CmdGetDataRate(CommandContext &ctx) {
+    int datarate;
+    int res = ctx.dabradio.GetDataRate(&datarate);
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->Int("datarate", datarate);
+    }
+    return res;
+}
+int CmdGetSamplingRate(CommandContext &ctx) {
+    int samplingrate;
+    int res = ctx.dabradio.GetSamplingRate(&samplingrate);
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->Int("samplingrate", samplingrate);
+    }
+    return res;
+}
+int CmdGetSignalQuality(CommandContext &ctx) {
+    char quality;
+    int res = ctx.dabradio.GetDABSignalQuality(&quality);
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->Int("signalquality", quality);
+    }
+    return res;
+}
+/* get telemetry [s|min|h] [<t1> <t2>] */
+int CmdGetTelemetry(CommandContext &ctx) {
+    int resolution = TELEMETRY_MINUTES;
+    long from = 0;
+    long to = time(nullptr) + 1;
+    size_t first;
+    size_t last;
+    int res;
+    
+    if (ctx.param.size() >= 3 &&
+            (resolution = Telemetry::Resolution(ctx.param[2])) < 0) {
+        return RES_ERR_SYNTAX;
+    }
+    if (ctx.param.size() >= 4 && (ctx.param.size() != 5 ||
+                                  !ParseNumber(ctx.param[3], &from) ||
+                                  !ParseNumber(ctx.param[4], &to))) {
+        return RES_ERR_SYNTAX;
+    }
+    res = ctx.dabradio.GetTelemetry(resolution, from, to, &first, &last);
+    if (ctx.json && res == RES_PASS) {
+        const Telemetry &telemetry = ctx.dabradio.SignalHistory();
+        ctx.json->String("resolution", Telemetry::ResolutionName(resolution));
+        ctx.json->BeginArray("telemetry");
+        for (size_t i = first; i < last; i++) {
+            const Telemetry::Bucket &bucket = telemetry.Get(resolution, i);
+            ctx.json->BeginObject();
+            ctx.json->Int("start", bucket.start);
+            ctx.json->Int("samples", bucket.samples);
+            for (int v = 0; v < TELEMETRY_VALUES; v++) {
+                ctx.json->BeginObject(Telemetry::ValueName(v));
+                ctx.json->Int("min", bucket.min[v]);
+                ctx.json->Int("avg", bucket.Average(v));
+                ctx.json->Int("max", bucket.max[v]);
+                ctx.json->EndObject();
+            }
+            ctx.json->EndObject();
+        }
+        ctx.json->EndArray();
+    }
+    return res;
+}
+int CmdGetProgramName(CommandContext &ctx) {
+    std::string programname;
+    long dabindex;
+    int res;
+    
+    res = ChannelParam(ctx, &dabindex);
+    if (res != RES_ERR_SYNTAX) {
+        res = ctx.dabradio.GetProgramName(dabindex, &programname);
+    }
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->Int("channel", dabindex);
+        ctx.json->String("programname", programname);
+    }
+    return res;
+}
+int CmdGetEpg(CommandContext &ctx) {
+    time_t now = time(nullptr);
+    long dabindex;
+    long from = now;
+    long to = now + 1;
+    uint32_t serviceid;
+    size_t first;
+    size_t last;
+    bool nownext = ctx.param.size() < 4;
+    int res;
+    
+    res = ChannelParam(ctx, &dabindex);
+    if (!nownext && (ctx.param.size() < 5 ||
+                     !ParseNumber(ctx.param[3], &from) ||
+                     !ParseNumber(ctx.param[4], &to))) {
+        res = RES_ERR_SYNTAX;
+    }
+    if (res != RES_ERR_SYNTAX) {
+        res = ctx.dabradio.GetEpg(dabindex, from, to, nownext,
+                                  &serviceid, &first, &last);
+    }
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->Int("channel", dabindex);
+        ctx.json->Int("serviceid", serviceid);
+        ctx.json->BeginArray("epg");
+        for (size_t i = first; i < last; i++) {
+            EpgStore::Programme programme = ctx.dabradio.Epg().Get(serviceid,
+                                                                   i);
+            ctx.json->BeginObject();
+            ctx.json->Int("start", programme.start);
+            ctx.json->Int("end", programme.end);
+            ctx.json->String("name", programme.name);
+            ctx.json->String("description", programme.description);
+            ctx.json->EndObject();
+        }
+        ctx.json->EndArray();
+    }
+    return res;
+}
+int CmdGetProgramText(CommandContext &ctx) {
+    std::string programtext;
+    int res = ctx.dabradio.GetProgramText(&programtext);
+    if (ctx.json && (res == RES_PASS || res == RES_WARN_OLDTEXT)) {
+        ctx.json->String("programtext", programtext);
+    }
+    return res;
+}
+int CmdGetProgramInfo(CommandContext &ctx) {
+    unsigned char serviceComponentID;
+    uint32 serviceID;
+    uint16 ensembleID;
+    long dabindex;
+    int res;
+    
+    res = ChannelParam(ctx, &dabindex);
+    if (res != RES_ERR_SYNTAX) {
+        res = ctx.dabradio.GetProgramInfo(dabindex,
+                                          &serviceComponentID,
+                                          &serviceID,
+                                          &ensembleID);
+    }
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->Int("channel", dabindex);
+        ctx.json->Int("servicecomponentid", serviceComponentID);
+        ctx.json->Int("serviceid", serviceID);
+        ctx.json->Int("ensembleid", ensembleID);
+    }
+    return res;
+}
+int CmdGetEnsembleName(CommandContext &ctx) {
+    std::string ensemblename;
+    long dabindex;
+    int res;
+    
+    res = ChannelParam(ctx, &dabindex);
+    if (res != RES_ERR_SYNTAX) {
+        res = ctx.dabradio.GetEnsembleName(dabindex, 1, &ensemblename);
+    }
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->Int("channel", dabindex);
+        ctx.json->String("ensemblename", ensemblename);
+    }
+    return res;
+}
+int CmdGetFrequency(CommandContext &ctx) {
+    char freq;
+    int res = ctx.dabradio.GetFrequency(&freq);
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->Int("frequency", freq);
+    }
+    return res;
+}
+int CmdGetStats(CommandContext &ctx) {
+    int res = ctx.dabradio.GetStats();
+    if (ctx.json) {
+        ctx.dabradio.Stats().List(ctx.json);
+    }
+    return res;
+}
+
+static constexpr CommandEntry getproperties[] = {
+    {"playmode",       CmdGetPlayMode},
+    {"volume",         CmdGetVolume},
+    {"stereo",         CmdGetStereo},
+    {"totalprogram",   CmdGetTotalProgram},
+    {"playindex",      CmdGetPlayIndex},
+    {"playstatus",     CmdGetPlayStatus},
+    {"signalstrength", CmdGetSignalStrength},
+    {"datarate",       CmdGetDataRate},
+    {"samplingrate",   CmdGetSamplingRate},
+    {"signalquality",  CmdGetSignalQuality},
+    {"programname",    CmdGetProgramName},
+    {"programtext",    CmdGetProgramText},
+    {"programinfo",    CmdGetProgramInfo},
+    {"ensemblename",   CmdGetEnsembleName},
+    {"frequency",      CmdGetFrequency},
+    {"stats",          CmdGetStats},
+    {"epg",            CmdGetEpg},
+    {"telemetry",      CmdGetTelemetry},
+};
+static constexpr DispatchTable getpropertytable(getproperties);
+
+/* set <property> <value> */
+int CmdSetPlayMode(CommandContext &ctx) {
+    char playmode;
+    int res = ValueParam(ctx, "dab", 0, "fm", 1, &playmode);
+    if (res != RES_ERR_SYNTAX) {
+        res = ctx.dabradio.SetPlayMode(playmode);
+    }
+    return res;
+}
+int CmdSetVolume(CommandContext &ctx) {
+    char volume;
+    int res = ValueParam(ctx, "+", '+', "-", '-', &volume);
+    if (res != RES_ERR_SYNTAX) {
+        res = ctx.dabradio.SetVolume(volume);
+    }
+    return res;
+}
+int CmdSetStereo(CommandContext &ctx) {
+    char stereo;
+    int res = ValueParam(ctx, "", 0, "", 0, &stereo);
+    if (res != RES_ERR_SYNTAX) {
+        res = ctx.dabradio.SetStereoMode(stereo);
+    }
+    return res;
+}
+
+static constexpr CommandEntry setproperties[] = {
+    {"playmode", CmdSetPlayMode},
+    {"volume",   CmdSetVolume},
+    {"stereo",   CmdSetStereo},
+};
+static constexpr DispatchTable setpropertytable(setproperties);
+
+/* commands */
+int CmdHelp(CommandContext &ctx) {
+    const Tokens &param = ctx.param;
+    const char *progname = ctx.progname;
+    std::ostringstream text;
+    std::ostream &out = ctx.json ? text : ctx.out;
+    
+    if (param.size() == 1 || param[1] == "help") {
+        out << progname << " -- help\n"
+            << "  help                   show this help screen" << "\n"
+            << "  help <command>         show detailed help on the given command" << "\n"
+            << "  open                   open serial connection" << "\n"
+            << "  close                  close serial connection" << "\n"
+            << "  get <property>         get detailed information with \"help get\"" << "\n"
+            << "  set <property> <value> get detailed information with \"help set\"" << "\n"
+            << "  scan [<blocks>]        scan all receivable programs and stores them" << "\n"
+            << "  list                   print a list of all stored programs" << "\n"
+            << "  playstream <channel>   start playing the program <channel>" << "\n"
+            << "  zap <channel>          switch to the DAB program <channel> at once" << "\n"
+            << "  preset store <n> || recall <n> || list" << "\n"
+            << "                         the preset slots 0..9 of the MonkeyBoard" << "\n"
+            << "  seek up || seek down   tune to the next strong FM station" << "\n"
+            << "  stopstream             stop playing the current program" << "\n"
+            << "  history [<cha>] [<n>]  the last <n> program texts of <cha>" << "\n"
+            << "  search nowplaying <text>" << "\n"
+            << "                         the received program texts containing <text>" << "\n"
+            << "  #<comment>             a comment line which does nothing" << "\n"
+            << "  ver                    display the program version (v" << VERSION << ")\n" 
+            << "  sleep <ms>             delay time in milliseconds" << "\n"
+            << "  batch [stoponerror]    the commands up to \"end\" with one result" << "\n"
+            << "  run [stoponerror] <file>" << "\n"
+            << "                         the commands of <file> with one result" << "\n"
+            << "  reset stats            clear the latencies of \"get stats\"" << "\n"
+            << "  cancel [<id>]          cancel a queued or the running request" << "\n"
+            << "  subscribe <prop> <ms>  push <prop> whenever its value changes" << "\n"
+            << "  unsubscribe <prop>     stop pushing <prop> (\"all\": all properties)" << "\n"
+            << "  exit || quit           exit/quit this application" << "\n"
+            << "  [@<id>] [timeout <ms>] <command>" << "\n"
+            << "                         tag a command with an id and a deadline" << "\n"
+            << "\n"
+            << "enter these commands for getting started:\n"
+            << "-----------------------------------------\n"
+            << "  open\n"
+            << "  set volume 9\n"
+            << "  set stereo 1\n"
+            << "  # scan     # only if necessary\n"
+            << "  list\n"
+            << "  playstream 4\n"
+            << "  close\n"
+            << "  quit\n";
+    } else if (param[1] == "open") {
+        out << progname << " -- help " << param[1] << "\n"
+            << "  open the connection to the MonkeyBoard\n";
+    } else if (param[1] == "close") {
+        out << progname << " -- help " << param[1] << "\n"
+            << "  close the connection to the MonkeyBoard\n";
+    } else if (param[1] == "get") {
+        out << progname << " -- help " << param[1] << "\n"
+            << "  get the current value of the given property.\n"
+            << "\n"
+            << "Properties:\n"
+            << "  get playmode           playmode: 0=DAB, 1=FM" << "\n"
+            << "  get volume             volume: 0..16" << "\n"
+            << "  get stereo             stereo mode: 0=mono, 1=stereo" << "\n"
+            << "  get totalprogram       total number of stored programs" << "\n"
+            << "  get playindex          index of currently playing program: 0..totalprogram-1" << "\n"
+            << "  get playstatus         playstatus: 0=playing, 1=scanning, 2=?, 3=stopped" << "\n"
+            << "  get signalstrength     0%..100% (a value below 20% isn't sufficient)" << "\n"
+            << "  get datarate           data rate in kbit/s" << "\n"
+            << "  get samplingrate       sampling rate in kHz" << "\n"
+            << "  get signalquality      DAB signal quality: 0..100" << "\n"
+            << "  get programname <cha>  name of the given channel" << "\n"
+            << "  get programtext        additional text sent by the radio station" << "\n"
+            << "  get programinfo <cha>  serviceComponentID, ServiceID, EnsembleID" << "\n"
+            << "  get ensemblename <cha> name of the DAB multiplex block" << "\n"
+            << "  get stats              latencies of the KeyStone library calls" << "\n"
+            << "  get slide [<hash>]     a received MOT slide, base64 encoded" << "\n"
+            << "  get epg <cha>          programme guide: now and next" << "\n"
+            << "  get epg <cha> <t1> <t2>  programmes between t1 and t2 (seconds since 1970)" << "\n"
+            << "  get telemetry [s|min|h] [<t1> <t2>]" << "\n"
+            << "                         min/avg/max of the reception per second/minute/hour" << "\n";
+    } else if (param[1] == "set") {
+        out << progname << " -- help " << param[1] << "\n"
+            << "  set the value of the given property.\n"
+            << "\n"
+            << "Properties:\n"
+            << "  set playmode           playmode: 0=DAB, 1=FM" << "\n"
+            << "  set volume             volume: 0..16" << "\n"
+            << "  set stereo             stereo mode: 0=mono, 1=stereo" << "\n";
+    } else if (param[1] == "scan") {
+        out << progname << " -- help " << param[1] << "\n"
+            << "  scan all DAB multiplex blocks for receivable programs\n"
+            << "  and store them in the internal memory of the MonkeyBoard\n"
+            << "\n"
+            << "  scan                   clear the program list and scan all blocks" << "\n"
+            << "  scan <from> <to>       scan the blocks <from>..<to>, e.g. scan 5C 7D" << "\n"
+            << "  scan blocks <b1>,<b2>  scan the given blocks, e.g. scan blocks 5C,11D" << "\n"
+            << "  blocks can be given by name (5A..13F) or by index (0..40)." << "\n"
+            << "  Partial scans keep the known programs and report the new ones\n"
+            << "  after each block.\n"
+            << "  Every finished block is announced as\n"
+            << "  *EVT:  scan==<block>, index <i>, <n> programs, <ms> ms, <ms> ms totally\n"
+            << "\n"
+            << "  In FM mode (set playmode 1) scan measures the signal strength\n"
+            << "  of the band " << FM_BAND_LOW << ".." << FM_BAND_HIGH << " kHz every " << FMSCAN_COARSE_STEP << " kHz and then on\n"
+            << "  the " << FMSCAN_FINE_STEP << " kHz raster around the peaks only. The stations are\n"
+            << "  kept by dabd with their frequency as channel.\n";
+    } else if (param[1] == "list") {
+        out << progname << " -- help " << param[1] << "\n"
+            << "  list all programs stored in the internal memory of the MonkeyBoard\n"
+            << "  the list is read once after \"open\" or \"scan\" and kept in memory\n"
+            << "  in FM mode: the stations of the last FM scan, channel is the frequency\n";
+    } else if (param[1] == "playstream") {
+        out << progname << " -- help " << param[1] << "\n"
+            << "  start playback of the program defined by the given channel\n";
+    } else if (param[1] == "preset") {
+        out << progname << " -- help " << param[1] << "\n"
+            << "  preset store <n> [<channel>]\n"
+            << "  store the playing or the given channel of the current play mode\n"
+            << "  in the preset slot <n> (0.." << KEYSTONE_PRESETS - 1 << ") of the MonkeyBoard\n"
+            << "  preset recall <n> [dab|fm]\n"
+            << "  play the preset <n> of the current or the given mode\n"
+            << "  preset list\n"
+            << "  all presets which aren't empty\n"
+            << "  The presets are read once after \"open\" and kept in memory.\n";
+    } else if (param[1] == "seek") {
+        out << progname << " -- help " << param[1] << "\n"
+            << "  seek up || seek down\n"
+            << "  tune to the next FM station above or below the tuned frequency\n"
+            << "  with a signal strength of at least " << FMSCAN_STRONG << "%, around the band\n"
+            << "  if necessary. The play mode becomes FM.\n";
+    } else if (param[1] == "stopstream") {
+        out << progname << " -- help " << param[1] << "\n"
+            << "  stop playback of the currently playing program\n";
+    } else if (param[1] == "history") {
+        out << progname << " -- help " << param[1] << "\n"
+            << "  history [<channel>] [<n>]\n"
+            << "  the last <n> (default " << DLSHISTORY_ENTRIES << ") different program texts received\n"
+            << "  from the given or the playing DAB program, the newest first.\n"
+            << "  \"Artist - Title\" texts are shown split into artist and title.\n";
+    } else if (param[1] == "search") {
+        out << progname << " -- help " << param[1] << "\n"
+            << "  search nowplaying <text>\n"
+            << "  all program texts received since the start which contain <text>,\n"
+            << "  the case of letters doesn't matter\n";
+    } else if (param[1] == "ver") {
+        out << progname << " -- help " << param[1] << "\n"
+            << "  print the program version to stdout.\n"
+            << "  The verbosity level must be higher or equal to "
+            << VERBOSITY_MSG << ".\n";
+    } else if (param[1] == "sleep") {
+        out << progname << " -- help " << param[1] << "\n"
+            << "  perform a delay of the given value in milliseconds\n"
+            << "  this may be helpful in command scripts. The later commands of\n"
+            << "  the same client wait, those of other clients don't.\n";
+    } else if (param[1] == "batch" || param[1] == "run") {
+        out << progname << " -- help " << param[1] << "\n"
+            << "  batch [stoponerror]\n"
+            << "  <command>\n"
+            << "  ...\n"
+            << "  end\n"
+            << "  run [stoponerror] <file>\n"
+            << "  execute the commands up to \"end\" or the commands of <file> one\n"
+            << "  after another. They print their messages but get a single\n"
+            << "  result: the first error or 0. With \"stoponerror\" the first error\n"
+            << "  ends the script. \"sleep\" doesn't block other clients here.\n"
+            << "  subscribe, cancel, quit, get slide, batch and run can't be part\n"
+            << "  of a script.\n"
+            << "  \"dabd -x <file>\" runs <file> at the start.\n";
+    } else if (param[1] == "cancel") {
+        out << progname << " -- help " << param[1] << "\n"
+            << "  cancel [<id>]\n"
+            << "  remove the queued request <id> or stop the running request,\n"
+            << "  a running scan is aborted. Without <id> the running request\n"
+            << "  is cancelled.\n";
+    } else if (param[1] == "subscribe" || param[1] == "unsubscribe") {
+        out << progname << " -- help " << param[1] << "\n"
+            << "  subscribe <property> [<interval>]\n"
+            << "  unsubscribe <property> || all\n"
+            << "  dabd reads <property> every <interval> milliseconds (default 1000,\n"
+            << "  at least " << SUBSCRIPTION_MIN_INTERVAL << ") and sends it only if its value has changed:\n"
+            << "    *EVT:  <property>==<value>\n"
+            << "  subscribe without parameters lists the subscriptions.\n"
+            << "\n"
+            << "Properties:\n"
+            << "  programtext, signalstrength, datarate, samplingrate,\n"
+            << "  playstatus, playindex\n";
+    } else if (param[1] == "timeout" || param[1][0] == '@') {
+        out << progname << " -- help " << param[1] << "\n"
+            << "  [@<id>] [timeout <ms>] <command>\n"
+            << "  Commands for the MonkeyBoard are queued and executed one after\n"
+            << "  another by a separate thread. Each command gets an id which is\n"
+            << "  given back with its result: \"*RES:  <result> @<id>\".\n"
+            << "  @<id> chooses the id, otherwise the commands are numbered.\n"
+            << "  timeout <ms> gives up the command after <ms> milliseconds with\n"
+            << "  result " << RES_ERR_TIMEOUT << ", a running scan is aborted.\n";
+    } else if (param[1] == "exit" || param[1] == "quit") {
+        out << progname << " -- help " << param[1] << "\n"
+            << "  leave this application\n";
+    } else { // unknown help command
+        out << progname << " -- help " << param[1] << "\n"
+            << "  unknown command \"" << param[1] << "\"\n";
+    }
+    out << std::endl;
+    if (ctx.json) {
+        ctx.json->String("help", text.str());
+    }
+    return RES_WARN_NONE;
+}
+int CmdOpen(CommandContext &ctx) {
+    return ctx.dabradio.OpenSerial();
+}
+int CmdClose(CommandContext &ctx) {
+    return ctx.dabradio.CloseSerial();
+}
+int CmdGet(CommandContext &ctx) {
+    const CommandEntry *property = getpropertytable.Find(ctx.param[1]);
+    return property ? property->handler(ctx) : RES_ERR_SYNTAX;
+}
+int CmdSet(CommandContext &ctx) {
+    const CommandEntry *property = setpropertytable.Find(ctx.param[1]);
+    if (ctx.param.size() < 3 || !property) {
+        return RES_ERR_SYNTAX;
+    }
+    return property->handler(ctx);
+}
+/* scan <from> <to> || scan blocks <b1>,<b2>,... */
+int ScanBlocks(CommandContext &ctx) {
+    const Tokens &param = ctx.param;
+    std::vector<int> blocks;
+    Tokens blocknames;
+    int res = RES_PASS;
+    
+    if (param[1] == "blocks" && param.size() == 3) {
+        blocknames.Split(param[2], ',');
+    } else if (param.size() == 3) { // <from> <to>
+        blocknames.Split(param.From(1, ctx.line));
+    }
+    for (size_t i = 0; i < blocknames.size(); i++) {
+        int block = KeyStone::DABBlockIndex(blocknames[i]);
+        if (block < 0 && !ParseNumber(blocknames[i], &block)) {
+            block = -1; // neither a block name nor an index
+        }
+        if (block < 0 || block >= DAB_MUXBLOCKS) {
+            res = RES_ERR_SYNTAX;
+        }
+        blocks.push_back(block);
+    }
+    if (blocks.empty() || blocknames.Overflow()) {
+        res = RES_ERR_SYNTAX;
+    } else if (param[1] != "blocks" && blocks[0] > blocks[1]) {
+        res = RES_ERR_SYNTAX;
+        if (VERBOSITY_ENABLED(VERBOSITY_ERR, ctx.verbosity)) {
+            ctx.out << "*ERR:  scan: block " << blocknames[0]
+                    << " is behind block " << blocknames[1] << "."
+                    << std::endl;
+        }
+    } else if (param[1] != "blocks") { // range <from> <to>
+        int from = blocks[0];
+        int to = blocks[1];
+        blocks.clear();
+        for (int block = from; block <= to; block++) {
+            blocks.push_back(block);
+        }
+    }
+    if (res != RES_ERR_SYNTAX) {
+        res = ctx.dabradio.DoScanBlocks(blocks);
+    }
+    return res;
+}
+int CmdScan(CommandContext &ctx) {
+    const Tokens &param = ctx.param;
+    int res;
+    
+    if (param.size() == 1) { // all blocks or the FM band
+        res = ctx.dabradio.DoScan();
+    } else {
+        res = ScanBlocks(ctx);
+    }
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->Int("totalprogram", ctx.dabradio.PlayMode() ?
+                      ctx.dabradio.FmServices().Size() :
+                      ctx.dabradio.Services().Size());
+    }
+    return res;
+}
+/* list in FM mode: the stations of the last FM scan */
+int ListFm(CommandContext &ctx) {
+    int res = ctx.dabradio.FMProgramList();
+    if (ctx.json && res == RES_PASS) {
+        const ServiceTable &services = ctx.dabradio.FmServices();
+        ctx.json->BeginArray("programs");
+        for (long row = 0; row < services.Size(); row++) {
+            ctx.json->BeginObject();
+            ctx.json->Int("channel", services.DABIndex(row));
+            ctx.json->String("name", services.Name(row));
+            ctx.json->Int("programtype", services.ProgramType(row));
+            ctx.json->EndObject();
+        }
+        ctx.json->EndArray();
+    }
+    return res;
+}
+int CmdList(CommandContext &ctx) {
+    int res;
+    if (ctx.dabradio.PlayMode()) {
+        return ListFm(ctx);
+    }
+    res = ctx.dabradio.DABProgramList();
+    if (ctx.json && res == RES_PASS) {
+        const ServiceTable &services = ctx.dabradio.Services();
+        ctx.json->BeginArray("programs");
+        for (long row = 0; row < services.Size(); row++) {
+            ctx.json->BeginObject();
+            ctx.json->Int("channel", services.DABIndex(row));
+            ctx.json->String("name", services.Name(row));
+            ctx.json->Int("servicecomponentid",
+                          services.ServiceComponentID(row));
+            ctx.json->Int("serviceid", services.ServiceID(row));
+            ctx.json->Int("ensembleid", services.EnsembleID(row));
+            ctx.json->String("ensemblename", services.EnsembleName(row));
+            ctx.json->Int("programtype", services.ProgramType(row));
+            ctx.json->Int("applicationtype", services.ApplicationType(row));
+            ctx.json->EndObject();
+        }
+        ctx.json->EndArray();
+    }
+    return res;
+}
+int CmdPlayStream(CommandContext &ctx) {
+    unsigned long channel;
+    int res;
+    if (!ParseNumber(ctx.param[1], &channel)) {
+        return RES_ERR_SYNTAX;
+    }
+    res = ctx.dabradio.PlayStream(channel);
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->Int("channel", channel);
+    }
+    return res;
+}
+int CmdZap(CommandContext &ctx) {
+    long dabindex;
+    long row;
+    int res;
+    if (!ParseNumber(ctx.param[1], &dabindex)) {
+        return RES_ERR_SYNTAX;
+    }
+    res = ctx.dabradio.Zap(dabindex, &row);
+    if (ctx.json && res == RES_PASS) {
+        const ServiceTable &services = ctx.dabradio.Services();
+        ctx.json->Int("channel", dabindex);
+        ctx.json->String("programname", services.Name(row));
+        ctx.json->String("ensemblename", services.EnsembleName(row));
+        ctx.json->Int("serviceid", services.ServiceID(row));
+    }
+    return res;
+}
+/* the members of a preset in "preset" */
+void JsonPreset(CommandContext &ctx, int slot, char mode, long channel) {
+    const ServiceTable &services = mode ? ctx.dabradio.FmServices()
+                                        : ctx.dabradio.Services();
+    long row = services.Find(channel);
+    ctx.json->Int("preset", slot);
+    ctx.json->String("mode", mode ? "fm" : "dab");
+    ctx.json->Int("channel", channel);
+    if (row >= 0) {
+        ctx.json->String("programname", services.Name(row));
+    }
+}
+/* preset store <n> [<channel>] || recall <n> [dab|fm] || list */
+int CmdPreset(CommandContext &ctx) {
+    std::string_view action = ctx.param[1];
+    char mode;
+    long channel = -1;
+    int slot = -1;
+    int res;
+    
+    if (action == "list" && ctx.param.size() == 2) {
+        res = ctx.dabradio.ListPresets();
+        if (ctx.json && res == RES_PASS) {
+            ctx.json->BeginArray("presets");
+            for (mode = 0; mode <= 1; mode++) {
+                for (slot = 0; slot < KEYSTONE_PRESETS; slot++) {
+                    channel = ctx.dabradio.Preset(mode, slot);
+                    if (channel >= 0) {
+                        ctx.json->BeginObject();
+                        JsonPreset(ctx, slot, mode, channel);
+                        ctx.json->EndObject();
                     }
-                } else if (param[1] == "frequency") {
-                    res = dabradio.GetFrequency(&param_char);
-                } else { // unknown get property
-                    res = RES_ERR_SYNTAX;
                 }
-            } else { // missing parameter
-                res = RES_ERR_SYNTAX;
             }
-            param[0] = "";
-        } else if (param[0] == "set") {
-            if (param.size() >= 3) {
-                if (param[1] == "playmode") {
-                    if (param[2] == "dab") {
-                        param_char = 0;
-                    } else if (param[2] == "fm") {
-                        param_char = 1;
-                    } else {
-                        try {
-                            param_char = (char)std::stoi(param[2],
-                                                         &param_errpos);
-                        }
-                        catch (...) {
-                            res = RES_ERR_SYNTAX;
-                        }
-                        if (param_errpos < param[2].length()) {
-                            // don't accept partial conversion:
-                            res = RES_ERR_SYNTAX;
-                        }
-                    }
-                    if (res != RES_ERR_SYNTAX) {
-                        res = dabradio.SetPlayMode(param_char);
-                    }    
-                } else if (param[1] == "volume") {
-                    if (param[2] == "+") {
-                        param_char = '+';
-                    } else if (param[2] == "-") {
-                        param_char = '-';
-                    } else {
-                        try {
-                            param_char = (char)std::stoi(param[2],
-                                                         &param_errpos);
-                        }
-                        catch (...) {
-                            res = RES_ERR_SYNTAX;
-                        }
-                        if (param_errpos < param[2].length()) {
-                            // don't accept partial conversion:
-                            res = RES_ERR_SYNTAX;
-                        }
-                    }
-                    if (res != RES_ERR_SYNTAX) {
-                        res = dabradio.SetVolume(param_char);
-                    }    
-                } else if (param[1] == "stereo") {
-                    try {
-                        param_char = (char)std::stoi(param[2],
-                                                     &param_errpos);
-                    }
-                    catch (...) {
-                        res = RES_ERR_SYNTAX;
-                    }
-                    if (param_errpos < param[2].length()) {
-                        // don't accept partial conversion:
-                        res = RES_ERR_SYNTAX;
-                    }
-                    if (res != RES_ERR_SYNTAX) {
-                        res = dabradio.SetStereoMode(param_char);
-                    }    
-                } else { // unknown set property
-                    res = RES_ERR_SYNTAX;
+            ctx.json->EndArray();
+        }
+        return res;
+    }
+    if (!ParseNumber(ctx.param[2], &slot) || ctx.param.size() > 4) {
+        return RES_ERR_SYNTAX;
+    }
+    if (action == "store") {
+        if (ctx.param.size() == 4 && !ParseNumber(ctx.param[3], &channel)) {
+            return RES_ERR_SYNTAX;
+        }
+        res = ctx.dabradio.StorePreset(slot, channel);
+        mode = ctx.dabradio.PlayMode();
+        if (res == RES_PASS) {
+            channel = ctx.dabradio.Preset(mode, slot);
+        }
+    } else if (action == "recall") {
+        mode = ctx.dabradio.PlayMode();
+        if (ctx.param.size() == 4) {
+            if (ctx.param[3] != "dab" && ctx.param[3] != "fm") {
+                return RES_ERR_SYNTAX;
+            }
+            mode = ctx.param[3] == "fm";
+        }
+        res = ctx.dabradio.RecallPreset(slot, mode, &channel);
+    } else {
+        return RES_ERR_SYNTAX;
+    }
+    if (ctx.json && res == RES_PASS) {
+        JsonPreset(ctx, slot, mode, channel);
+    }
+    return res;
+}
+/* seek up || seek down */
+int CmdSeek(CommandContext &ctx) {
+    const ServiceTable &services = ctx.dabradio.FmServices();
+    std::string_view direction = ctx.param[1];
+    unsigned long freq;
+    long row;
+    int res;
+    if (ctx.param.size() != 2 || (direction != "up" && direction != "down")) {
+        return RES_ERR_SYNTAX;
+    }
+    res = ctx.dabradio.Seek(direction == "up" ? 1 : -1, &freq);
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->Int("channel", freq);
+        if ((row = services.Find(freq)) >= 0) {
+            ctx.json->String("programname", services.Name(row));
+        }
+    }
+    return res;
+}
+int CmdStopStream(CommandContext &ctx) {
+    return ctx.dabradio.StopStream();
+}
+/* the members of a program text in "history" and "search" */
+void JsonText(JsonWriter &json, const DlsHistory::Text &text) {
+    json.Int("first", text.first);
+    json.Int("last", text.last);
+    json.String("text", text.text);
+    json.String("artist", text.artist);
+    json.String("title", text.title);
+}
+int CmdMotReset(CommandContext &ctx) {
+    return ctx.dabradio.MotReset();
+}
+int CmdMotImage(CommandContext &ctx) {
+    std::string image;
+    uint32_t serviceid;
+    int res = ctx.dabradio.GetMotSlideshowImage(&image, &serviceid);
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->String("image", image);
+        ctx.json->Int("serviceid", serviceid);
+    }
+    return res;
+}
+/* history [<cha>] [<n>]: the texts of the given or the playing program */
+int CmdHistory(CommandContext &ctx) {
+    unsigned long n = DLSHISTORY_ENTRIES;
+    long dabindex;
+    uint32_t serviceid;
+    int res;
+    
+    if (ctx.param.size() >= 2) {
+        res = ParseNumber(ctx.param[1], &dabindex) ? RES_PASS : RES_ERR_SYNTAX;
+    } else {
+        res = ChannelParam(ctx, &dabindex);
+    }
+    if (ctx.param.size() >= 3 && !ParseNumber(ctx.param[2], &n)) {
+        res = RES_ERR_SYNTAX;
+    }
+    if (res != RES_ERR_SYNTAX) {
+        res = ctx.dabradio.GetHistory(dabindex, n, &serviceid);
+    }
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->Int("channel", dabindex);
+        ctx.json->Int("serviceid", serviceid);
+        ctx.json->BeginArray("history");
+        ctx.dabradio.TextHistory().History(serviceid, n,
+            [&ctx](const DlsHistory::Text &text) {
+                ctx.json->BeginObject();
+                JsonText(*ctx.json, text);
+                ctx.json->EndObject();
+            });
+        ctx.json->EndArray();
+    }
+    return res;
+}
+/* search nowplaying <text> */
+int CmdSearch(CommandContext &ctx) {
+    std::string_view needle = ctx.param.From(2, ctx.line);
+    int res;
+    
+    if (ctx.param[1] != "nowplaying" || needle.empty()) {
+        return RES_ERR_SYNTAX;
+    }
+    res = ctx.dabradio.SearchNowPlaying(needle);
+    if (ctx.json && res == RES_PASS) {
+        ctx.json->BeginArray("matches");
+        ctx.dabradio.TextHistory().Search(needle,
+            [&ctx](uint32_t serviceid, const DlsHistory::Text &text) {
+                ctx.json->BeginObject();
+                ctx.json->Int("serviceid", serviceid);
+                JsonText(*ctx.json, text);
+                ctx.json->EndObject();
+            });
+        ctx.json->EndArray();
+    }
+    return res;
+}
+int CmdVer(CommandContext &ctx) {
+    if (VERBOSITY_ENABLED(VERBOSITY_MSG, ctx.verbosity)) {
+        ctx.out << "*MSG:  " << ctx.progname
+                << ": version " << VERSION
+                << std::endl;
+    }
+    if (ctx.json) {
+        ctx.json->String("version", VERSION);
+    }
+    return RES_PASS;
+}
+/* "sleep" is a timer of the main loop, it never reaches the worker */
+int CmdSleep(CommandContext &ctx) {
+    unsigned long ms;
+    if (!ParseNumber(ctx.param[1], &ms)) {
+        return RES_ERR_SYNTAX;
+    }
+    return RES_PASS;
+}
+int CmdReset(CommandContext &ctx) {
+    if (ctx.param[1] != "stats") {
+        return RES_ERR_SYNTAX;
+    }
+    return ctx.dabradio.ResetStats();
+}
+int CmdQuit(CommandContext &ctx) {
+    return RES_PASS;
+}
+
+static constexpr CommandEntry commands[] = {
+    {"help",       CmdHelp},
+    {"open",       CmdOpen},
+    {"close",      CmdClose},
+    {"get",        CmdGet},
+    {"set",        CmdSet},
+    {"scan",       CmdScan},
+    {"list",       CmdList},
+    {"playstream", CmdPlayStream},
+    {"zap",        CmdZap},
+    {"preset",     CmdPreset},
+    {"seek",       CmdSeek},
+    {"stopstream", CmdStopStream},
+    {"motreset",   CmdMotReset},
+    {"motimage",   CmdMotImage},
+    {"history",    CmdHistory},
+    {"search",     CmdSearch},
+    {"ver",        CmdVer},
+    {"sleep",      CmdSleep},
+    {"reset",      CmdReset},
+    {"exit",       CmdQuit},
+    {"quit",       CmdQuit},
+};
+static constexpr DispatchTable commandtable(commands);
+
+/* Execute a single command line and write its messages into out.     *
+ * The typed results are added to json unless it is nullptr.           *
+ * Returns the result code or RES_WARN_NONE for empty lines/comments.  */
+int ExecuteCommand(KeyStone &dabradio,
+                   std::string_view stdinline,
+                   const char *progname,
+                   int verbosity,
+                   std::ostream &out,
+                   JsonWriter *json = nullptr) {
+    Tokens param(stdinline);  // split parameters without copying
+    CommandContext ctx{dabradio, param, stdinline, progname, verbosity, out,
+                       json};
+    const CommandEntry *command;
+    int res;
+    
+    if (param.size() == 0 || param[0][0] == '#') {
+        return RES_WARN_NONE; // empty command or comment
+    }
+    command = commandtable.Find(param[0]);
+    if (command && !param.Overflow()) {
+        res = command->handler(ctx);
+    } else { // unknown command
+        res = RES_ERR_SYNTAX;
+    }
+    
+    if (res == RES_ERR_SYNTAX) {
+        if (VERBOSITY_ENABLED(VERBOSITY_ERR, verbosity)) {
+            out << "*ERR:  syntax error \" "
+                << stdinline << "\""
+                << std::endl;
+        }
+    }
+    return res;
+}
+
+/*********************** metadata subscriptions ***********************/
+/* Read the subscribed property on the worker thread and format its   *
+ * value for the push message, as JSON members if json isn't nullptr.  *
+ * The KeyStone messages are discarded.                                *
+ * Returns the result code of the KeyStone method.                     */
+int SampleProperty(KeyStone &dabradio,
+                   const std::string &property,
+                   JsonWriter *json,
+                   std::string *value) {
+    std::streambuf *output;
+    std::string text;
+    long number = 0;
+    char status = 0;
+    char strength = 0;
+    int bitError = 0;
+    int rate = 0;
+    long idx = 0;
+    int res;
+    
+    output = dabradio.SetOutput(nullptr);
+    if (property == "programtext") {
+        res = dabradio.GetProgramText(&text);
+    } else if (property == "signalstrength") {
+        res = dabradio.GetSignalStrength(&strength, &bitError);
+        number = strength;
+    } else if (property == "datarate") {
+        res = dabradio.GetDataRate(&rate);
+        number = rate;
+    } else if (property == "samplingrate") {
+        res = dabradio.GetSamplingRate(&rate);
+        number = rate;
+    } else if (property == "playstatus") {
+        res = dabradio.GetPlayStatus(&status);
+        number = status;
+    } else if (property == "playindex") {
+        res = dabradio.GetPlayIndex(&idx);
+        number = idx;
+    } else {
+        res = RES_ERR_SYNTAX;
+    }
+    dabradio.SetOutput(output);
+    
+    if (json) {
+        json->Clear();
+        if (property == "programtext") {
+            json->String(property, text);
+        } else {
+            json->Int(property, number);
+        }
+        if (property == "signalstrength") {
+            json->Int("biterror", bitError);
+        }
+        *value = json->Text();
+    } else if (property == "programtext") {
+        *value = "\"" + text + "\"";
+    } else {
+        *value = std::to_string(number);
+        if (property == "signalstrength") {
+            *value += ", bitError==" + std::to_string(bitError);
+        }
+    }
+    return res;
+}
+
+/* The announcement of a slide, as JSON members if json isn't nullptr. *
+ * A repeated slide is only referred to by its hash.                    */
+std::string SlideValue(const SlideShow::Slide &slide, bool repeat,
+                       JsonWriter *json) {
+    std::ostringstream value;
+    if (json) {
+        json->Clear();
+        json->String("slide", SlideShow::HashText(slide.hash));
+        if (repeat) {
+            json->Bool("repeat", true);
+        } else {
+            json->String("name", slide.name);
+            json->Int("size", slide.size);
+        }
+        json->Int("serviceid", slide.serviceid);
+        return json->Text();
+    }
+    value << SlideShow::HashText(slide.hash) << ", ";
+    if (repeat) {
+        value << "repeated, ";
+    } else {
+        value << "\"" << slide.name << "\", " << slide.size << " bytes, ";
+    }
+    value << "ServiceID="
+          << std::setbase(16) << std::setw(8) << std::setfill('0')
+          << slide.serviceid;
+    return value.str();
+}
+
+bool SubscribableProperty(std::string_view property) {
+    return property == "slide" ||
+           property == "programtext" ||
+           property == "signalstrength" ||
+           property == "datarate" ||
+           property == "samplingrate" ||
+           property == "playstatus" ||
+           property == "playindex";
+}
+
+/* write a complete JSON record to stdout with a single write() */
+void WriteRecord(std::string_view record) {
+    const char *p = record.data();
+    size_t len = record.length();
+    while (len) {
+        ssize_t n = ::write(STDOUT_FILENO, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+struct PendingRequest {
+    int         timer;   // deadline timer or 0
+    std::string command;
+    int         client;  // 0: stdin/stdout, else a ControlSocket client
+    std::string id;      // the id given by the client
+    bool        sleep;   // a "sleep": timer is its end, not a deadline
+};
+
+/* a script of "batch ... end" or "run <file>" in progress */
+struct RunningScript {
+    std::shared_ptr<Script> script; // shared with its worker task
+    int                     timer;  // the timer of a "sleep" or 0
+};
+
+/* the lines of a client between "batch" and "end" */
+struct CollectingBatch {
+    std::string             id;      // the id of "batch"
+    std::string             command;
+    long                    timeout;
+    std::shared_ptr<Script> script;
+};
+
+/* a line of a client which waits for the end of its "sleep" */
+struct HeldLine {
+    std::string line;
+    bool        overlong;
+};
+
+/* the key of a request in the worker queue: ids are unique per client */
+std::string RequestKey(int client, std::string_view id) {
+    std::string key = std::to_string(client);
+    key += ':';
+    key.append(id.data(), id.length());
+    return key;
+}
+
+int main(int argc, char *argv[]) {
+    Reactor reactor;
+    LineReader stdinreader;
+    DeviceWorker worker;
+    std::map<std::string, PendingRequest> pending; // by RequestKey()
+    std::map<std::string, RunningScript> scripts;  // by RequestKey()
+    std::map<int, CollectingBatch> batches;        // by client
+    std::map<int, std::string> sleeps;             // "sleep" by client
+    std::map<int, std::deque<HeldLine>> heldlines; // by client
+    unsigned long nextid = 1;
+    bool quitting = false;
+    bool jsonl = false;       // "--protocol=jsonl"
+    std::string socketpath;   // "--socket=<path>"
+    std::string initscript;   // "-x <script>"
+    std::ostringstream clientout; // main thread messages for a client
+    JsonWriter record;        // main thread: the current JSON record
+    JsonWriter fields;        // main thread: typed results of a command
+    JsonWriter workerfields;  // worker thread: typed results of a command
+    JsonWriter stepfields;    // worker thread: typed results of a script step
+    SlideShow slideshow(MAX_OBJECT_SIZE, "dabd_slides"); // main thread
+    std::ostream discard(nullptr);
+    
+    int verbosity = VERBOSITY_DEBUG;
+    
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg(argv[i]);
+        if (arg == "--protocol=jsonl") {
+            jsonl = true;
+        } else if (arg == "--protocol=text") {
+            jsonl = false;
+        } else if (arg == "-x" && i + 1 < argc) {
+            initscript = argv[++i];
+        } else if (arg.substr(0, 9) == "--socket=" && arg.length() > 9) {
+            socketpath = arg.substr(9);
+        } else if (arg.substr(0, 12) == "--verbosity=" &&
+                   ParseNumber(arg.substr(12), &verbosity) &&
+                   verbosity >= VERBOSITY_NONE &&
+                   verbosity <= VERBOSITY_DEBUG) {
+            // messages above VERBOSITY_BUILD aren't available anyway
+        } else {
+            std::cout << "usage: " << argv[0]
+                      << " [--protocol=text|jsonl] [--socket=<path>]"
+                      << " [-x <script>]"
+                      << " [--verbosity=" << VERBOSITY_NONE
+                      << ".." << VERBOSITY_DEBUG << "]"
+                      << std::endl;
+            return 1;
+        }
+    }
+    
+    // in JSON Lines mode only the records are written to stdout
+    std::ostream &msgout = jsonl ? discard : std::cout;
+    
+    KeyStone dabradio(verbosity, msgout.rdbuf());
+    
+    ExecuteCommand(dabradio, "help", argv[0], verbosity, msgout);
+    
+    /* Frontends connected to the control socket are served by the    *
+     * same event loop as stdin. Client 0 is stdin/stdout.            */
+    std::function<void(int client, std::string_view line,
+                       bool overlong)> handleline;
+    std::function<void(int client)> dropclient;
+    ControlSocket controlsocket(reactor,
+        [&](int client, std::string_view line, bool overlong) {
+            handleline(client, line, overlong);
+        },
+        [&](int client) {
+            dropclient(client);
+        });
+    
+    /* send text (or a JSON record) to a client */
+    auto send = [&](int client, std::string_view text) {
+        if (client != 0) {
+            controlsocket.Write(client, text);
+        } else if (jsonl) {
+            WriteRecord(text);
+        } else {
+            std::cout << text;
+            std::cout.flush();
+        }
+    };
+    
+    /* Print the result of a request: "*RES:  <res> @<id>" or a JSON   *
+     * record {"id", "command", "res", <fields>}. Empty lines and      *
+     * comments don't get a record.                                    */
+    auto printresult = [&](int client, const std::string &id,
+                           std::string_view command,
+                           int res, std::string_view resultfields) {
+        if (jsonl) {
+            if (command.length() == 0 || command[0] == '#') {
+                return;
+            }
+            record.Clear();
+            record.BeginObject();
+            record.String("id", id);
+            record.String("command", command);
+            record.Int("res", res);
+            record.Members(resultfields);
+            record.EndObject();
+            record.Newline();
+            send(client, record.Text());
+        } else if (res != RES_WARN_NONE &&
+                   VERBOSITY_ENABLED(VERBOSITY_RES, verbosity)) {
+            send(client, "*RES:  " + std::to_string(res) + " @" + id + "\n");
+        }
+    };
+    /* Subscribed properties are sampled by the worker thread as well. *
+     * Only changed values are pushed to the client.                  */
+    std::function<void()> sampleslide;
+    Subscriptions subscriptions(reactor,
+        [&](const std::string &property) {
+            DeviceRequest req;
+            if (property == "slide") {
+                sampleslide();
+                return;
+            }
+            req.id = "~" + property; // not pending: no messages, no result
+            req.task = [&, property](std::string *value) {
+                return SampleProperty(dabradio, property,
+                                      jsonl ? &workerfields : nullptr,
+                                      value);
+            };
+            req.done = [&, property](int res, const std::string &value) {
+                // RES_WARN_OLDTEXT: the program text hasn't changed
+                subscriptions.SampleDone(property,
+                                         res == RES_PASS ||
+                                         res == RES_WARN_OLDTEXT,
+                                         value);
+            };
+            worker.Submit(req);
+        },
+        [&](int client, const std::string &property,
+            const std::string &value) {
+            if (jsonl) {
+                record.Clear();
+                record.BeginObject();
+                record.String("event", property);
+                record.Members(value);
+                record.EndObject();
+                record.Newline();
+                send(client, record.Text());
+            } else {
+                send(client, "*EVT:  " + property + "==" + value + "\n");
+            }
+        });
+    
+    /* The MOT slideshow is polled while "slide" is subscribed, at the *
+     * adaptive rate of SlideShow and only if the worker is idle: a    *
+     * poll never delays a command. A new slide is copied into the     *
+     * cache on the main thread, the worker only calls the library.    */
+    sampleslide = [&]() {
+        auto serviceid = std::make_shared<uint32_t>(0);
+        DeviceRequest req;
+        if (!slideshow.Due(SlideShow::clock::now()) || !worker.Idle()) {
+            subscriptions.SampleDone("slide", false, "");
+            return;
+        }
+        req.id = "~slide";
+        req.task = [&, serviceid](std::string *image) {
+            std::streambuf *output = dabradio.SetOutput(nullptr);
+            int res = dabradio.GetMotSlideshowImage(image, serviceid.get());
+            dabradio.SetOutput(output);
+            return res;
+        };
+        req.done = [&, serviceid](int res, const std::string &image) {
+            const SlideShow::Slide *slide = nullptr;
+            bool repeat = false;
+            std::string value;
+            if (res == RES_PASS) {
+                slide = slideshow.Load(image, *serviceid, &repeat);
+                if (!slide && VERBOSITY_ENABLED(VERBOSITY_ERR, verbosity)) {
+                    msgout << "*ERR:  slide " << image << ": "
+                           << strerror(errno)
+                           << std::endl;
                 }
-            } else { // missing parameter
-                res = RES_ERR_SYNTAX;
             }
-            param[0] = "";
-        } else if (param[0] == "scan") {
-            res = dabradio.DoScan();
-            param[0] = "";
-        } else if (param[0] == "list") {
-            res = dabradio.DABProgramList();
-            param[0] = "";
-        } else if (param[0] == "playstream") {
-            if (param.size() >= 2) {
-                try {
-                    param_ulong = std::stoul(param[1],
-                                             &param_errpos);
-                }
-                catch (...) {
-                    res = RES_ERR_SYNTAX;
+            if (slide) {
+                value = SlideValue(*slide, repeat, jsonl ? &fields : nullptr);
+            }
+            // without a playing slideshow the board hasn't been asked
+            slideshow.Polled(SlideShow::clock::now(), res != RES_WARN_NOTRUN,
+                             *serviceid, slide != nullptr);
+            subscriptions.SampleDone("slide", slide != nullptr, value);
+        };
+        worker.Submit(req);
+    };
+    
+    /* The programme guides are harvested one program per             *
+     * EPG_HARVEST_INTERVAL and only if the worker is idle, so the     *
+     * harvest never delays a command. The timer only runs while the   *
+     * board is open in DAB mode, see armtimers.                       */
+    bool harvesting = false;
+    bool epgavailable = true; // false: libkeystonecomm without GetEpg()
+    int epgtimer = 0;
+    auto harvestepg = [&]() {
+        DeviceRequest req;
+        if (harvesting || !worker.Idle()) {
+            return;
+        }
+        harvesting = true;
+        req.id = "~epg";
+        req.task = [&](std::string *result) {
+            uint32_t serviceid;
+            long count;
+            std::streambuf *output = dabradio.SetOutput(nullptr);
+            int res = dabradio.HarvestEpg(&serviceid, &count);
+            dabradio.SetOutput(output);
+            return res;
+        };
+        req.done = [&](int res, const std::string &result) {
+            harvesting = false;
+            if (res == RES_ERR_TODO) { // libkeystonecomm without GetEpg()
+                epgavailable = false;
+                reactor.CancelTimer(epgtimer);
+                epgtimer = 0;
+                if (VERBOSITY_ENABLED(VERBOSITY_WARN, verbosity)) {
+                    msgout << "*WARN: no programme guide: libkeystonecomm "
+                           << "doesn't provide GetEpg()."
+                           << std::endl;
                 }
-                if (param_errpos < param[1].length()) {
-                    // don't accept partial conversion:
-                    res = RES_ERR_SYNTAX;
+            }
+        };
+        worker.Submit(req);
+    };
+    
+    /* The reception is sampled every TELEMETRY_INTERVAL while the     *
+     * worker is idle: a command never waits for more than one sample. *
+     * The timer only runs while the board is open, see armtimers.     */
+    bool sampling = false;
+    int telemetrytimer = 0;
+    auto sampletelemetry = [&]() {
+        DeviceRequest req;
+        if (sampling || !worker.Idle()) {
+            return;
+        }
+        sampling = true;
+        req.id = "~telemetry";
+        req.task = [&](std::string *result) {
+            return dabradio.SampleTelemetry();
+        };
+        req.done = [&](int res, const std::string &result) {
+            sampling = false;
+        };
+        worker.Submit(req);
+    };
+    
+    /* The background timers are armed only while they have work: an  *
+     * idle dabd with a closed serial port doesn't wake up at all.     *
+     * Open, close and the play mode change on the worker thread, so   *
+     * this is checked after every event of the worker.                */
+    auto armtimers = [&]() {
+        bool open = dabradio.SerialOpen();
+        bool dab = open && !dabradio.PlayMode();
+        if (open && !telemetrytimer) {
+            telemetrytimer = reactor.AddTimer(TELEMETRY_INTERVAL,
+                                              sampletelemetry,
+                                              TELEMETRY_INTERVAL);
+        } else if (!open && telemetrytimer) {
+            reactor.CancelTimer(telemetrytimer);
+            telemetrytimer = 0;
+        }
+        if (dab && epgavailable && !epgtimer) {
+            epgtimer = reactor.AddTimer(EPG_HARVEST_INTERVAL, harvestepg,
+                                        EPG_HARVEST_INTERVAL);
+        } else if (!dab && epgtimer) {
+            reactor.CancelTimer(epgtimer);
+            epgtimer = 0;
+        }
+    };
+    
+    /* leave the event loop after the last result was printed */
+    auto quitwhenidle = [&]() {
+        if (quitting && pending.empty()) {
+            reactor.Stop();
+        }
+    };
+    
+    /* --socket=<path>: SIGTERM and SIGINT let dabd quit like "exit"  *
+     * on stdin, so the socket file is removed and the serial port    *
+     * is closed properly. They are blocked before the worker thread  *
+     * starts, so it inherits the blocked signals.                    */
+    if (socketpath.length()) {
+        if (!controlsocket.Listen(socketpath)) {
+            std::cout << "*ERR:  " << argv[0] << ": can't listen on "
+                      << socketpath << ": " << strerror(errno)
+                      << std::endl;
+            return 1;
+        }
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGTERM);
+        sigaddset(&signals, SIGINT);
+        pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+        int sigfd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+        reactor.AddFd(sigfd, POLLIN, [&](int fd, short revents) {
+            struct signalfd_siginfo info;
+            while (::read(fd, &info, sizeof(info)) == sizeof(info)) {
+                quitting = true;
+            }
+            quitwhenidle();
+        });
+    }
+    
+    // worker thread: messages of the running request
+    std::ostream workerout(worker.OutputBuffer());
+    
+    /* Every block a scan has finished is reported to the client which *
+     * started it, as a message of the running request.                */
+    JsonWriter progress;
+    dabradio.SetScanProgress([&](int block, long programs, long blocktime,
+                                 long elapsed) {
+        if (jsonl) {
+            std::string key = worker.Running(); // see RequestKey()
+            progress.Clear();
+            progress.BeginObject();
+            progress.String("id", key.substr(key.find(':') + 1));
+            progress.String("event", "scan");
+            progress.String("block", KeyStone::DABBlockName(block));
+            progress.Int("index", block);
+            progress.Int("programs", programs);
+            progress.Int("blocktime", blocktime);
+            progress.Int("elapsed", elapsed);
+            progress.EndObject();
+            progress.Newline();
+            workerout << progress.Text();
+            workerout.flush();
+        } else {
+            workerout << "*EVT:  scan==" << KeyStone::DABBlockName(block)
+                      << ", index " << block << ", " << programs
+                      << " programs, " << blocktime << " ms, "
+                      << elapsed << " ms totally"
+                      << std::endl;
+        }
+    });
+    
+    /* Only the worker thread talks to the MonkeyBoard. It executes   *
+     * the queued requests one after another. Their messages and      *
+     * results come back as events to the main thread.                */
+    dabradio.SetOutput(jsonl ? nullptr : worker.OutputBuffer());
+    worker.Start([&](const DeviceRequest &req, std::ostream &out,
+                     std::string *result) {
+        int res;
+        dabradio.ClearCancel();
+        if (!jsonl) {
+            return ExecuteCommand(dabradio, req.line, argv[0], verbosity,
+                                  out);
+        }
+        workerfields.Clear();
+        res = ExecuteCommand(dabradio, req.line, argv[0], verbosity,
+                             discard, &workerfields);
+        *result = workerfields.Text();
+        return res;
+    });
+    reactor.AddFd(worker.EventFd(), POLLIN, [&](int fd, short revents) {
+        DeviceEvent ev;
+        while (worker.PopEvent(&ev)) {
+            if (ev.done && ev.callback) { // an internal task
+                ev.callback(ev.res, ev.text);
+                continue;
+            }
+            auto it = pending.find(ev.id);
+            if (it == pending.end()) {
+                continue; // request timed out: drop its late messages
+            }
+            if (ev.done) {
+                if (it->second.timer) {
+                    reactor.CancelTimer(it->second.timer);
                 }
-                if (res != RES_ERR_SYNTAX) {
-                    res = dabradio.PlayStream(param_ulong);
-                }    
-            } else { // missing parameter
+                printresult(it->second.client, it->second.id,
+                            it->second.command, ev.res, ev.text);
+                pending.erase(it);
+            } else {
+                send(it->second.client, ev.text);
+            }
+        }
+        armtimers();
+        quitwhenidle();
+    });
+    
+    /* A script runs as one pending request. Its commands up to the     *
+     * next "sleep" are a single worker task, they are executed back   *
+     * to back. A "sleep" is a timer, so the worker is free meanwhile. *
+     * The combined result is printed when the script has finished.    */
+    std::function<void(const std::string &key)> runscript;
+    auto finishscript = [&](const std::string &key) {
+        auto it = scripts.find(key);
+        auto p = pending.find(key);
+        if (it == scripts.end()) {
+            return;
+        }
+        if (it->second.timer) {
+            reactor.CancelTimer(it->second.timer);
+        }
+        if (p != pending.end()) {
+            Script &script = *it->second.script;
+            const Script::Step *failed = script.Failed();
+            if (p->second.timer) {
+                reactor.CancelTimer(p->second.timer);
+            }
+            if (!jsonl && failed &&
+                    VERBOSITY_ENABLED(VERBOSITY_ERR, verbosity)) {
+                send(p->second.client, "*ERR:  " + p->second.command +
+                     ": \"" + failed->line + "\" failed.\n");
+            }
+            printresult(p->second.client, p->second.id, p->second.command,
+                        script.Res(), jsonl ? script.Results() : "");
+            pending.erase(p);
+        }
+        scripts.erase(it);
+        quitwhenidle();
+    };
+    runscript = [&](const std::string &key) {
+        auto it = scripts.find(key);
+        DeviceRequest req;
+        if (it == scripts.end()) {
+            return; // stopped meanwhile
+        }
+        std::shared_ptr<Script> script = it->second.script;
+        it->second.timer = 0;
+        if (script->Finished()) {
+            finishscript(key);
+            return;
+        }
+        if (script->Current().sleep >= 0) {
+            it->second.timer = reactor.AddTimer(script->Current().sleep,
+                                                [&, key, script]() {
+                script->Done(RES_PASS);
+                runscript(key);
+            });
+            return;
+        }
+        req.id = key;
+        req.task = [&, script](std::string *result) {
+            dabradio.ClearCancel();
+            while (!script->Finished() && script->Current().sleep < 0) {
+                const std::string &line = script->Current().line;
+                int res;
+                stepfields.Clear();
+                if (jsonl) {
+                    res = ExecuteCommand(dabradio, line, argv[0], verbosity,
+                                         discard, &stepfields);
+                } else {
+                    res = ExecuteCommand(dabradio, line, argv[0], verbosity,
+                                         workerout);
+                }
+                script->Done(res, stepfields.Text());
+                if (res == RES_ERR_CANCEL) {
+                    script->Stop(res);
+                }
+            }
+            return script->Res();
+        };
+        req.done = [&, key](int res, const std::string &result) {
+            runscript(key);
+        };
+        worker.Submit(req);
+    };
+    /* Stop a script at once: cancel, timeout. A running task still   *
+     * uses the script, it is finished by the done event of the task.  */
+    auto stopscript = [&](const std::string &key, int res) {
+        auto it = scripts.find(key);
+        if (it == scripts.end()) {
+            return;
+        }
+        it->second.script->Stop(res);
+        if (worker.CancelRunning(key, [&]() { dabradio.Cancel(); })) {
+            return; // runscript() of its done event finishes it
+        }
+        worker.Dequeue(key);
+        finishscript(key);
+    };
+    /* Returns RES_PASS if script can be started as the request id. */
+    auto checkscript = [&](int client, const std::string &id,
+                           const Script &script, std::string_view name,
+                           std::ostream &out) {
+        if (script.BadLine()) {
+            if (VERBOSITY_ENABLED(VERBOSITY_ERR, verbosity)) {
+                out << "*ERR:  " << name << ": line " << script.BadLine()
+                    << " can't be part of a script."
+                    << std::endl;
+            }
+            return RES_ERR_SYNTAX;
+        }
+        if (pending.count(RequestKey(client, id))) { // id still running
+            return RES_WARN_NOTRUN;
+        }
+        return RES_PASS;
+    };
+    auto startscript = [&](int client, const std::string &id,
+                           std::string_view command, long timeout,
+                           const std::shared_ptr<Script> &script) {
+        std::string key = RequestKey(client, id);
+        int timer = 0;
+        if (timeout >= 0) {
+            timer = reactor.AddTimer(timeout, [&, key]() {
+                auto it = pending.find(key);
+                if (it != pending.end()) {
+                    it->second.timer = 0;
+                    stopscript(key, RES_ERR_TIMEOUT);
+                }
+            });
+        }
+        pending[key] = PendingRequest{timer, std::string(command), client, id,
+                                      false};
+        scripts[key] = RunningScript{script, 0};
+        runscript(key);
+    };
+    
+    /* A "sleep" holds the later lines of its client until it has     *
+     * ended, so "open", "sleep 500", "playstream 3" really wait. The  *
+     * held lines are handled after the line which ended the sleep.    */
+    bool stdinheld = false; // the end of stdin waits for held lines
+    auto wakeclient = [&](int client) {
+        sleeps.erase(client);
+        reactor.AddTimer(0, [&, client]() {
+            auto it = heldlines.find(client);
+            std::deque<HeldLine> lines;
+            if (it != heldlines.end()) {
+                lines = std::move(it->second);
+                heldlines.erase(it);
+            }
+            while (!lines.empty() && !sleeps.count(client)) {
+                handleline(client, lines.front().line,
+                           lines.front().overlong);
+                lines.pop_front();
+            }
+            if (!lines.empty()) { // held again by a "sleep"
+                heldlines[client] = std::move(lines);
+            } else if (client == 0 && stdinheld && !sleeps.count(0)) {
+                quitting = true;
+                quitwhenidle();
+            }
+        });
+    };
+    
+    /* A command line is "[@<id>] [timeout <ms>] <command>". Commands  *
+     * which don't need the MonkeyBoard are answered at once, all      *
+     * others are queued for the worker thread. An overlong line (more *
+     * than LINEQUEUE_SLOT_SIZE bytes) is rejected, not cut.           */
+    handleline = [&](int client, std::string_view stdinline,
+                     bool overlong) {
+        Tokens param(stdinline);
+        std::string id;
+        std::string_view command;
+        size_t first = 0;
+        long timeout = -1;
+        int res = RES_WARN_NONE;
+        // messages of the main thread for this client
+        std::ostream &out = client == 0 ? msgout : jsonl ? discard : clientout;
+        auto batch = batches.find(client);
+        
+        if (sleeps.count(client) || heldlines.count(client)) {
+            // behind a "sleep", only "cancel" is handled at once
+            size_t c = param.size() > 1 && param[0][0] == '@';
+            if (overlong || param[c] != "cancel") {
+                heldlines[client].push_back(HeldLine{std::string(stdinline),
+                                                     overlong});
+                return;
+            }
+        }
+        if (batch != batches.end() && (overlong || param[0] != "end")) {
+            // checked at "end"
+            batch->second.script->Add(overlong ? std::string_view()
+                                               : stdinline, overlong);
+            return;
+        }
+        if (overlong) {
+            clientout.str("");
+            if (VERBOSITY_ENABLED(VERBOSITY_ERR, verbosity)) {
+                out << "*ERR:  command line longer than "
+                    << LINEQUEUE_SLOT_SIZE << " bytes: \""
+                    << stdinline << "...\""
+                    << std::endl;
+            }
+            if (client != 0 && clientout.tellp() > 0) {
+                send(client, clientout.str());
+            }
+            printresult(client, std::to_string(nextid++), stdinline,
+                        RES_ERR_SYNTAX, "");
+            return;
+        }
+        if (param[0].length() > 1 && param[0][0] == '@') {
+            id = param[0].substr(1);
+            first++;
+        } else {
+            id = std::to_string(nextid++);
+        }
+        if (param.size() > first + 2 && param[first] == "timeout") {
+            if (!ParseNumber(param[first + 1], &timeout) || timeout < 0) {
                 res = RES_ERR_SYNTAX;
             }
-            param[0] = "";
-        } else if (param[0] == "stopstream") {
-            res = dabradio.StopStream();
-            param[0] = "";
-        } else if (param[0] == "motreset") {
-            res = dabradio.MotReset();
-            param[0] = "";
-        } else if (param[0] == "motimage") {
-            res = dabradio.GetMotSlideshowImage(&param_string);
-            param[0] = "";
-        } else if (param[0] == "ver") {
-            if (verbosity >= VERBOSITY_MSG) {
-                std::cout << "*MSG:  " << argv[0]
-                          << ": version " << VERSION
-                          << std::endl;
+            first += 2;
+        }
+        command = param.From(first, stdinline);
+        
+        fields.Clear();
+        clientout.str("");
+        if (res == RES_ERR_SYNTAX) {
+            if (VERBOSITY_ENABLED(VERBOSITY_ERR, verbosity)) {
+                out << "*ERR:  syntax error \" "
+                    << stdinline << "\""
+                    << std::endl;
             }
+            command = stdinline;
+        } else if (quitting) { // "quit" is waiting for the worker
+            res = RES_WARN_NOTRUN;
+        } else if (command == "" || command[0] == '#' ||
+                   param[first] == "help" || param[first] == "ver") {
+            res = ExecuteCommand(dabradio, command, argv[0], verbosity,
+                                 out, jsonl ? &fields : nullptr);
+        } else if (param[first] == "exit" || param[first] == "quit") {
+            // a socket client only closes its own connection
             res = RES_PASS;
-            param[0] = "";            
-        } else if (param[0] == "sleep") {
-            if (param.size() >= 2) {
-                try {
-                    param_ulong = std::stoul(param[1], &param_errpos);
+            if (client == 0) {
+                quitting = true;
+            }
+        } else if (param[first] == "batch" &&
+                   (param.size() == first + 1 ||
+                    (param.size() == first + 2 &&
+                     param[first + 1] == "stoponerror"))) {
+            /* batch [stoponerror]: the following lines up to "end" */
+            batches[client] = CollectingBatch{
+                id, std::string(command), timeout,
+                std::make_shared<Script>(param.size() == first + 2)};
+            return;
+        } else if (param[first] == "end" && batch != batches.end()) {
+            /* the result of "end" is the result of the batch */
+            CollectingBatch collected = std::move(batch->second);
+            batches.erase(batch);
+            res = checkscript(client, collected.id, *collected.script,
+                              "batch", out);
+            if (res == RES_PASS) {
+                startscript(client, collected.id, collected.command,
+                            collected.timeout, collected.script);
+                return;
+            }
+            if (client != 0 && clientout.tellp() > 0) {
+                send(client, clientout.str());
+            }
+            printresult(client, collected.id, collected.command, res, "");
+            return;
+        } else if (param[first] == "run" && param.size() > first + 1) {
+            /* run [stoponerror] <file> */
+            bool stoponerror = param[first + 1] == "stoponerror";
+            std::string path(param.From(first + 1 + stoponerror, stdinline));
+            auto script = std::make_shared<Script>(stoponerror);
+            if (path.empty()) {
+                res = RES_ERR_SYNTAX;
+                if (VERBOSITY_ENABLED(VERBOSITY_ERR, verbosity)) {
+                    out << "*ERR:  syntax error \" "
+                        << stdinline << "\""
+                        << std::endl;
                 }
-                catch (...) {
-                    res = RES_ERR_SYNTAX;
+            } else if (!script->Load(path)) {
+                res = RES_ERR_FAIL;
+                if (VERBOSITY_ENABLED(VERBOSITY_ERR, verbosity)) {
+                    out << "*ERR:  run: " << path << ": " << strerror(errno)
+                        << std::endl;
                 }
-                if (param_errpos < param[1].length()) {
-                    // don't accept partial conversion:
-                    res = RES_ERR_SYNTAX;
+            } else {
+                res = checkscript(client, id, *script, path, out);
+            }
+            if (res == RES_PASS) {
+                startscript(client, id, command, timeout, script);
+                return;
+            }
+        } else if (param[first] == "subscribe") {
+            /* subscribe [<property> [<interval>]] */
+            long interval = 1000;
+            res = RES_PASS;
+            if (param.size() == first + 1) {
+                if (jsonl) {
+                    subscriptions.List(&fields, client);
+                } else {
+                    out << "subscriptions:\n";
+                    subscriptions.List(out, client);
+                    out.flush();
                 }
-                if (res != RES_ERR_SYNTAX) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(param_ulong));
-                    res = RES_PASS;
-                }    
-            } else { // missing parameter
+            } else if (!SubscribableProperty(param[first + 1])) {
+                res = RES_ERR_SYNTAX;
+            } else if (param.size() > first + 2 &&
+                       !ParseNumber(param[first + 2], &interval)) {
                 res = RES_ERR_SYNTAX;
             }
-            param[0] = "";
-        } else if (param[0] == "exit" || param[0] == "quit") {
-            res = RES_PASS;
-        } else { // unknown command
-            param[0] = "";
+            if (res == RES_PASS && param.size() > first + 1) {
+                subscriptions.Subscribe(std::string(param[first + 1]),
+                                        interval, client);
+            }
+            if (res == RES_ERR_SYNTAX &&
+                    VERBOSITY_ENABLED(VERBOSITY_ERR, verbosity)) {
+                out << "*ERR:  syntax error \" "
+                    << stdinline << "\""
+                    << std::endl;
+            }
+        } else if (param[first] == "unsubscribe") {
             res = RES_ERR_SYNTAX;
+            if (param.size() > first + 1) {
+                std::string property(param[first + 1]);
+                res = subscriptions.Unsubscribe(property, client) ?
+                      RES_PASS : RES_WARN_NOTRUN;
+            } else if (VERBOSITY_ENABLED(VERBOSITY_ERR, verbosity)) {
+                out << "*ERR:  syntax error \" "
+                    << stdinline << "\""
+                    << std::endl;
+            }
+        } else if (param[first] == "get" && param[first + 1] == "slide") {
+            /* get slide [<hash>]: a cached slide, base64 encoded */
+            const SlideShow::Slide *slide = slideshow.Last();
+            uint64_t hash;
+            res = RES_PASS;
+            if (param.size() > first + 2) {
+                slide = nullptr;
+                if (SlideShow::ParseHash(param[first + 2], &hash)) {
+                    slide = slideshow.Find(hash);
+                } else {
+                    res = RES_ERR_SYNTAX;
+                }
+            }
+            if (res == RES_ERR_SYNTAX) {
+                if (VERBOSITY_ENABLED(VERBOSITY_ERR, verbosity)) {
+                    out << "*ERR:  syntax error \" "
+                        << stdinline << "\""
+                        << std::endl;
+                }
+            } else if (!slide) {
+                res = RES_ERR_FAIL;
+                if (VERBOSITY_ENABLED(VERBOSITY_ERR, verbosity)) {
+                    out << "*ERR:  get slide: the slide isn't cached."
+                        << std::endl;
+                }
+            } else {
+                std::string data;
+                Base64(std::string_view(slide->data, slide->size), &data);
+                if (jsonl) {
+                    SlideValue(*slide, false, &fields);
+                    fields.String("data", data);
+                } else if (VERBOSITY_ENABLED(VERBOSITY_MSG, verbosity)) {
+                    out << "*MSG:  slide==" << SlideValue(*slide, false, nullptr)
+                        << "\n" << data
+                        << std::endl;
+                }
+            }
+        } else if (param[first] == "sleep") {
+            /* sleep <ms>: a timer of the main loop, the worker serves  *
+             * other clients meanwhile. The later lines of this client  *
+             * are held until it ends, a shorter timeout ends it early. */
+            std::string key = RequestKey(client, id);
+            unsigned long ms;
+            if (param.size() != first + 2 ||
+                    !ParseNumber(param[first + 1], &ms)) {
+                res = RES_ERR_SYNTAX;
+            } else if (pending.count(key)) { // the same id is still running
+                res = RES_WARN_NOTRUN;
+            } else {
+                bool timedout = timeout >= 0 && (unsigned long)timeout < ms;
+                int timer = reactor.AddTimer(timedout ? timeout : ms,
+                                             [&, key, timedout]() {
+                    auto it = pending.find(key);
+                    if (it == pending.end()) {
+                        return;
+                    }
+                    printresult(it->second.client, it->second.id,
+                                it->second.command,
+                                timedout ? RES_ERR_TIMEOUT : RES_PASS, "");
+                    wakeclient(it->second.client);
+                    pending.erase(it);
+                    quitwhenidle();
+                });
+                pending[key] = PendingRequest{timer, std::string(command),
+                                              client, id, true};
+                sleeps[client] = key;
+                return;
+            }
+        } else if (param[first] == "cancel") {
+            /* cancel [<id>]: drop a queued request or stop the running *
+             * one (the running request is cancelled without <id>).     *
+             * A client can cancel its own requests only.               */
+            std::string cancelkey = param.size() > first + 1 ?
+                                    RequestKey(client, param[first + 1]) :
+                                    worker.Running();
+            res = RES_WARN_NOTRUN;
+            auto it = pending.find(cancelkey);
+            if (it != pending.end() && it->second.client == client) {
+                if (scripts.count(cancelkey)) {
+                    stopscript(cancelkey, RES_ERR_CANCEL);
+                    res = RES_PASS;
+                } else if (it->second.sleep || worker.Dequeue(cancelkey)) {
+                    if (it->second.timer) {
+                        reactor.CancelTimer(it->second.timer);
+                    }
+                    printresult(client, it->second.id, it->second.command,
+                                RES_ERR_CANCEL, "");
+                    if (it->second.sleep) {
+                        wakeclient(client);
+                    }
+                    pending.erase(it);
+                    res = RES_PASS;
+                } else if (worker.CancelRunning(cancelkey, [&]() {
+                               dabradio.Cancel();
+                           })) {
+                    res = RES_PASS; // the worker reports the result
+                }
+            }
+        } else { // a command for the MonkeyBoard
+            std::string key = RequestKey(client, id);
+            int timer = 0;
+            if (pending.count(key)) { // the same id is still running
+                res = RES_WARN_NOTRUN;
+                printresult(client, id, command, res, "");
+                return;
+            }
+            if (timeout >= 0) {
+                timer = reactor.AddTimer(timeout, [&, key]() {
+                    auto it = pending.find(key);
+                    if (it == pending.end()) {
+                        return;
+                    }
+                    if (!worker.Dequeue(key)) { // running or just finished
+                        worker.CancelRunning(key, [&]() {
+                            dabradio.Cancel();
+                        });
+                    }
+                    printresult(it->second.client, it->second.id,
+                                it->second.command, RES_ERR_TIMEOUT, "");
+                    pending.erase(it); // drop the messages coming later
+                    quitwhenidle();
+                });
+            }
+            pending[key] = PendingRequest{timer, std::string(command),
+                                          client, id, false};
+            worker.Submit(DeviceRequest{key, std::string(command)});
+            return;
         }
-
-        /* return command result */
-        if (res == RES_ERR_SYNTAX) {
-            if (verbosity >= VERBOSITY_ERR) {
-                std::cout << "*ERR:  syntax error \" "
-                          << stdinline << "\""
-                          << std::endl;
+        if (client != 0 && clientout.tellp() > 0) {
+            send(client, clientout.str());
+        }
+        printresult(client, id, command, res, fields.Text());
+        if (client != 0 && res == RES_PASS &&
+                (param[first] == "exit" || param[first] == "quit")) {
+            controlsocket.Close(client);
+        }
+        quitwhenidle();
+    };
+    
+    /* A disconnected client loses its subscriptions and its queued    *
+     * requests. The output of its running request is dropped.         */
+    dropclient = [&](int client) {
+        subscriptions.Unsubscribe("all", client);
+        batches.erase(client);
+        sleeps.erase(client);
+        heldlines.erase(client);
+        for (auto it = scripts.begin(); it != scripts.end(); ) {
+            auto p = pending.find(it->first);
+            if (p != pending.end() && p->second.client == client) {
+                it->second.script->Stop(RES_ERR_CANCEL);
+                worker.Dequeue(it->first);
+                if (it->second.timer) {
+                    reactor.CancelTimer(it->second.timer);
+                }
+                if (p->second.timer) {
+                    reactor.CancelTimer(p->second.timer);
+                }
+                pending.erase(p);
+                it = scripts.erase(it);
+            } else {
+                it++;
             }
         }
-        if (res != RES_WARN_NONE) {
-            if (verbosity >= VERBOSITY_RES) {
-                std::cout << "*RES:  " << res
-                          << std::endl;
+        for (auto it = pending.begin(); it != pending.end(); ) {
+            if (it->second.client == client &&
+                    (it->second.sleep || worker.Dequeue(it->first))) {
+                if (it->second.timer) {
+                    reactor.CancelTimer(it->second.timer);
+                }
+                it = pending.erase(it);
+            } else {
+                it++;
             }
         }
-        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        quitwhenidle();
+    };
+    
+    /* Wait for commands on stdin without polling: poll() wakes up the *
+     * main thread only when there is something to read. The data is  *
+     * read in blocks and split into complete lines which are passed  *
+     * to the command parser without copying them again.              */
+    reactor.AddFd(STDIN_FILENO, POLLIN, [&](int fd, short revents) {
+        std::string_view stdinline;
+        bool overlong;
+        ssize_t len;
+        
+        len = stdinreader.Fill(fd);
+        if (len < 0 && (errno == EINTR || errno == EAGAIN)) {
+            return;
+        }
+        if (len <= 0) { // end of file: execute a pending unterminated line
+            reactor.RemoveFd(fd);
+            stdinreader.Finish();
+        }
+        do {
+            while (stdinreader.Front(&stdinline, &overlong)) {
+                handleline(0, stdinline, overlong);
+                stdinreader.Pop();
+            }
+        } while (stdinreader.Split()); // lines which didn't fit into the ring
+        // with a control socket dabd keeps running at the end of stdin
+        if (quitting || (len <= 0 && socketpath.empty())) {
+            reactor.RemoveFd(fd);
+            if (!quitting && (sleeps.count(0) || heldlines.count(0))) {
+                stdinheld = true; // quit after the held lines
+                return;
+            }
+            quitting = true;
+            quitwhenidle();
+        }
+    });
+    /* -x <script>: executed like "run <script>" with the id "init" */
+    if (initscript.length()) {
+        handleline(0, "@init run " + initscript, false);
     }
+    reactor.Run();
+    
+    // the worker must not use dabradio any longer
+    controlsocket.Shutdown();
+    subscriptions.Clear();
+    worker.Stop();
+    dabradio.SetOutput(msgout.rdbuf());
+    
     // print this line anyway and independent to the verbosity level
     // for signaling the termination of dabd to piped processes!
-    std::cout << "*MSG:  Press <ENTER> to terminate " << argv[0]
-              << std::endl;    
-    stdinthr_reading = false;
-    stdinthread.join();
+    if (jsonl) {
+        record.Clear();
+        record.BeginObject();
+        record.String("event", "terminate");
+        record.EndObject();
+        record.Newline();
+        WriteRecord(record.Text());
+    } else {
+        std::cout << "*MSG:  Press <ENTER> to terminate " << argv[0]
+                  << std::endl;
+    }
     return 0;
 }
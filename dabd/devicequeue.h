@@ -0,0 +1,250 @@
+/*      dabd -- a DAB radio backend daemon for the Raspberry Pi
+ *                Copyright  (C) 2019 schlizbaeda
+ *
+ * dabd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License
+ * or any later version.
+ *
+ * devicequeue.h -- the device worker thread.
+ *
+ * Exactly one thread talks to the MonkeyBoard. The main thread hands
+ * over command lines as DeviceRequests tagged with an id and goes on
+ * serving its event loop. The worker executes them one after another.
+ * Everything the worker writes into its output stream and the final
+ * result code come back to the main thread as DeviceEvents carrying
+ * the id of the request. An eventfd wakes up the main thread's poll().
+ */
+
+#ifndef DABD_DEVICEQUEUE_H
+#define DABD_DEVICEQUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+
+/* the result of an internal task and a callback for the main thread */
+typedef std::function<int(std::string *result)> DeviceTask;
+typedef std::function<void(int res, const std::string &result)> DeviceDone;
+
+struct DeviceRequest {
+    std::string id;
+    std::string line;  // the command line to execute
+    DeviceTask  task;  // or an internal task instead of a command line
+    DeviceDone  done;  // called by the main thread when task is finished
+};
+
+struct DeviceEvent {
+    std::string id;
+    bool        done;  // false: output text, true: request finished
+    int         res;   // result code if done
+    std::string text;  // output text if !done, result of a task if done
+    DeviceDone  callback;
+};
+
+
+class DeviceWorker {
+public:
+    /* executes one request on the worker thread, returns its result  *
+     * code, *result is passed to the main thread with the done event */
+    typedef std::function<int(const DeviceRequest &req,
+                              std::ostream &out,
+                              std::string *result)> Executor;
+
+    DeviceWorker() : m_outbuf(this), m_out(&m_outbuf) {
+        m_eventfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        m_stopping = false;
+        m_busy = false;
+    }
+    ~DeviceWorker() {
+        Stop();
+        ::close(m_eventfd);
+    }
+
+    void Start(Executor executor) {
+        m_executor = executor;
+        m_thread = std::thread(&DeviceWorker::Run, this);
+    }
+    /* finish the running request, drop the queued ones */
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+            m_requests.clear();
+        }
+        m_cond.notify_one();
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+    }
+
+    /* the stream the executor writes to: each flush (std::endl)
+     * becomes an output event of the running request */
+    std::streambuf *OutputBuffer() {
+        return &m_outbuf;
+    }
+
+    /* main thread side */
+    void Submit(const DeviceRequest &req) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_requests.push_back(req);
+        }
+        m_cond.notify_one();
+    }
+    /* remove a queued request, returns false if it isn't queued */
+    bool Dequeue(const std::string &id) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto it = m_requests.begin(); it != m_requests.end(); ++it) {
+            if (it->id == id) {
+                m_requests.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+    /* Call cancel() if id is the running request. It is called with
+     * the lock held: the worker can't finish id and start the next
+     * request meanwhile, so cancel() never hits another request.
+     * Returns false if id isn't running. */
+    bool CancelRunning(const std::string &id,
+                       const std::function<void()> &cancel) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_busy || m_running != id) {
+            return false;
+        }
+        cancel();
+        return true;
+    }
+    /* id of the running request or "" */
+    std::string Running() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_busy ? m_running : std::string();
+    }
+    /* neither a running nor a queued request */
+    bool Idle() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return !m_busy && m_requests.empty();
+    }
+    int EventFd() const {
+        return m_eventfd;
+    }
+    bool PopEvent(DeviceEvent *ev) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_events.empty()) {
+            uint64_t count;
+            // reset the eventfd, new events will signal it again
+            while (::read(m_eventfd, &count, sizeof(count)) > 0) {
+            }
+            return false;
+        }
+        *ev = std::move(m_events.front());
+        m_events.pop_front();
+        return true;
+    }
+
+private:
+    /* collects the output of the running request */
+    class EventStreamBuf : public std::streambuf {
+    public:
+        EventStreamBuf(DeviceWorker *worker) : m_worker(worker) {
+        }
+    protected:
+        int overflow(int c) override {
+            if (c != traits_type::eof()) {
+                m_text += (char)c;
+            }
+            return c;
+        }
+        std::streamsize xsputn(const char *s, std::streamsize n) override {
+            m_text.append(s, n);
+            return n;
+        }
+        int sync() override {
+            if (m_text.length()) {
+                m_worker->PostOutput(m_text);
+                m_text.clear();
+            }
+            return 0;
+        }
+    private:
+        DeviceWorker *m_worker;
+        std::string   m_text;
+    };
+
+    void Run() {
+        DeviceRequest req;
+        int res;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this]() {
+                    return m_stopping || !m_requests.empty();
+                });
+                if (m_stopping) {
+                    return;
+                }
+                req = std::move(m_requests.front());
+                m_requests.pop_front();
+                m_running = req.id;
+                m_busy = true;
+            }
+            std::string result;
+            if (req.task) {
+                res = req.task(&result);
+            } else {
+                res = m_executor(req, m_out, &result);
+            }
+            m_out.flush();
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_busy = false;
+            }
+            Post(DeviceEvent{req.id, true, res, result, std::move(req.done)});
+        }
+    }
+    void PostOutput(const std::string &text) {
+        std::string id;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            id = m_running;
+        }
+        Post(DeviceEvent{id, false, 0, text, nullptr});
+    }
+    void Post(DeviceEvent &&ev) {
+        uint64_t one = 1;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_events.push_back(std::move(ev));
+        }
+        if (::write(m_eventfd, &one, sizeof(one)) < 0) {
+            // counter overflow is impossible, the fd is signalled anyway
+        }
+    }
+
+    Executor                  m_executor;
+    std::thread               m_thread;
+    std::mutex                m_mutex;
+    std::condition_variable   m_cond;
+    std::deque<DeviceRequest> m_requests;  // waiting for the worker
+    std::deque<DeviceEvent>   m_events;    // waiting for the main thread
+    std::string               m_running;   // id of the running request
+    bool                      m_busy;
+    bool                      m_stopping;
+    int                       m_eventfd;
+    EventStreamBuf            m_outbuf;
+    std::ostream              m_out;
+};
+
+#endif // DABD_DEVICEQUEUE_H
@@ -0,0 +1,222 @@
+/*      dabd -- a DAB radio backend daemon for the Raspberry Pi
+ *                Copyright  (C) 2019 schlizbaeda
+ *
+ * dabd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License
+ * or any later version.
+ *
+ * dlshistory.h -- the program texts (DLS) received per service.
+ *
+ * Every service gets a ring of the last DLSHISTORY_ENTRIES different
+ * texts with the time each was received first and last. The entries
+ * have a fixed size, a ring is allocated once when the first text of
+ * its service arrives. A text which is still in the ring (a station
+ * slogan, the title of the song shown again) only updates its time.
+ * The texts are compared by a 64 bit hash first.
+ *
+ * "Artist - Title" (also with an en dash) and "Title by Artist" are
+ * split into artist and title when the text arrives, a prefix like
+ * "Now playing:" is skipped. History() and Search() hand out string
+ * views into the rings, they don't allocate.
+ */
+
+#ifndef DABD_DLSHISTORY_H
+#define DABD_DLSHISTORY_H
+
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string_view>
+
+#define DLSHISTORY_ENTRIES 32    // texts kept per service
+#define DLSHISTORY_TEXT_SIZE 256 // bytes, a DLS has up to 128 characters
+
+
+class DlsHistory {
+public:
+    struct Text {
+        time_t           first; // received first
+        time_t           last;  // received last
+        std::string_view text;
+        std::string_view artist; // "" if the text isn't a song
+        std::string_view title;
+    };
+
+    /* Add a text received from serviceid at time now. label is the name
+     * of the service: "<label> - News" isn't a song. Returns false if
+     * the text was in the ring already. */
+    bool Add(uint32_t serviceid, std::string_view text, time_t now,
+             std::string_view label = std::string_view()) {
+        Ring &ring = m_rings[serviceid];
+        uint64_t hash;
+        text = Trim(text.substr(0, DLSHISTORY_TEXT_SIZE));
+        if (text.empty()) {
+            return false;
+        }
+        hash = Hash(text);
+        for (size_t i = 0; i < ring.count; i++) {
+            Entry &entry = ring.entries[i];
+            if (entry.hash == hash &&
+                    std::string_view(entry.text, entry.length) == text) {
+                entry.last = now;
+                return false;
+            }
+        }
+        Entry &entry = ring.entries[ring.next];
+        ring.next = (ring.next + 1) % DLSHISTORY_ENTRIES;
+        ring.count += ring.count < DLSHISTORY_ENTRIES;
+        memcpy(entry.text, text.data(), text.length());
+        entry.length = text.length();
+        entry.hash = hash;
+        entry.first = entry.last = now;
+        Parse(&entry, label);
+        return true;
+    }
+    void Clear() {
+        m_rings.clear();
+    }
+
+    /* fn(const Text &) for the last n texts of serviceid, the newest
+     * first. Returns the number of texts passed to fn. */
+    template<typename Fn>
+    size_t History(uint32_t serviceid, size_t n, Fn fn) const {
+        auto it = m_rings.find(serviceid);
+        size_t i;
+        if (it == m_rings.end()) {
+            return 0;
+        }
+        const Ring &ring = it->second;
+        n = n < ring.count ? n : ring.count;
+        for (i = 0; i < n; i++) {
+            size_t e = (ring.next + DLSHISTORY_ENTRIES - 1 - i) %
+                       DLSHISTORY_ENTRIES;
+            fn(View(ring.entries[e]));
+        }
+        return n;
+    }
+    /* fn(uint32_t serviceid, const Text &) for every text containing
+     * needle, compared without case of ASCII letters. Returns the
+     * number of matches. */
+    template<typename Fn>
+    size_t Search(std::string_view needle, Fn fn) const {
+        size_t matches = 0;
+        for (auto &service : m_rings) {
+            History(service.first, DLSHISTORY_ENTRIES,
+                    [&](const Text &text) {
+                        if (Contains(text.text, needle)) {
+                            fn(service.first, text);
+                            matches++;
+                        }
+                    });
+        }
+        return matches;
+    }
+
+private:
+    struct Entry {
+        time_t   first;
+        time_t   last;
+        uint64_t hash;
+        uint16_t length;
+        uint16_t artist;       // offset into text
+        uint16_t artistlength; // 0: not a song
+        uint16_t title;
+        uint16_t titlelength;
+        char     text[DLSHISTORY_TEXT_SIZE];
+    };
+    struct Ring {
+        Entry  entries[DLSHISTORY_ENTRIES];
+        size_t count = 0; // entries in use
+        size_t next = 0;  // the entry the next text is written to
+    };
+
+    static uint64_t Hash(std::string_view text) {
+        uint64_t hash = 0xcbf29ce484222325ull; // FNV-1a
+        for (char c : text) {
+            hash = (hash ^ (uint8_t)c) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+    static std::string_view Trim(std::string_view s) {
+        while (s.length() && (s.front() == ' ' || s.front() == '\t')) {
+            s.remove_prefix(1);
+        }
+        while (s.length() && (s.back() == ' ' || s.back() == '\t' ||
+                              s.back() == '\r' || s.back() == '\n')) {
+            s.remove_suffix(1);
+        }
+        return s;
+    }
+    static char Lower(char c) {
+        return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+    }
+    static bool StartsWith(std::string_view s, std::string_view prefix) {
+        if (s.length() < prefix.length()) {
+            return false;
+        }
+        for (size_t i = 0; i < prefix.length(); i++) {
+            if (Lower(s[i]) != Lower(prefix[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    static bool Contains(std::string_view s, std::string_view needle) {
+        for (size_t i = 0; i + needle.length() <= s.length(); i++) {
+            if (StartsWith(s.substr(i), needle)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* the artist and the title of a song */
+    static void Parse(Entry *entry, std::string_view label) {
+        static const std::string_view prefixes[] = {
+            "now playing:", "now playing", "on air:", "jetzt läuft:",
+            "jetzt:", "nowplaying:",
+        };
+        std::string_view text(entry->text, entry->length);
+        std::string_view artist;
+        std::string_view title;
+        size_t sep;
+        // a reused entry still holds the offsets of its former text
+        entry->artist = entry->title = 0;
+        entry->artistlength = entry->titlelength = 0;
+        for (std::string_view prefix : prefixes) {
+            if (StartsWith(text, prefix)) {
+                text = Trim(text.substr(prefix.length()));
+                break;
+            }
+        }
+        if ((sep = text.find(" - ")) != std::string_view::npos) {
+            artist = Trim(text.substr(0, sep));
+            title = Trim(text.substr(sep + 3));
+        } else if ((sep = text.find(" – ")) != std::string_view::npos) {
+            artist = Trim(text.substr(0, sep));
+            title = Trim(text.substr(sep + 5)); // the dash has 3 bytes
+        } else if ((sep = text.rfind(" by ")) != std::string_view::npos) {
+            title = Trim(text.substr(0, sep));
+            artist = Trim(text.substr(sep + 4));
+        }
+        if (artist.empty() || title.empty() || artist == label) {
+            return; // e.g. "Deutschlandfunk - Nachrichten"
+        }
+        entry->artist = artist.data() - entry->text;
+        entry->artistlength = artist.length();
+        entry->title = title.data() - entry->text;
+        entry->titlelength = title.length();
+    }
+    static Text View(const Entry &entry) {
+        std::string_view text(entry.text, entry.length);
+        return Text{entry.first, entry.last, text,
+                    text.substr(entry.artist, entry.artistlength),
+                    text.substr(entry.title, entry.titlelength)};
+    }
+
+    std::map<uint32_t, Ring> m_rings; // by ServiceID
+};
+
+#endif // DABD_DLSHISTORY_H
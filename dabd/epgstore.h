@@ -0,0 +1,149 @@
+/*      dabd -- a DAB radio backend daemon for the Raspberry Pi
+ *                Copyright  (C) 2019 schlizbaeda
+ *
+ * dabd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License
+ * or any later version.
+ *
+ * epgstore.h -- the electronic programme guide of the DAB services.
+ *
+ * GetEpg() of the KeyStone library returns all programmes of a service
+ * it has received, in no particular order. EpgStore keeps them per
+ * ServiceID in a compact time-ordered index: a vector of 16 byte
+ * entries sorted by the start time, the names and descriptions of a
+ * service in a single string. A programme ends when the next one
+ * starts, the last one is open ended. So the programme running at a
+ * time and those between two times are found by a binary search.
+ *
+ * The programmes of a service are replaced as a whole: Begin(), Add()
+ * for each programme, End(). The index is built in a spare buffer,
+ * so the store keeps its capacity and doesn't allocate once all
+ * services have been harvested.
+ */
+
+#ifndef DABD_EPGSTORE_H
+#define DABD_EPGSTORE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define EPG_HARVEST_INTERVAL 10000 // ms between the GetEpg() of two services
+
+
+class EpgStore {
+public:
+    struct Programme {
+        time_t           start;
+        time_t           end;         // 0: unknown, the last programme
+        std::string_view name;
+        std::string_view description;
+    };
+
+    /* replace the programmes of serviceid */
+    void Begin(uint32_t serviceid) {
+        m_serviceid = serviceid;
+        m_spare.entries.clear();
+        m_spare.text.clear();
+    }
+    void Add(time_t start, std::string_view name,
+             std::string_view description) {
+        m_spare.entries.push_back(Entry{(int64_t)start,
+                                        (uint32_t)m_spare.text.length(),
+                                        (uint16_t)name.length(),
+                                        (uint16_t)description.length()});
+        m_spare.text.append(name.data(), name.length());
+        m_spare.text.append(description.data(), description.length());
+    }
+    /* sort by start time, a programme given twice is kept once */
+    void End(time_t harvested) {
+        std::vector<Entry> &entries = m_spare.entries;
+        std::stable_sort(entries.begin(), entries.end(),
+                         [](const Entry &a, const Entry &b) {
+                             return a.start < b.start;
+                         });
+        entries.erase(std::unique(entries.begin(), entries.end(),
+                                  [](const Entry &a, const Entry &b) {
+                                      return a.start == b.start;
+                                  }),
+                      entries.end());
+        m_spare.harvested = harvested;
+        std::swap(m_services[m_serviceid], m_spare);
+    }
+    void Clear() {
+        m_services.clear();
+    }
+
+    /* the number of programmes of serviceid */
+    size_t Size(uint32_t serviceid) const {
+        const Index *index = Find(serviceid);
+        return index ? index->entries.size() : 0;
+    }
+    /* time of the last harvest of serviceid or 0 */
+    time_t Harvested(uint32_t serviceid) const {
+        const Index *index = Find(serviceid);
+        return index ? index->harvested : 0;
+    }
+    /* [*first, *last): the programmes running between from and to */
+    void Range(uint32_t serviceid, time_t from, time_t to,
+               size_t *first, size_t *last) const {
+        const Index *index = Find(serviceid);
+        *first = *last = 0;
+        if (!index) {
+            return;
+        }
+        auto begin = index->entries.begin();
+        auto end = index->entries.end();
+        // the last programme starting at from or before is running then
+        auto it = std::upper_bound(begin, end, (int64_t)from,
+                                   [](int64_t t, const Entry &e) {
+                                       return t < e.start;
+                                   });
+        *first = it == begin ? 0 : it - begin - 1;
+        *last = std::lower_bound(begin, end, (int64_t)to,
+                                 [](const Entry &e, int64_t t) {
+                                     return e.start < t;
+                                 }) - begin;
+        *first = std::min(*first, *last);
+    }
+    /* programme i of serviceid, i < Size(serviceid) */
+    Programme Get(uint32_t serviceid, size_t i) const {
+        const Index &index = *Find(serviceid);
+        const Entry &e = index.entries[i];
+        std::string_view text(index.text);
+        return Programme{(time_t)e.start,
+                         i + 1 < index.entries.size() ?
+                         (time_t)index.entries[i + 1].start : 0,
+                         text.substr(e.text, e.namelen),
+                         text.substr(e.text + e.namelen, e.descriptionlen)};
+    }
+
+private:
+    struct Entry {
+        int64_t  start;
+        uint32_t text;           // offset of the name in Index::text
+        uint16_t namelen;
+        uint16_t descriptionlen; // the description follows the name
+    };
+    struct Index {
+        std::vector<Entry> entries;
+        std::string        text;
+        time_t             harvested = 0;
+    };
+
+    const Index *Find(uint32_t serviceid) const {
+        auto it = m_services.find(serviceid);
+        return it == m_services.end() ? nullptr : &it->second;
+    }
+
+    std::map<uint32_t, Index> m_services;
+    Index                     m_spare;     // built by Begin()...End()
+    uint32_t                  m_serviceid = 0;
+};
+
+#endif // DABD_EPGSTORE_H
@@ -0,0 +1,169 @@
+/*      dabd -- a DAB radio backend daemon for the Raspberry Pi
+ *                Copyright  (C) 2019 schlizbaeda
+ *
+ * dabd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License
+ * or any later version.
+ *
+ * fmscan.h -- finding FM stations by their signal strength.
+ *
+ * The MonkeyBoard has no FM search of its own: dabd tunes to a
+ * frequency with PlayStream() and reads GetSignalStrength() back,
+ * every measurement costs two serial round trips. A station can be
+ * received some 100 kHz beside its frequency, so the band is measured
+ * in steps of FMSCAN_COARSE_STEP first. Only around a coarse reading
+ * which is stronger than both of its neighbours the strength is
+ * followed uphill on the channel raster of FMSCAN_FINE_STEP. A peak
+ * of at least FMSCAN_STRONG is a station.
+ *
+ * A seek walks the coarse steps from the tuned frequency on, around
+ * the band if necessary, and follows the first reading of at least
+ * FMSCAN_CANDIDATE uphill. It stops at the first peak which is strong
+ * and isn't the station it started from.
+ *
+ * The measurement is a function object: measure(freq) tunes to freq
+ * (kHz) and returns the signal strength in % or a negative error,
+ * which stops the search at once (a cancelled scan, a serial error).
+ */
+
+#ifndef DABD_FMSCAN_H
+#define DABD_FMSCAN_H
+
+#include <cstdlib>
+#include <vector>
+
+#define FM_BAND_LOW 87500       // kHz
+#define FM_BAND_HIGH 108000     // kHz
+#define FMSCAN_FINE_STEP 100    // kHz, the channel raster
+#define FMSCAN_COARSE_STEP 300  // kHz
+#define FMSCAN_CANDIDATE 10     // % of a coarse reading worth a closer look
+#define FMSCAN_STRONG 30        // % of a station
+
+
+class FmScanner {
+public:
+    struct Station {
+        unsigned long freq;     // kHz, 0: none
+        int           strength; // %
+    };
+
+    FmScanner() {
+        m_measurements = 0;
+    }
+
+    /* all stations of the band into *stations, ascending by frequency.
+     * Returns 0 or the error of measure. */
+    template<typename Measure>
+    int Sweep(Measure measure, std::vector<Station> *stations) {
+        std::vector<Station> coarse;
+        Station peak;
+        int res;
+        stations->clear();
+        for (unsigned long freq = FM_BAND_LOW; freq <= FM_BAND_HIGH;
+                freq += FMSCAN_COARSE_STEP) {
+            if ((res = Read(measure, freq)) < 0) {
+                return res;
+            }
+            coarse.push_back(Station{freq, res});
+        }
+        for (size_t i = 0; i < coarse.size(); i++) {
+            int strength = coarse[i].strength;
+            if (strength < FMSCAN_CANDIDATE ||
+                    (i > 0 && coarse[i - 1].strength > strength) ||
+                    (i + 1 < coarse.size() &&
+                     coarse[i + 1].strength >= strength)) {
+                continue; // the peak is nearer to a neighbour
+            }
+            if ((res = Climb(measure, coarse[i], &peak)) < 0) {
+                return res;
+            }
+            if (peak.strength >= FMSCAN_STRONG && (stations->empty() ||
+                    stations->back().freq != peak.freq)) {
+                stations->push_back(peak);
+            }
+        }
+        return 0;
+    }
+    /* the next strong station from the frequency from upwards
+     * (direction > 0) or downwards into *station, its freq is 0 if
+     * there is none in the whole band. Returns 0 or the error of
+     * measure. */
+    template<typename Measure>
+    int Seek(Measure measure, unsigned long from, int direction,
+             Station *station) {
+        const long span = FM_BAND_HIGH - FM_BAND_LOW + FMSCAN_FINE_STEP;
+        long step = direction > 0 ? FMSCAN_COARSE_STEP : -FMSCAN_COARSE_STEP;
+        long freq = from;
+        int res;
+        *station = Station{0, 0};
+        if (from < FM_BAND_LOW || from > FM_BAND_HIGH) { // start at the edge
+            freq = direction > 0 ? FM_BAND_LOW - FMSCAN_COARSE_STEP
+                                 : FM_BAND_HIGH + FMSCAN_COARSE_STEP;
+        }
+        for (long walked = 0; walked < span; walked += FMSCAN_COARSE_STEP) {
+            freq += step;
+            if (freq > FM_BAND_HIGH) { // around the band
+                freq -= span;
+            } else if (freq < FM_BAND_LOW) {
+                freq += span;
+            }
+            if ((res = Read(measure, freq)) < 0) {
+                return res;
+            }
+            if (res < FMSCAN_CANDIDATE) {
+                continue;
+            }
+            if ((res = Climb(measure, Station{(unsigned long)freq, res},
+                             station)) < 0) {
+                return res;
+            }
+            if (station->strength >= FMSCAN_STRONG && station->freq != from) {
+                return 0;
+            }
+        }
+        *station = Station{0, 0};
+        return 0;
+    }
+
+    /* the calls of measure since the construction */
+    long Measurements() const {
+        return m_measurements;
+    }
+
+private:
+    template<typename Measure>
+    int Read(Measure &measure, unsigned long freq) {
+        m_measurements++;
+        return measure(freq);
+    }
+    /* follow the strength from start uphill on the channel raster, not
+     * farther than a coarse step: the local maximum into *peak */
+    template<typename Measure>
+    int Climb(Measure &measure, Station start, Station *peak) {
+        int res;
+        *peak = start;
+        for (long step : {(long)FMSCAN_FINE_STEP, -(long)FMSCAN_FINE_STEP}) {
+            long freq = (long)start.freq + step;
+            while (std::labs(freq - (long)start.freq) < FMSCAN_COARSE_STEP &&
+                   freq >= FM_BAND_LOW && freq <= FM_BAND_HIGH) {
+                if ((res = Read(measure, freq)) < 0) {
+                    return res;
+                }
+                if (res <= peak->strength) {
+                    break;
+                }
+                *peak = Station{(unsigned long)freq, res};
+                freq += step;
+            }
+            if (peak->freq != start.freq) {
+                break; // it went uphill in this direction
+            }
+        }
+        return 0;
+    }
+
+    long m_measurements;
+};
+
+#endif // DABD_FMSCAN_H
@@ -0,0 +1,52 @@
+#!/bin/bash
+# idlestat.sh -- measure the idle load of dabd
+#
+# Starts dabd with an open but silent stdin and samples the CPU time
+# and the number of context switches of all its threads from /proc.
+# Every voluntary context switch is a wakeup of a sleeping thread, so
+# the voluntary switches per second are the wakeups per second.
+#
+# usage: ./idlestat.sh [seconds] [path to dabd]
+#        e.g. compare an old and a new build:
+#        ./idlestat.sh 10 ./dabd.old; ./idlestat.sh 10 ./dabd
+
+SECONDS_IDLE=${1:-10}
+DABD=${2:-./dabd}
+
+# sum a field of /proc/<pid>/task/*/status over all threads
+sum_status() {
+    cat /proc/$1/task/*/status 2>/dev/null \
+        | awk -v key="$2:" '$1 == key { sum += $2 } END { print sum + 0 }'
+}
+# utime + stime of the process in clock ticks
+cpu_ticks() {
+    awk '{ print $14 + $15 }' /proc/$1/stat
+}
+
+# "sleep" keeps stdin of dabd open without sending any command
+sleep $((SECONDS_IDLE + 5)) | "$DABD" >/dev/null &
+sleep 1 # let dabd start up and print its help screen
+PID=$(pgrep -n -f "^$DABD")
+if [ -z "$PID" ]; then
+    echo "$DABD is not running"
+    exit 1
+fi
+
+TICKS0=$(cpu_ticks $PID)
+VCSW0=$(sum_status $PID voluntary_ctxt_switches)
+NVCSW0=$(sum_status $PID nonvoluntary_ctxt_switches)
+sleep $SECONDS_IDLE
+TICKS1=$(cpu_ticks $PID)
+VCSW1=$(sum_status $PID voluntary_ctxt_switches)
+NVCSW1=$(sum_status $PID nonvoluntary_ctxt_switches)
+kill $PID 2>/dev/null
+
+HZ=$(getconf CLK_TCK)
+awk -v t=$((TICKS1 - TICKS0)) -v hz=$HZ -v s=$SECONDS_IDLE \
+    -v v=$((VCSW1 - VCSW0)) -v nv=$((NVCSW1 - NVCSW0)) -v d="$DABD" \
+    'BEGIN {
+        printf "%s idle for %d s:\n", d, s
+        printf "  CPU time:        %.2f s (%.2f %%)\n", t / hz, 100 * t / hz / s
+        printf "  wakeups/s:       %.1f\n", v / s
+        printf "  preemptions/s:   %.1f\n", nv / s
+    }'
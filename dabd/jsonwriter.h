@@ -0,0 +1,142 @@
+/*      dabd -- a DAB radio backend daemon for the Raspberry Pi
+ *                Copyright  (C) 2019 schlizbaeda
+ *
+ * dabd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License
+ * or any later version.
+ *
+ * jsonwriter.h -- JSON records of the "--protocol=jsonl" mode.
+ *
+ * A JsonWriter appends JSON text to a buffer which is allocated once
+ * and reused for every record: Clear() keeps its capacity. Numbers
+ * are formatted by std::to_chars, so neither iostream nor locale is
+ * involved. Commas between the members are inserted automatically.
+ */
+
+#ifndef DABD_JSONWRITER_H
+#define DABD_JSONWRITER_H
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#define JSON_BUFFER_SIZE 16384 // a "list" of some hundred programs
+
+
+class JsonWriter {
+public:
+    JsonWriter(size_t capacity = JSON_BUFFER_SIZE) {
+        m_buf.reserve(capacity);
+        m_comma = false;
+    }
+
+    void Clear() {
+        m_buf.clear();
+        m_comma = false;
+    }
+    const std::string &Text() const { return m_buf; }
+    bool Empty() const { return m_buf.empty(); }
+
+    void BeginObject() {
+        Separate();
+        m_buf += '{';
+        m_comma = false;
+    }
+    void BeginObject(std::string_view key) {
+        Key(key);
+        BeginObject();
+    }
+    void EndObject() {
+        m_buf += '}';
+        m_comma = true;
+    }
+    void BeginArray(std::string_view key) {
+        Key(key);
+        Separate();
+        m_buf += '[';
+        m_comma = false;
+    }
+    void EndArray() {
+        m_buf += ']';
+        m_comma = true;
+    }
+    /* end of a record */
+    void Newline() {
+        m_buf += '\n';
+        m_comma = false;
+    }
+
+    void String(std::string_view key, std::string_view value) {
+        Key(key);
+        Quote(value);
+        m_comma = true;
+    }
+    void Int(std::string_view key, long long value) {
+        char num[24];
+        Key(key);
+        std::to_chars_result r = std::to_chars(num, num + sizeof(num), value);
+        m_buf.append(num, r.ptr - num);
+        m_comma = true;
+    }
+    void Bool(std::string_view key, bool value) {
+        Key(key);
+        m_buf += value ? "true" : "false";
+        m_comma = true;
+    }
+    /* members written by another JsonWriter, e.g. '"volume":9' */
+    void Members(std::string_view members) {
+        if (members.length()) {
+            Separate();
+            m_buf.append(members.data(), members.length());
+            m_comma = true;
+        }
+    }
+
+private:
+    void Separate() {
+        if (m_comma) {
+            m_buf += ',';
+            m_comma = false;
+        }
+    }
+    void Key(std::string_view key) {
+        Separate();
+        Quote(key);
+        m_buf += ':';
+    }
+    void Quote(std::string_view s) {
+        static const char hex[] = "0123456789abcdef";
+        size_t plain = 0;
+        m_buf += '"';
+        for (size_t i = 0; i < s.length(); i++) {
+            unsigned char c = (unsigned char)s[i];
+            if (c >= 0x20 && c != '"' && c != '\\') {
+                continue; // UTF-8 is copied unchanged
+            }
+            m_buf.append(s.data() + plain, i - plain);
+            plain = i + 1;
+            m_buf += '\\';
+            switch (c) {
+                case '"':  m_buf += '"';  break;
+                case '\\': m_buf += '\\'; break;
+                case '\n': m_buf += 'n';  break;
+                case '\r': m_buf += 'r';  break;
+                case '\t': m_buf += 't';  break;
+                default:
+                    m_buf += "u00";
+                    m_buf += hex[c >> 4];
+                    m_buf += hex[c & 15];
+                    break;
+            }
+        }
+        m_buf.append(s.data() + plain, s.length() - plain);
+        m_buf += '"';
+    }
+
+    std::string m_buf;
+    bool        m_comma; // the next member needs a ','
+};
+
+#endif // DABD_JSONWRITER_H
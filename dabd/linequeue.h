@@ -0,0 +1,185 @@
+/*      dabd -- a DAB radio backend daemon for the Raspberry Pi
+ *                Copyright  (C) 2019 schlizbaeda
+ *
+ * dabd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License
+ * or any later version.
+ *
+ * linequeue.h -- line oriented input queue.
+ *
+ * LineReader reads its file descriptor in blocks with read() and
+ * splits the data into whole lines. The lines are handed over to the
+ * consumer through LineRing, a bounded ring of fixed size line slots.
+ * The consumer gets a std::string_view onto the slot, so a command
+ * line is copied exactly once: from the read buffer into its slot.
+ *
+ * Reading and consuming both happen on the main thread (the reactor),
+ * so the ring needs no atomics. A line longer than a slot isn't cut
+ * silently: the consumer gets its beginning marked as overlong and
+ * has to reject it.
+ */
+
+#ifndef DABD_LINEQUEUE_H
+#define DABD_LINEQUEUE_H
+
+#include <cstring>
+#include <string_view>
+
+#include <errno.h>
+#include <unistd.h>
+
+#define LINEQUEUE_SLOTS 64         // must be a power of 2
+#define LINEQUEUE_SLOT_SIZE 256    // max. length of a command line
+#define LINEREADER_BUFFER_SIZE 4096
+
+
+template <size_t SLOTS, size_t SLOTSIZE>
+class LineRing {
+    static_assert((SLOTS & (SLOTS - 1)) == 0,
+                  "LineRing: SLOTS must be a power of 2");
+public:
+    LineRing() : m_head(0), m_tail(0) {
+    }
+
+    /* producer side: copy a line (without "\n") into the next free
+     * slot. A longer line keeps its first SLOTSIZE bytes and is marked
+     * as overlong. Returns false if all slots are in use. */
+    bool Push(const char *data, size_t len) {
+        if (Full()) {
+            return false;
+        }
+        Slot &slot = m_slots[m_tail & (SLOTS - 1)];
+        slot.overlong = len > SLOTSIZE;
+        if (slot.overlong) {
+            len = SLOTSIZE;
+        }
+        std::memcpy(slot.data, data, len);
+        slot.len = len;
+        m_tail++;
+        return true;
+    }
+    bool Full() const {
+        return m_tail - m_head == SLOTS;
+    }
+
+    /* consumer side: the view stays valid until Pop() is called,
+     * *overlong tells whether the line was longer than a slot */
+    bool Front(std::string_view *line, bool *overlong = nullptr) const {
+        if (Empty()) {
+            return false;
+        }
+        const Slot &slot = m_slots[m_head & (SLOTS - 1)];
+        *line = std::string_view(slot.data, slot.len);
+        if (overlong) {
+            *overlong = slot.overlong;
+        }
+        return true;
+    }
+    void Pop() {
+        m_head++;
+    }
+    bool Empty() const {
+        return m_head == m_tail;
+    }
+
+private:
+    struct Slot {
+        size_t len;
+        bool   overlong;
+        char   data[SLOTSIZE];
+    };
+    size_t m_head; // the next slot to consume
+    size_t m_tail; // the next slot to fill
+    Slot   m_slots[SLOTS];
+};
+
+
+class LineReader {
+public:
+    typedef LineRing<LINEQUEUE_SLOTS, LINEQUEUE_SLOT_SIZE> Ring;
+
+    LineReader() {
+        m_len = 0;
+        m_skipping = false;
+    }
+
+    /* producer side: one read() into the block buffer, then split.
+     * Returns the result of read(): 0 on end of file, -1 on error. */
+    ssize_t Fill(int fd) {
+        ssize_t len;
+        if (m_len == sizeof(m_buf)) {
+            Split(); // make room if the consumer popped some lines
+            if (m_len == sizeof(m_buf)) {
+                errno = EAGAIN;
+                return -1;
+            }
+        }
+        len = ::read(fd, m_buf + m_len, sizeof(m_buf) - m_len);
+        if (len > 0) {
+            m_len += len;
+            Split();
+        }
+        return len;
+    }
+    /* Move all complete lines from the block buffer into the ring as
+     * long as there are free slots. Returns the number of moved lines. */
+    int Split() {
+        int lines = 0;
+        size_t pos = 0;
+        while (pos < m_len) {
+            char *eol = (char*)std::memchr(m_buf + pos, '\n', m_len - pos);
+            if (eol == nullptr) {
+                break;
+            }
+            size_t linelen = eol - (m_buf + pos);
+            if (m_skipping) { // rest of an overlong line
+                m_skipping = false;
+            } else if (!m_ring.Push(m_buf + pos, linelen)) {
+                break; // ring full: try again after the consumer popped
+            } else {
+                lines++;
+            }
+            pos += linelen + 1;
+        }
+        if (pos == 0 && m_len == sizeof(m_buf)) {
+            // no line feed in the whole buffer: an overlong line
+            if (m_skipping) {
+                pos = m_len;
+            } else if (m_ring.Push(m_buf, m_len)) {
+                m_skipping = true;
+                pos = m_len;
+                lines++;
+            }
+        }
+        if (pos) {
+            std::memmove(m_buf, m_buf + pos, m_len - pos);
+            m_len -= pos;
+        }
+        return lines;
+    }
+    /* producer side at end of file: hand over an unterminated line */
+    void Finish() {
+        Split();
+        if (m_skipping || (m_len && m_ring.Push(m_buf, m_len))) {
+            m_len = 0;
+            m_skipping = false;
+        }
+    }
+
+    /* consumer side: an overlong line has to be rejected */
+    bool Front(std::string_view *line, bool *overlong = nullptr) const {
+        return m_ring.Front(line, overlong);
+    }
+    void Pop() {
+        m_ring.Pop();
+    }
+
+private:
+    char   m_buf[LINEREADER_BUFFER_SIZE];
+    size_t m_len;      // bytes in m_buf
+    bool   m_skipping; // dropping the remainder of an overlong line
+    Ring   m_ring;
+};
+
+#endif // DABD_LINEQUEUE_H
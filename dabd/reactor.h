@@ -0,0 +1,193 @@
+/*      dabd -- a DAB radio backend daemon for the Raspberry Pi
+ *                Copyright  (C) 2019 schlizbaeda
+ *
+ * dabd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License
+ * or any later version.
+ *
+ * reactor.h -- a small poll() based event loop.
+ *
+ * The main thread of dabd sleeps inside poll() until one of the
+ * watched file descriptors becomes readable/writable or the next
+ * timer expires. There is no periodic tick: an idle dabd without a
+ * timer doesn't wake up at all.
+ */
+
+#ifndef DABD_REACTOR_H
+#define DABD_REACTOR_H
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include <errno.h>
+#include <poll.h>
+
+class Reactor {
+public:
+    typedef std::chrono::steady_clock clock;
+    typedef std::function<void(int fd, short revents)> FdHandler;
+    typedef std::function<void()> TimerHandler;
+
+    Reactor() {
+        m_nexttimerid = 1;
+        m_running = false;
+    }
+
+    /* file descriptor watchers */
+    void AddFd(int fd, short events, FdHandler handler) {
+        Watcher w;
+        w.fd = fd;
+        w.events = events;
+        w.handler = handler;
+        RemoveFd(fd);
+        m_watchers.push_back(w);
+    }
+    void ModifyFd(int fd, short events) {
+        for (auto &w : m_watchers) {
+            if (w.fd == fd) {
+                w.events = events;
+            }
+        }
+    }
+    void RemoveFd(int fd) {
+        for (size_t i = 0; i < m_watchers.size(); i++) {
+            if (m_watchers[i].fd == fd) {
+                m_watchers.erase(m_watchers.begin() + i);
+                return;
+            }
+        }
+    }
+
+    /* one-shot (period == 0) or periodic timers, returns the timer id */
+    int AddTimer(long delay_ms, TimerHandler handler, long period_ms = 0) {
+        Timer t;
+        t.id = m_nexttimerid++;
+        t.due = clock::now() + std::chrono::milliseconds(delay_ms);
+        t.period = std::chrono::milliseconds(period_ms);
+        t.handler = handler;
+        m_timers.push_back(t);
+        return t.id;
+    }
+    void CancelTimer(int id) {
+        for (size_t i = 0; i < m_timers.size(); i++) {
+            if (m_timers[i].id == id) {
+                m_timers.erase(m_timers.begin() + i);
+                return;
+            }
+        }
+    }
+
+    /* Wait for the next event(s) and dispatch them. A negative
+     * max_ms waits until an event arrives. Returns the number of
+     * dispatched events or -1 if there is nothing left to wait for. */
+    int RunOnce(long max_ms = -1) {
+        int timeout;
+        int n;
+        int dispatched = 0;
+
+        if (m_watchers.empty() && m_timers.empty()) {
+            return -1;
+        }
+        timeout = PollTimeout(max_ms);
+        m_pollfds.resize(m_watchers.size());
+        for (size_t i = 0; i < m_watchers.size(); i++) {
+            m_pollfds[i].fd = m_watchers[i].fd;
+            m_pollfds[i].events = m_watchers[i].events;
+            m_pollfds[i].revents = 0;
+        }
+        n = ::poll(m_pollfds.data(), m_pollfds.size(), timeout);
+        if (n < 0 && errno != EINTR) {
+            return -1;
+        }
+        /* Handlers may add or remove watchers, so look every fd up
+         * again before calling its handler. */
+        for (size_t i = 0; n > 0 && i < m_pollfds.size(); i++) {
+            if (m_pollfds[i].revents) {
+                n--;
+                for (auto &w : m_watchers) {
+                    if (w.fd == m_pollfds[i].fd) {
+                        FdHandler handler = w.handler;
+                        dispatched++;
+                        handler(m_pollfds[i].fd, m_pollfds[i].revents);
+                        break;
+                    }
+                }
+            }
+        }
+        dispatched += FireTimers();
+        return dispatched;
+    }
+    void Run() {
+        m_running = true;
+        while (m_running && RunOnce() >= 0) {
+        }
+        m_running = false;
+    }
+    void Stop() {
+        m_running = false;
+    }
+
+private:
+    struct Watcher {
+        int fd;
+        short events;
+        FdHandler handler;
+    };
+    struct Timer {
+        int id;
+        clock::time_point due;
+        clock::duration period;
+        TimerHandler handler;
+    };
+
+    int PollTimeout(long max_ms) {
+        long timeout = max_ms;
+        clock::time_point now = clock::now();
+        for (auto &t : m_timers) {
+            long ms;
+            if (t.due <= now) {
+                return 0;
+            }
+            // round up: waking up too early would only spin
+            ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                     t.due - now + std::chrono::microseconds(999)).count();
+            if (timeout < 0 || ms < timeout) {
+                timeout = ms;
+            }
+        }
+        return (int)timeout;
+    }
+    int FireTimers() {
+        int fired = 0;
+        clock::time_point now = clock::now();
+        for (size_t i = 0; i < m_timers.size(); ) {
+            if (m_timers[i].due <= now) {
+                TimerHandler handler = m_timers[i].handler;
+                if (m_timers[i].period.count() > 0) {
+                    m_timers[i].due += m_timers[i].period;
+                    if (m_timers[i].due < now) { // don't catch up
+                        m_timers[i].due = now + m_timers[i].period;
+                    }
+                    i++;
+                } else {
+                    m_timers.erase(m_timers.begin() + i);
+                }
+                fired++;
+                handler(); // may add or cancel timers
+            } else {
+                i++;
+            }
+        }
+        return fired;
+    }
+
+    std::vector<Watcher>       m_watchers;
+    std::vector<Timer>         m_timers;
+    std::vector<struct pollfd> m_pollfds;
+    int                        m_nexttimerid;
+    bool                       m_running;
+};
+
+#endif // DABD_REACTOR_H
@@ -0,0 +1,91 @@
+/*      dabd -- a DAB radio backend daemon for the Raspberry Pi
+ *                Copyright  (C) 2019 schlizbaeda
+ *
+ * dabd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License
+ * or any later version.
+ *
+ * scanpoller.h -- the pace of polling a running DAB scan.
+ *
+ * While the board scans, dabd can only ask it which block it is at and
+ * how many programs it has found so far. Asking in a tight loop floods
+ * the serial link for the whole sweep. ScanPoller waits between two
+ * polls instead: as long as no block has been finished, the interval
+ * doubles from SCANPOLL_MIN_INTERVAL on. Every finished block updates
+ * an average of the block time, then the board is asked about
+ * SCANPOLL_PER_BLOCK times per block. The interval always stays
+ * between SCANPOLL_MIN_INTERVAL and SCANPOLL_MAX_INTERVAL, so a
+ * cancelled scan stops after SCANPOLL_MAX_INTERVAL at the latest.
+ */
+
+#ifndef DABD_SCANPOLLER_H
+#define DABD_SCANPOLLER_H
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#define SCANPOLL_MIN_INTERVAL 10  // ms
+#define SCANPOLL_MAX_INTERVAL 250 // ms
+#define SCANPOLL_PER_BLOCK 8      // polls during an average block
+
+
+class ScanPoller {
+public:
+    typedef std::chrono::steady_clock clock;
+
+    ScanPoller() {
+        Start();
+    }
+
+    void Start() {
+        m_start = m_blockstart = clock::now();
+        m_interval = SCANPOLL_MIN_INTERVAL;
+        m_average = 0;
+        m_blocks = 0;
+    }
+    /* the board has finished a block: returns the ms it took */
+    long Advanced() {
+        clock::time_point now = clock::now();
+        long ms = Milliseconds(now - m_blockstart);
+        m_blockstart = now;
+        // the blocks without a multiplex are scanned faster than the others
+        m_average = m_blocks ? (3 * m_average + ms) / 4 : ms;
+        m_blocks++;
+        m_interval = std::clamp(m_average / SCANPOLL_PER_BLOCK,
+                                (long)SCANPOLL_MIN_INTERVAL,
+                                (long)SCANPOLL_MAX_INTERVAL);
+        return ms;
+    }
+    /* wait before the next poll */
+    void Wait() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(m_interval));
+        if (!m_blocks) { // no estimate yet
+            m_interval = std::min(2 * m_interval,
+                                  (long)SCANPOLL_MAX_INTERVAL);
+        }
+    }
+
+    /* ms since Start() */
+    long Elapsed() const {
+        return Milliseconds(clock::now() - m_start);
+    }
+    long Interval() const {
+        return m_interval;
+    }
+
+private:
+    static long Milliseconds(clock::duration d) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(d)
+            .count();
+    }
+
+    clock::time_point m_start;
+    clock::time_point m_blockstart;
+    long              m_interval; // ms
+    long              m_average;  // ms per block
+    long              m_blocks;   // finished since Start()
+};
+
+#endif // DABD_SCANPOLLER_H
@@ -0,0 +1,179 @@
+/*      dabd -- a DAB radio backend daemon for the Raspberry Pi
+ *                Copyright  (C) 2019 schlizbaeda
+ *
+ * dabd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License
+ * or any later version.
+ *
+ * script.h -- command sequences of "batch ... end" and "run <file>".
+ *
+ * A Script is checked completely before its first command runs: a
+ * command which only the main thread can execute (subscribe, cancel,
+ * quit, get slide, a nested batch, ...) makes the whole script
+ * invalid. The main thread hands the commands up to the next "sleep"
+ * to the worker as one request, which executes them back to back. A
+ * "sleep" is a timer of the main thread, so the other clients are
+ * served meanwhile.
+ *
+ * The worker records the result of every command with Done(). A
+ * script stops at the first error if it was started with
+ * "stoponerror", or at once by Stop() from the main thread. Its
+ * result is the first error or 0.
+ */
+
+#ifndef DABD_SCRIPT_H
+#define DABD_SCRIPT_H
+
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "command.h"
+#include "jsonwriter.h"
+
+#define SCRIPT_MAX_COMMANDS 1000
+
+
+class Script {
+public:
+    struct Step {
+        std::string line;
+        long        sleep;  // ms of a "sleep" or -1
+    };
+
+    Script(bool stoponerror) : m_results(1024) {
+        m_stoponerror = stoponerror;
+        m_lines = 0;
+        m_badline = 0;
+        m_next = 0;
+        m_failed = 0;
+        m_res = 0;
+        m_stopres = 0;
+        m_results.BeginArray("steps");
+    }
+
+    /* Append a command line, empty lines and comments are skipped.
+     * Returns false if line can't be part of a script, e.g. because
+     * it was overlong and cut by the reader. */
+    bool Add(std::string_view line, bool overlong = false) {
+        static const std::string_view mainonly[] = {
+            "batch", "end", "run", "subscribe", "unsubscribe", "cancel",
+            "exit", "quit",
+        };
+        Tokens param(line);
+        long ms = -1;
+        bool valid;
+        m_lines++;
+        if (overlong) {
+            m_badline = m_badline ? m_badline : m_lines;
+            return false;
+        }
+        if (param.size() == 0 || param[0][0] == '#') {
+            return true;
+        }
+        valid = m_steps.size() < SCRIPT_MAX_COMMANDS &&
+                param[0][0] != '@'; // no ids or timeouts of its own
+        for (std::string_view command : mainonly) {
+            valid = valid && param[0] != command;
+        }
+        // the slide cache belongs to the main thread
+        valid = valid && !(param[0] == "get" && param.size() > 1 &&
+                           param[1] == "slide");
+        if (param[0] == "sleep") {
+            valid = valid && param.size() == 2 &&
+                    ParseNumber(param[1], &ms) && ms >= 0;
+        }
+        if (!valid) {
+            m_badline = m_badline ? m_badline : m_lines;
+            return false;
+        }
+        m_steps.push_back(Step{std::string(line), ms});
+        return true;
+    }
+    /* Add() every line of the file path. Returns false with errno set
+     * if it can't be read. */
+    bool Load(const std::string &path) {
+        std::ifstream file(path);
+        std::string line;
+        if (!file) {
+            return false;
+        }
+        while (std::getline(file, line)) {
+            if (line.length() && line.back() == '\r') {
+                line.pop_back();
+            }
+            Add(line);
+        }
+        return true;
+    }
+    /* the first line Add() refused or 0 */
+    size_t BadLine() const {
+        return m_badline;
+    }
+    size_t Size() const {
+        return m_steps.size();
+    }
+
+    bool Finished() const {
+        return m_next >= m_steps.size() || m_stopres != 0 ||
+               (m_stoponerror && m_res < 0);
+    }
+    /* the next command, !Finished() */
+    const Step &Current() const {
+        return m_steps[m_next];
+    }
+    /* the result of Current() and its typed results (JSON members) */
+    void Done(int res, std::string_view fields = std::string_view()) {
+        m_results.BeginObject();
+        m_results.String("command", m_steps[m_next].line);
+        m_results.Int("res", res);
+        m_results.Members(fields);
+        m_results.EndObject();
+        if (res < 0 && m_res == 0) {
+            m_res = res;
+            m_failed = m_next;
+        }
+        m_next++;
+    }
+    /* stop before the next command, e.g. with RES_ERR_CANCEL. The
+     * first reason is kept: a timeout stays the result of the script
+     * although the command it cancelled returns RES_ERR_CANCEL. */
+    void Stop(int res) {
+        int none = 0;
+        m_stopres.compare_exchange_strong(none, res);
+    }
+
+    /* the first error or 0 */
+    int Res() const {
+        return m_stopres ? (int)m_stopres : m_res;
+    }
+    /* the command which returned the first error or nullptr */
+    const Step *Failed() const {
+        return m_res < 0 ? &m_steps[m_failed] : nullptr;
+    }
+    size_t Completed() const {
+        return m_next;
+    }
+    /* the JSON members of the combined reply, once after Finished() */
+    const std::string &Results() {
+        m_results.EndArray();
+        m_results.Int("completed", m_next);
+        return m_results.Text();
+    }
+
+private:
+    std::vector<Step> m_steps;
+    bool              m_stoponerror;
+    size_t            m_lines;     // lines given to Add()
+    size_t            m_badline;
+    size_t            m_next;      // the next step
+    size_t            m_failed;    // the step of m_res
+    int               m_res;
+    std::atomic<int>  m_stopres;   // set by the main thread
+    JsonWriter        m_results;
+};
+
+#endif // DABD_SCRIPT_H
@@ -0,0 +1,286 @@
+/*      dabd -- a DAB radio backend daemon for the Raspberry Pi
+ *                Copyright  (C) 2019 schlizbaeda
+ *
+ * dabd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License
+ * or any later version.
+ *
+ * servicetable.h -- in-memory copy of the program list of the board.
+ *
+ * The table is stored column by column (struct of arrays). It is
+ * filled once after a scan or on the first access, so "list" and
+ * "get programname/programinfo/ensemblename" don't need any serial
+ * round trip to the MonkeyBoard.
+ *
+ * Save() writes the table into a file with a fixed, versioned layout
+ * (a header followed by one fixed size record per service). The file
+ * is replaced atomically by rename(). Load() maps it read-only with
+ * mmap() at startup, so the program list is available immediately.
+ */
+
+#ifndef DABD_SERVICETABLE_H
+#define DABD_SERVICETABLE_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SERVICE_LABEL_SIZE 64 // DAB label (16 chars) in UTF-8 + '\0'
+
+#define SERVICEDB_MAGIC "DABDSVC"
+#define SERVICEDB_VERSION 1
+
+/* file layout: ServiceDBHeader, then header.count ServiceDBRecords */
+struct ServiceDBHeader {
+    char     magic[8];   // SERVICEDB_MAGIC
+    uint32_t version;    // SERVICEDB_VERSION
+    uint32_t recordsize; // sizeof(ServiceDBRecord)
+    uint32_t count;      // number of records
+    uint32_t checksum;   // FNV-1a of all records
+};
+struct ServiceDBRecord {
+    int32_t  dabindex;
+    uint32_t serviceid;
+    uint16_t ensembleid;
+    uint8_t  servcompid;
+    int8_t   programtype;
+    int8_t   applicationtype;
+    uint8_t  reserved[3];
+    char     name[SERVICE_LABEL_SIZE];
+    char     ensemblename[SERVICE_LABEL_SIZE];
+};
+
+
+class ServiceTable {
+public:
+    ServiceTable() {
+        m_valid = false;
+    }
+
+    void Clear() {
+        m_dabindex.clear();
+        m_names.clear();
+        m_ensemblenames.clear();
+        m_servcompid.clear();
+        m_serviceid.clear();
+        m_ensembleid.clear();
+        m_programtype.clear();
+        m_applicationtype.clear();
+        m_valid = false;
+    }
+    void Reserve(long count) {
+        m_dabindex.reserve(count);
+        m_names.reserve(count * SERVICE_LABEL_SIZE);
+        m_ensemblenames.reserve(count * SERVICE_LABEL_SIZE);
+        m_servcompid.reserve(count);
+        m_serviceid.reserve(count);
+        m_ensembleid.reserve(count);
+        m_programtype.reserve(count);
+        m_applicationtype.reserve(count);
+    }
+    void Add(long dabindex,
+             const char *name,
+             const char *ensemblename,
+             unsigned char servcompid,
+             uint32_t serviceid,
+             uint16_t ensembleid,
+             char programtype,
+             char applicationtype) {
+        m_dabindex.push_back(dabindex);
+        AddLabel(&m_names, name);
+        AddLabel(&m_ensemblenames, ensemblename);
+        m_servcompid.push_back(servcompid);
+        m_serviceid.push_back(serviceid);
+        m_ensembleid.push_back(ensembleid);
+        m_programtype.push_back(programtype);
+        m_applicationtype.push_back(applicationtype);
+    }
+
+    /* the table is valid when it was completely read from the board */
+    bool Valid() const { return m_valid; }
+    void SetValid(bool valid) { m_valid = valid; }
+    long Size() const { return (long)m_dabindex.size(); }
+
+    /* row of the given DAB index or -1 */
+    long Find(long dabindex) const {
+        if (dabindex >= 0 && dabindex < Size() &&
+                m_dabindex[dabindex] == dabindex) {
+            return dabindex; // the usual case: row == DAB index
+        }
+        for (long row = 0; row < Size(); row++) {
+            if (m_dabindex[row] == dabindex) {
+                return row;
+            }
+        }
+        return -1;
+    }
+
+    /* row of the given service or -1, servcompid -1: any component */
+    long FindServiceID(uint32_t serviceid, int servcompid = -1) const {
+        for (long row = 0; row < Size(); row++) {
+            if (m_serviceid[row] == serviceid &&
+                    (servcompid < 0 || m_servcompid[row] == servcompid)) {
+                return row;
+            }
+        }
+        return -1;
+    }
+
+    long DABIndex(long row) const { return m_dabindex[row]; }
+    const char *Name(long row) const {
+        return &m_names[row * SERVICE_LABEL_SIZE];
+    }
+    const char *EnsembleName(long row) const {
+        return &m_ensemblenames[row * SERVICE_LABEL_SIZE];
+    }
+    unsigned char ServiceComponentID(long row) const {
+        return m_servcompid[row];
+    }
+    uint32_t ServiceID(long row) const { return m_serviceid[row]; }
+    uint16_t EnsembleID(long row) const { return m_ensembleid[row]; }
+    char ProgramType(long row) const { return m_programtype[row]; }
+    char ApplicationType(long row) const { return m_applicationtype[row]; }
+
+    /* Write the table to path atomically: the records are written to
+     * a temporary file which replaces path by rename() afterwards.
+     * Returns false if the file couldn't be written. */
+    bool Save(const std::string &path) const {
+        std::string tmppath = path + ".tmp";
+        std::vector<ServiceDBRecord> records(Size());
+        ServiceDBHeader header;
+        bool ok;
+        int fd;
+
+        for (long row = 0; row < Size(); row++) {
+            ServiceDBRecord &r = records[row];
+            std::memset(&r, 0, sizeof(r));
+            r.dabindex = m_dabindex[row];
+            r.serviceid = m_serviceid[row];
+            r.ensembleid = m_ensembleid[row];
+            r.servcompid = m_servcompid[row];
+            r.programtype = m_programtype[row];
+            r.applicationtype = m_applicationtype[row];
+            std::memcpy(r.name, Name(row), SERVICE_LABEL_SIZE);
+            std::memcpy(r.ensemblename, EnsembleName(row), SERVICE_LABEL_SIZE);
+        }
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, SERVICEDB_MAGIC, sizeof(SERVICEDB_MAGIC));
+        header.version = SERVICEDB_VERSION;
+        header.recordsize = sizeof(ServiceDBRecord);
+        header.count = records.size();
+        header.checksum = Checksum(records.data(),
+                                   records.size() * sizeof(ServiceDBRecord));
+
+        fd = ::open(tmppath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        ok = WriteAll(fd, &header, sizeof(header)) &&
+             WriteAll(fd, records.data(),
+                      records.size() * sizeof(ServiceDBRecord)) &&
+             ::fsync(fd) == 0;
+        ok = ::close(fd) == 0 && ok;
+        if (ok) {
+            ok = ::rename(tmppath.c_str(), path.c_str()) == 0;
+        }
+        if (!ok) {
+            ::unlink(tmppath.c_str());
+        }
+        return ok;
+    }
+    /* Map the file read-only and copy its records into the table. The
+     * table is not marked valid: this has to be confirmed against the
+     * board. Returns false if the file is missing or doesn't match
+     * the layout of this version. */
+    bool Load(const std::string &path) {
+        struct stat st;
+        const ServiceDBHeader *header;
+        const ServiceDBRecord *records;
+        bool ok = false;
+        void *map;
+        int fd;
+
+        Clear();
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        if (::fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(*header)) {
+            map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) {
+                header = (const ServiceDBHeader*)map;
+                records = (const ServiceDBRecord*)(header + 1);
+                ok = std::memcmp(header->magic, SERVICEDB_MAGIC,
+                                 sizeof(SERVICEDB_MAGIC)) == 0 &&
+                     header->version == SERVICEDB_VERSION &&
+                     header->recordsize == sizeof(ServiceDBRecord) &&
+                     (off_t)(sizeof(*header) + header->count *
+                             sizeof(ServiceDBRecord)) == st.st_size &&
+                     header->checksum == Checksum(records, header->count *
+                                                  sizeof(ServiceDBRecord));
+                if (ok) {
+                    Reserve(header->count);
+                    for (uint32_t i = 0; i < header->count; i++) {
+                        const ServiceDBRecord &r = records[i];
+                        Add(r.dabindex, r.name, r.ensemblename,
+                            r.servcompid, r.serviceid, r.ensembleid,
+                            r.programtype, r.applicationtype);
+                    }
+                }
+                ::munmap(map, st.st_size);
+            }
+        }
+        ::close(fd);
+        return ok;
+    }
+
+private:
+    static uint32_t Checksum(const void *data, size_t len) {
+        const unsigned char *p = (const unsigned char*)data;
+        uint32_t hash = 2166136261u; // FNV-1a
+        for (size_t i = 0; i < len; i++) {
+            hash = (hash ^ p[i]) * 16777619u;
+        }
+        return hash;
+    }
+    static bool WriteAll(int fd, const void *data, size_t len) {
+        const char *p = (const char*)data;
+        while (len) {
+            ssize_t n = ::write(fd, p, len);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            p += n;
+            len -= n;
+        }
+        return true;
+    }
+    static void AddLabel(std::vector<char> *column, const char *label) {
+        size_t pos = column->size();
+        column->resize(pos + SERVICE_LABEL_SIZE, '\0');
+        std::strncpy(column->data() + pos, label, SERVICE_LABEL_SIZE - 1);
+    }
+
+    bool                       m_valid;
+    std::vector<long>          m_dabindex;
+    std::vector<char>          m_names;         // SERVICE_LABEL_SIZE each
+    std::vector<char>          m_ensemblenames; // SERVICE_LABEL_SIZE each
+    std::vector<unsigned char> m_servcompid;
+    std::vector<uint32_t>      m_serviceid;
+    std::vector<uint16_t>      m_ensembleid;
+    std::vector<char>          m_programtype;
+    std::vector<char>          m_applicationtype;
+};
+
+#endif // DABD_SERVICETABLE_H
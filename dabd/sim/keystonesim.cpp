@@ -0,0 +1,906 @@
+/*      dabd -- a DAB radio backend daemon for the Raspberry Pi
+ *                Copyright  (C) 2019 schlizbaeda
+ *
+ * dabd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License
+ * or any later version.
+ *
+ * keystonesim.cpp -- a simulated MonkeyBoard.
+ *
+ * This library implements the API of KeyStoneCOMM.h without any
+ * hardware, so dabd can be tested and benchmarked on every Linux box
+ * ("make dabd-sim"). The radio is described by a configuration file
+ * given in the environment variable KEYSTONESIM_CONFIG (see
+ * keystonesim.conf), without it a small built-in radio is used:
+ *
+ *   - DAB ensembles on multiplex blocks with their services, program
+ *     texts (DLS), slides (MOT) and programme guides (EPG), FM
+ *     stations with RDS names
+ *   - a latency per library call, every call costs a serial round
+ *     trip on the real board
+ *   - failure injection: every n-th call of a function fails
+ *   - a virtual clock: with "clock virtual" the latencies, scans and
+ *     text changes don't take any real time, the clock is advanced
+ *     by the latency of each call instead. The default is the real
+ *     clock: dabd waits between the polls of a scan, which doesn't
+ *     move a virtual clock, so a scan would hardly get on.
+ *
+ * KEYSTONESIM_STATS=1 prints the number of calls per function at exit.
+ * Like the original library it must be used by a single thread.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <ctime>
+#include <map>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../../KeyStoneCOMM/KeyStoneCOMM.h"
+#include "../../KSDeviceLibrary/Epg.h"
+
+#define SIM_MUXBLOCKS 41
+#define SIM_PRESETS 10
+
+static const char *simblocknames[SIM_MUXBLOCKS] = {
+    "5A", "5B", "5C", "5D", "6A", "6B", "6C", "6D",
+    "7A", "7B", "7C", "7D", "8A", "8B", "8C", "8D",
+    "9A", "9B", "9C", "9D", "10A", "10N", "10B", "10C", "10D",
+    "11A", "11N", "11B", "11C", "11D", "12A", "12N", "12B", "12C", "12D",
+    "13A", "13B", "13C", "13D", "13E", "13F",
+};
+
+struct SimEnsemble {
+    int          block;
+    uint16       ensembleid;
+    int          strength;     // 0..100 %
+    int          biterror;
+    std::wstring label;
+};
+
+struct SimProgramme {
+    long        minutes;     // start after the hour the simulation began
+    std::string name;
+    std::string description;
+};
+
+struct SimService {
+    int                       block;
+    uint32                    serviceid;
+    unsigned char             scid;
+    char                      programtype;
+    char                      applicationtype; // 1: slideshow
+    int                       datarate;        // kbit/s
+    std::wstring              label;
+    std::vector<std::wstring> texts;           // DLS, changed periodically
+    std::vector<std::string>  slides;          // MOT slideshow images
+    std::vector<SimProgramme> epg;             // in the order of the config
+};
+
+struct SimFmStation {
+    unsigned long             freq;     // kHz
+    int                       strength; // 0..100 % at freq
+    std::wstring              label;    // RDS program service name
+    std::vector<std::wstring> texts;    // RDS radio text
+};
+
+struct SimCall {
+    long latency = -1;  // us, -1: the default latency
+    long failevery = 0; // every n-th call fails, 0: never
+    long count = 0;
+    long failures = 0;
+};
+
+/* the simulated board */
+static struct SimRadio {
+    bool loaded = false;
+    bool virtualclock = false;
+    long long now = 0;              // us of the virtual clock
+    time_t epgbase = 0;             // wall clock hour the EPG starts at
+    long latency = 2000;            // us per call
+    long scantime = 250;            // ms per DAB block
+    long textperiod = 10000;        // ms between two DLS texts
+    long slideperiod = 15000;       // ms between two slides
+    std::vector<SimEnsemble> ensembles;
+    std::vector<SimService> services;
+    std::vector<SimFmStation> fmstations;
+    std::map<std::string, SimCall, std::less<>> calls;
+
+    bool open = false;
+    char volume = 8;
+    char stereomode = 1;
+    char headroom = 0;
+    std::vector<int> programs;      // the board's program list: services
+    bool scanning = false;
+    int scanfrom = 0;
+    int scanto = 0;
+    int scanned = 0;                // blocks whose services are found
+    int scanblock = 0;              // the block being scanned
+    long long scanstart = 0;
+    char playmode = 0;              // 0: DAB, 1: FM
+    bool playing = false;
+    long playindex = -1;
+    unsigned long fmfreq = 87500;
+    long long playstart = 0;
+    long lasttext = -1;             // index of the last returned text
+    long lastslide = -1;
+    MotMode motmode = MOT_HEADER_MODE;
+    long presets[2][SIM_PRESETS];
+} sim;
+
+
+/****************************** configuration ******************************/
+static std::wstring Widen(const std::string &utf8) {
+    std::wstring w;
+    for (size_t i = 0; i < utf8.length(); ) {
+        unsigned char c = utf8[i];
+        int len = c < 0x80 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+        wchar_t ch = len == 1 ? c : c & (0x3F >> (len - 1));
+        for (int k = 1; k < len && i + k < utf8.length(); k++) {
+            ch = (ch << 6) | (utf8[i + k] & 0x3F);
+        }
+        w += ch;
+        i += len;
+    }
+    return w;
+}
+
+static int BlockIndex(const std::string &name) {
+    for (int i = 0; i < SIM_MUXBLOCKS; i++) {
+        if (name == simblocknames[i]) {
+            return i;
+        }
+    }
+    return std::atoi(name.c_str());
+}
+
+/* split a line into words, "a quoted label" is a single word */
+static std::vector<std::string> Words(const std::string &line) {
+    std::vector<std::string> words;
+    size_t i = 0;
+    while (i < line.length()) {
+        if (line[i] == ' ' || line[i] == '\t') {
+            i++;
+        } else if (line[i] == '#') {
+            break;
+        } else if (line[i] == '"') {
+            size_t end = line.find('"', i + 1);
+            if (end == std::string::npos) {
+                end = line.length();
+            }
+            words.push_back(line.substr(i + 1, end - i - 1));
+            i = end + 1;
+        } else {
+            size_t end = line.find_first_of(" \t", i);
+            if (end == std::string::npos) {
+                end = line.length();
+            }
+            words.push_back(line.substr(i, end - i));
+            i = end;
+        }
+    }
+    return words;
+}
+
+static SimService *FindServiceID(uint32 serviceid) {
+    for (auto &service : sim.services) {
+        if (service.serviceid == serviceid) {
+            return &service;
+        }
+    }
+    return nullptr;
+}
+
+static void ConfigLine(const std::vector<std::string> &w) {
+    long n = w.size();
+    if (n >= 2 && w[0] == "clock") {
+        sim.virtualclock = w[1] != "real";
+    } else if (n >= 3 && w[0] == "latency") {
+        if (w[1] == "*") {
+            sim.latency = std::atol(w[2].c_str());
+        } else {
+            sim.calls[w[1]].latency = std::atol(w[2].c_str());
+        }
+    } else if (n >= 3 && w[0] == "fail") {
+        sim.calls[w[1]].failevery = std::atol(w[2].c_str());
+    } else if (n >= 2 && w[0] == "scantime") {
+        sim.scantime = std::atol(w[1].c_str());
+    } else if (n >= 2 && w[0] == "textperiod") {
+        sim.textperiod = std::atol(w[1].c_str());
+    } else if (n >= 2 && w[0] == "slideperiod") {
+        sim.slideperiod = std::atol(w[1].c_str());
+    } else if (n >= 6 && w[0] == "ensemble") {
+        sim.ensembles.push_back(SimEnsemble{
+            BlockIndex(w[1]),
+            (uint16)std::strtoul(w[2].c_str(), nullptr, 0),
+            std::atoi(w[3].c_str()),
+            std::atoi(w[4].c_str()),
+            Widen(w[5])});
+    } else if (n >= 8 && w[0] == "service") {
+        sim.services.push_back(SimService{
+            BlockIndex(w[1]),
+            (uint32)std::strtoul(w[2].c_str(), nullptr, 0),
+            (unsigned char)std::strtoul(w[3].c_str(), nullptr, 0),
+            (char)std::atoi(w[4].c_str()),
+            (char)std::atoi(w[5].c_str()),
+            std::atoi(w[6].c_str()),
+            Widen(w[7]), {}, {}, {}});
+    } else if (n >= 3 && w[0] == "text") {
+        SimService *service = FindServiceID(std::strtoul(w[1].c_str(),
+                                                         nullptr, 0));
+        if (service) {
+            service->texts.push_back(Widen(w[2]));
+        }
+    } else if (n >= 3 && w[0] == "slide") {
+        SimService *service = FindServiceID(std::strtoul(w[1].c_str(),
+                                                         nullptr, 0));
+        if (service) {
+            service->slides.push_back(w[2]);
+        }
+    } else if (n >= 4 && w[0] == "epg") {
+        SimService *service = FindServiceID(std::strtoul(w[1].c_str(),
+                                                         nullptr, 0));
+        if (service) {
+            service->epg.push_back(SimProgramme{std::atol(w[2].c_str()), w[3],
+                                                n >= 5 ? w[4] : ""});
+        }
+    } else if (n >= 4 && w[0] == "fm") {
+        sim.fmstations.push_back(SimFmStation{
+            std::strtoul(w[1].c_str(), nullptr, 0),
+            std::atoi(w[2].c_str()),
+            Widen(w[3]), {}});
+    } else if (n >= 3 && w[0] == "rdstext") {
+        unsigned long freq = std::strtoul(w[1].c_str(), nullptr, 0);
+        for (auto &station : sim.fmstations) {
+            if (station.freq == freq) {
+                station.texts.push_back(Widen(w[2]));
+            }
+        }
+    } else if (n) {
+        std::fprintf(stderr, "keystonesim: unknown config line \"%s\"\n",
+                     w[0].c_str());
+    }
+}
+
+static const char *simdefaultconfig =
+    "ensemble 5C  0x10bc 80 12 \"DR Deutschland\"\n"
+    "service  5C  0xd210 0 9  1 128 \"Deutschlandfunk\"\n"
+    "service  5C  0xd220 0 9  1 128 \"Dlf Kultur\"\n"
+    "service  5C  0xd230 0 11 1 96  \"Dlf Nova\"\n"
+    "service  5C  0x15dc 0 11 0 96  \"Radio BOB!\"\n"
+    "ensemble 11D 0x10d1 62 40 \"Bayern\"\n"
+    "service  11D 0xd311 0 10 1 96  \"Bayern 1 München\"\n"
+    "service  11D 0xd313 0 10 1 96  \"Bayern 3\"\n"
+    "service  11D 0xd314 0 14 0 128 \"BR-KLASSIK\"\n"
+    "text 0xd210 \"Deutschlandfunk - Nachrichten\"\n"
+    "text 0xd210 \"Deutschlandfunk - Informationen am Morgen\"\n"
+    "text 0x15dc \"AC/DC - Highway to Hell\"\n"
+    "text 0x15dc \"Motörhead - Ace of Spades\"\n"
+    "text 0xd313 \"Bayern 3 - Die beste Musik\"\n"
+    "slide 0xd210 /tmp/keystonesim_slide1.jpg\n"
+    "slide 0xd210 /tmp/keystonesim_slide2.jpg\n"
+    "epg 0xd210 -60 \"Informationen am Morgen\"\n"
+    "epg 0xd210 0 \"Nachrichten\" \"Die Nachrichten des Tages\"\n"
+    "epg 0xd210 30 \"Interview der Woche\"\n"
+    "epg 0xd210 60 \"Sport am Samstag\"\n"
+    "fm 88000  70 \"BAYERN 1\"\n"
+    "fm 97300  85 \"BAYERN 3\"\n"
+    "fm 104400 40 \"ANTENNE\"\n"
+    "rdstext 97300 \"Bayern 3 - Verkehr\"\n";
+
+static void SimPrintStats();
+
+/* read the configuration before the first call */
+static void Load() {
+    std::string line;
+    const char *path;
+
+    if (sim.loaded) {
+        return;
+    }
+    sim.loaded = true;
+    sim.epgbase = std::time(nullptr) / 3600 * 3600;
+    for (int mode = 0; mode < 2; mode++) {
+        for (int i = 0; i < SIM_PRESETS; i++) {
+            sim.presets[mode][i] = -1;
+        }
+    }
+    path = std::getenv("KEYSTONESIM_CONFIG");
+    if (path) {
+        std::ifstream config(path);
+        if (!config) {
+            std::fprintf(stderr, "keystonesim: can't read %s\n", path);
+        }
+        while (std::getline(config, line)) {
+            ConfigLine(Words(line));
+        }
+    } else {
+        std::istringstream config(simdefaultconfig);
+        while (std::getline(config, line)) {
+            ConfigLine(Words(line));
+        }
+    }
+    if (std::getenv("KEYSTONESIM_STATS")) {
+        std::atexit(SimPrintStats);
+    }
+}
+
+static void SimPrintStats() {
+    for (auto &call : sim.calls) {
+        if (call.second.count) {
+            std::fprintf(stderr, "keystonesim: %-22s %8ld calls %6ld failed\n",
+                         call.first.c_str(), call.second.count,
+                         call.second.failures);
+        }
+    }
+}
+
+
+/****************************** clock and calls ****************************/
+/* us of the simulated clock */
+static long long Now() {
+    if (sim.virtualclock) {
+        return sim.now;
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Every API function starts with a call of Enter(): it costs the latency
+ * of the function. Returns false if the call has to fail: because of
+ * failure injection or because the serial port isn't open. */
+static bool Enter(const char *function, bool needsport = true) {
+    Load();
+    auto it = sim.calls.find(std::string_view(function));
+    if (it == sim.calls.end()) {
+        it = sim.calls.emplace(function, SimCall()).first;
+    }
+    SimCall &call = it->second;
+    long latency = call.latency >= 0 ? call.latency : sim.latency;
+    call.count++;
+    if (sim.virtualclock) {
+        sim.now += latency;
+    } else if (latency > 0) {
+        std::this_thread::sleep_for(std::chrono::microseconds(latency));
+    }
+    if ((needsport && !sim.open) ||
+            (call.failevery > 0 && call.count % call.failevery == 0)) {
+        call.failures++;
+        return false;
+    }
+    return true;
+}
+
+static void Copy(const std::wstring &label, wchar_t *buf) {
+    // the KeyStone buffers of dabd have 300 characters
+    std::wcsncpy(buf, label.c_str(), 299);
+    buf[299] = L'\0';
+}
+
+static const SimEnsemble *EnsembleOf(const SimService &service) {
+    for (auto &ensemble : sim.ensembles) {
+        if (ensemble.block == service.block) {
+            return &ensemble;
+        }
+    }
+    return nullptr;
+}
+
+/* progress of a running DAB scan: the board finds the services of a
+ * block after half of its scan time */
+static void UpdateScan() {
+    if (!sim.scanning) {
+        return;
+    }
+    long blocks = sim.scanto - sim.scanfrom + 1;
+    long long elapsed = Now() - sim.scanstart;
+    long done = elapsed / (sim.scantime * 1000);
+    long found = (elapsed + sim.scantime * 500) / (sim.scantime * 1000);
+    if (found > blocks) {
+        found = blocks;
+    }
+    for (; sim.scanned < found; sim.scanned++) {
+        int block = sim.scanfrom + sim.scanned;
+        for (int i = 0; i < (int)sim.services.size(); i++) {
+            bool known = false;
+            if (sim.services[i].block != block) {
+                continue;
+            }
+            for (int p : sim.programs) {
+                known = known || p == i;
+            }
+            if (!known) {
+                sim.programs.push_back(i);
+            }
+        }
+    }
+    if (done >= blocks) {
+        sim.scanning = false;
+    }
+    sim.scanblock = sim.scanfrom + (done < blocks ? done : blocks - 1);
+}
+
+static const SimService *Program(long dabindex) {
+    UpdateScan();
+    if (dabindex < 0 || dabindex >= (long)sim.programs.size()) {
+        return nullptr;
+    }
+    return &sim.services[sim.programs[dabindex]];
+}
+
+static const SimService *PlayingService() {
+    return sim.playing && sim.playmode == 0 ? Program(sim.playindex)
+                                            : nullptr;
+}
+
+/* FM reception: the strength of a station falls off within 200 kHz */
+static int FmStrength(unsigned long freq, const SimFmStation **best) {
+    int strength = 0;
+    *best = nullptr;
+    for (auto &station : sim.fmstations) {
+        long df = std::labs((long)freq - (long)station.freq);
+        int s = df >= 200 ? 0 : station.strength * (200 - df) / 200;
+        if (s > strength) {
+            strength = s;
+            *best = &station;
+        }
+    }
+    return strength;
+}
+
+static void StartScan(unsigned char startindex, unsigned char endindex) {
+    sim.scanning = true;
+    sim.scanfrom = startindex;
+    sim.scanto = endindex < SIM_MUXBLOCKS ? endindex : SIM_MUXBLOCKS - 1;
+    sim.scanned = 0;
+    sim.scanblock = sim.scanfrom;
+    sim.scanstart = Now();
+    sim.playing = false;
+    sim.playmode = 0;
+}
+
+
+/******************************* KeyStoneCOMM.h ****************************/
+long CommVersion(void) {
+    Enter(__func__, false);
+    return 1;
+}
+BOOL OpenRadioPort(LPCSTR port, BOOL usehardmute) {
+    if (!Enter(__func__, false)) {
+        return false;
+    }
+    sim.open = true;
+    return true;
+}
+BOOL HardResetRadio(void) {
+    if (!Enter(__func__)) {
+        return false;
+    }
+    sim.playing = false;
+    sim.scanning = false;
+    return true;
+}
+BOOL IsSysReady(void) {
+    return Enter(__func__);
+}
+BOOL CloseRadioPort(void) {
+    if (!Enter(__func__)) {
+        return false;
+    }
+    sim.open = false;
+    return true;
+}
+BOOL SetVolume(char volume) {
+    if (!Enter(__func__) || volume < 0 || volume > 16) {
+        return false;
+    }
+    sim.volume = volume;
+    return true;
+}
+BOOL PlayStream(char mode, unsigned long channel) {
+    if (!Enter(__func__)) {
+        return false;
+    }
+    if (mode == 0 && channel >= sim.programs.size()) {
+        return false;
+    }
+    sim.scanning = false;
+    sim.playmode = mode;
+    sim.playing = true;
+    sim.playstart = Now();
+    sim.lasttext = -1;
+    sim.lastslide = -1;
+    if (mode == 0) {
+        sim.playindex = channel;
+    } else {
+        sim.fmfreq = channel;
+    }
+    return true;
+}
+BOOL StopStream(void) {
+    if (!Enter(__func__)) {
+        return false;
+    }
+    sim.playing = false;
+    sim.scanning = false;
+    return true;
+}
+char VolumePlus(void) {
+    if (!Enter(__func__)) {
+        return -1;
+    }
+    if (sim.volume < 16) {
+        sim.volume++;
+    }
+    return sim.volume;
+}
+char VolumeMinus(void) {
+    if (!Enter(__func__)) {
+        return -1;
+    }
+    if (sim.volume > 0) {
+        sim.volume--;
+    }
+    return sim.volume;
+}
+void VolumeMute(void) {
+    if (Enter(__func__)) {
+        sim.volume = 0;
+    }
+}
+char GetVolume(void) {
+    return Enter(__func__) ? sim.volume : -1;
+}
+char GetPlayMode(void) {
+    return Enter(__func__) ? sim.playmode : -1;
+}
+char GetPlayStatus(void) { // 0: playing, 1: scanning, 3: stopped
+    if (!Enter(__func__)) {
+        return -1;
+    }
+    UpdateScan();
+    return sim.scanning ? 1 : sim.playing ? 0 : 3;
+}
+long GetTotalProgram(void) {
+    if (!Enter(__func__)) {
+        return -1;
+    }
+    UpdateScan();
+    return sim.programs.size();
+}
+BOOL NextStream(void) {
+    if (!Enter(__func__) || !sim.playing || sim.playmode != 0 ||
+            sim.playindex + 1 >= (long)sim.programs.size()) {
+        return false;
+    }
+    sim.playindex++;
+    sim.lasttext = -1;
+    return true;
+}
+BOOL PrevStream(void) {
+    if (!Enter(__func__) || !sim.playing || sim.playmode != 0 ||
+            sim.playindex <= 0) {
+        return false;
+    }
+    sim.playindex--;
+    sim.lasttext = -1;
+    return true;
+}
+long GetPlayIndex(void) {
+    if (!Enter(__func__)) {
+        return -1;
+    }
+    return sim.playing && sim.playmode == 0 ? sim.playindex : -1;
+}
+char GetSignalStrength(int *biterror) {
+    const SimFmStation *station;
+    const SimService *service;
+    const SimEnsemble *ensemble;
+
+    *biterror = 0;
+    if (!Enter(__func__)) {
+        return -1;
+    }
+    if (sim.playmode == 1) {
+        return FmStrength(sim.fmfreq, &station);
+    }
+    service = PlayingService();
+    ensemble = service ? EnsembleOf(*service) : nullptr;
+    if (!ensemble) {
+        return 0;
+    }
+    *biterror = ensemble->biterror;
+    return ensemble->strength;
+}
+char GetProgramType(char mode, long dabIndex) {
+    const SimService *service = Enter(__func__) ? Program(dabIndex)
+                                                : nullptr;
+    return service ? service->programtype : -1;
+}
+char GetProgramText(wchar_t *programText) { // 0: new text
+    const std::vector<std::wstring> *texts = nullptr;
+    const SimFmStation *station;
+    long idx;
+
+    if (!Enter(__func__) || !sim.playing) {
+        return -1;
+    }
+    if (sim.playmode == 1) {
+        FmStrength(sim.fmfreq, &station);
+        texts = station ? &station->texts : nullptr;
+    } else if (PlayingService()) {
+        texts = &PlayingService()->texts;
+    }
+    if (!texts || texts->empty()) {
+        return 1;
+    }
+    idx = (Now() - sim.playstart) / (sim.textperiod * 1000) % texts->size();
+    if (idx == sim.lasttext) {
+        return 1;
+    }
+    sim.lasttext = idx;
+    Copy((*texts)[idx], programText);
+    return 0;
+}
+BOOL GetProgramName(char mode, long dabIndex, char namemode,
+                    wchar_t *programName) {
+    const SimFmStation *station;
+    const SimService *service;
+
+    if (!Enter(__func__)) {
+        return false;
+    }
+    if (mode == 1) { // FM: RDS name of the tuned station
+        if (FmStrength(sim.fmfreq, &station) < 20 || !station) {
+            return false;
+        }
+        Copy(station->label, programName);
+        return true;
+    }
+    service = Program(dabIndex);
+    if (!service) {
+        return false;
+    }
+    Copy(service->label, programName);
+    return true;
+}
+long GetPreset(char mode, char presetindex) {
+    if (!Enter(__func__) || mode < 0 || mode > 1 ||
+            presetindex < 0 || presetindex >= SIM_PRESETS) {
+        return -1;
+    }
+    return sim.presets[(int)mode][(int)presetindex];
+}
+BOOL SetPreset(char mode, char presetindex, unsigned long channel) {
+    if (!Enter(__func__) || mode < 0 || mode > 1 ||
+            presetindex < 0 || presetindex >= SIM_PRESETS) {
+        return false;
+    }
+    sim.presets[(int)mode][(int)presetindex] = channel;
+    return true;
+}
+BOOL DABAutoSearch(unsigned char startindex, unsigned char endindex) {
+    if (!Enter(__func__) || startindex > endindex) {
+        return false;
+    }
+    sim.programs.clear();
+    StartScan(startindex, endindex);
+    return true;
+}
+BOOL DABAutoSearchNoClear(unsigned char startindex, unsigned char endindex) {
+    if (!Enter(__func__) || startindex > endindex) {
+        return false;
+    }
+    StartScan(startindex, endindex);
+    return true;
+}
+BOOL GetEnsembleName(long dabIndex, char namemode, wchar_t *programName) {
+    const SimService *service = Enter(__func__) ? Program(dabIndex)
+                                                : nullptr;
+    const SimEnsemble *ensemble = service ? EnsembleOf(*service) : nullptr;
+    if (!ensemble) {
+        return false;
+    }
+    Copy(ensemble->label, programName);
+    return true;
+}
+int GetDataRate(void) {
+    if (!Enter(__func__)) {
+        return -1;
+    }
+    return PlayingService() ? PlayingService()->datarate : 0;
+}
+BOOL SetStereoMode(char mode) {
+    if (!Enter(__func__)) {
+        return false;
+    }
+    sim.stereomode = mode;
+    return true;
+}
+char GetFrequency(void) { // index of the DAB multiplex block
+    if (!Enter(__func__)) {
+        return -1;
+    }
+    UpdateScan();
+    if (sim.scanning) {
+        return sim.scanblock;
+    }
+    return PlayingService() ? PlayingService()->block : 0;
+}
+char GetStereoMode(void) {
+    return Enter(__func__) ? sim.stereomode : -1;
+}
+char GetStereo(void) {
+    return Enter(__func__) ? (sim.playing && sim.stereomode) : -1;
+}
+BOOL ClearDatabase(void) {
+    if (!Enter(__func__)) {
+        return false;
+    }
+    sim.programs.clear();
+    sim.playing = false;
+    return true;
+}
+BOOL SetBBEEQ(char BBEOn, char EQMode, char BBELo, char BBEHi,
+              char BBECFreq, char BBEMachFreq, char BBEMachGain,
+              char BBEMachQ, char BBESurr, char BBEMp, char BBEHpF,
+              char BBEHiMode) {
+    return Enter(__func__);
+}
+BOOL GetBBEEQ(char *BBEOn, char *EQMode, char *BBELo, char *BBEHi,
+              char *BBECFreq, char *BBEMachFreq, char *BBEMachGain,
+              char *BBEMachQ, char *BBESurr, char *BBEMp, char *BBEHpF,
+              char *BBEHiMode) {
+    *BBEOn = *EQMode = *BBELo = *BBEHi = *BBECFreq = *BBEMachFreq = 0;
+    *BBEMachGain = *BBEMachQ = *BBESurr = *BBEMp = *BBEHpF = *BBEHiMode = 0;
+    return Enter(__func__);
+}
+BOOL SetHeadroom(char headroom) {
+    if (!Enter(__func__)) {
+        return false;
+    }
+    sim.headroom = headroom;
+    return true;
+}
+char GetHeadroom(void) {
+    return Enter(__func__) ? sim.headroom : -1;
+}
+char GetApplicationType(long dabIndex) {
+    const SimService *service = Enter(__func__) ? Program(dabIndex)
+                                                : nullptr;
+    return service ? service->applicationtype : -1;
+}
+BOOL GetProgramInfo(long dabIndex, unsigned char *ServiceComponentID,
+                    uint32 *ServiceID, uint16 *EnsembleID) {
+    const SimService *service = Enter(__func__) ? Program(dabIndex)
+                                                : nullptr;
+    const SimEnsemble *ensemble = service ? EnsembleOf(*service) : nullptr;
+    if (!service) {
+        return false;
+    }
+    *ServiceComponentID = service->scid;
+    *ServiceID = service->serviceid;
+    *EnsembleID = ensemble ? ensemble->ensembleid : 0;
+    return true;
+}
+BOOL MotQuery(void) { // true: a new slide is available
+    const SimService *service;
+    long idx;
+
+    if (!Enter(__func__)) {
+        return false;
+    }
+    service = PlayingService();
+    if (!service || service->slides.empty()) {
+        return false;
+    }
+    idx = (Now() - sim.playstart) / (sim.slideperiod * 1000) %
+          service->slides.size();
+    if (idx == sim.lastslide) {
+        return false;
+    }
+    sim.lastslide = idx;
+    return true;
+}
+void GetImage(wchar_t *ImageFileName) {
+    const SimService *service;
+
+    ImageFileName[0] = L'\0';
+    if (!Enter(__func__)) {
+        return;
+    }
+    service = PlayingService();
+    if (service && sim.lastslide >= 0 &&
+            sim.lastslide < (long)service->slides.size()) {
+        Copy(Widen(service->slides[sim.lastslide]), ImageFileName);
+    }
+}
+void MotReset(MotMode enMode) {
+    if (Enter(__func__)) {
+        sim.motmode = enMode;
+        sim.lastslide = -1;
+    }
+}
+/* Epg.h: the programmes of a service, the start times are UTC */
+BOOL GetEpg(uint16 u16EnsembleID, uint32 u32ServiceID, uint8 u8ServCompID,
+            Service *pServ) {
+    const SimService *service;
+
+    if (!Enter(__func__)) {
+        return false;
+    }
+    service = FindServiceID(u32ServiceID);
+    if (!service || service->epg.empty()) {
+        return false;
+    }
+    pServ->u16EnsembleID = u16EnsembleID;
+    pServ->u32ServiceID = u32ServiceID;
+    pServ->u8ServCompID = u8ServCompID;
+    pServ->u16PINum = 0;
+    for (auto &programme : service->epg) {
+        if (pServ->u16PINum == MAX_PI_PER_SERVICE) {
+            break;
+        }
+        Programe &pi = pServ->pstPI[pServ->u16PINum];
+        time_t start = sim.epgbase + programme.minutes * 60;
+        std::snprintf((char*)pi.pu8MediumName, sizeof(pi.pu8MediumName),
+                      "%s", programme.name.c_str());
+        std::snprintf((char*)pi.pu8Discription, sizeof(pi.pu8Discription),
+                      "%s", programme.description.c_str());
+        pi.stClock.u32MJD = start / 86400 + 40587; // 1970-01-01
+        pi.stClock.u8Hour = start / 3600 % 24;
+        pi.stClock.u8Minute = start / 60 % 60;
+        pServ->u16PINum++;
+    }
+    return true;
+}
+char GetDABSignalQuality(void) {
+    const SimService *service;
+    const SimEnsemble *ensemble;
+
+    if (!Enter(__func__)) {
+        return -1;
+    }
+    service = PlayingService();
+    ensemble = service ? EnsembleOf(*service) : nullptr;
+    return ensemble ? ensemble->strength : 0;
+}
+char GetServCompType(long dabIndex) {
+    const SimService *service = Enter(__func__) ? Program(dabIndex)
+                                                : nullptr;
+    return service ? 0 : -1; // 0: audio
+}
+BOOL SyncRTC(BOOL sync) {
+    return Enter(__func__);
+}
+BOOL GetRTC(unsigned char *sec, unsigned char *min, unsigned char *hour,
+            unsigned char *day, unsigned char *month, unsigned char *year) {
+    long long s;
+
+    if (!Enter(__func__)) {
+        return false;
+    }
+    s = Now() / 1000000 + 12 * 3600; // the board's day starts at noon
+    *sec = s % 60;
+    *min = s / 60 % 60;
+    *hour = s / 3600 % 24;
+    *day = 1 + s / 86400 % 28;
+    *month = 6;
+    *year = 19;
+    return true;
+}
+int GetSamplingRate(void) { // kHz
+    if (!Enter(__func__)) {
+        return -1;
+    }
+    return sim.playing ? 48 : 0;
+}
@@ -0,0 +1,397 @@
+/*      dabd -- a DAB radio backend daemon for the Raspberry Pi
+ *                Copyright  (C) 2019 schlizbaeda
+ *
+ * dabd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License
+ * or any later version.
+ *
+ * slideshow.h -- the MOT slideshow of the playing DAB program.
+ *
+ * The MonkeyBoard assembles the MOT slides itself: MotQuery() tells
+ * whether a new slide is complete and GetImage() returns the name of
+ * the file it was written to. The next slide may overwrite that file,
+ * so each slide is copied into a pool which is allocated once: a slot
+ * of the size of the largest MOT object per cached slide plus one
+ * slot the next slide is read into.
+ *
+ * Stations repeat the same few slides (logos, show banners) again and
+ * again. The slides are cached by the FNV-1a hash of their data and
+ * their ServiceID: a repeated slide is recognized and isn't stored
+ * twice. The cache is a least recently used list of SLIDESHOW_SLOTS
+ * slides in memory and of SLIDESHOW_FILES slides in a directory, the
+ * files are named "<hash>-<serviceid>" and survive a restart.
+ *
+ * The board is polled at an adaptive rate: at SLIDESHOW_MIN_INTERVAL
+ * after a new slide or a change of the program, then every poll which
+ * doesn't find a new slide doubles the interval up to
+ * SLIDESHOW_MAX_INTERVAL. All of this runs on the main thread, only
+ * the library calls are made by the device worker.
+ */
+
+#ifndef DABD_SLIDESHOW_H
+#define DABD_SLIDESHOW_H
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SLIDESHOW_SLOTS 8            // slides cached in memory
+#define SLIDESHOW_FILES 64           // slides cached in the directory
+#define SLIDESHOW_NAME_SIZE 100      // MAX_NAME_LENGTH of the MOT decoder
+#define SLIDESHOW_MIN_INTERVAL 500   // ms
+#define SLIDESHOW_MAX_INTERVAL 8000  // ms
+
+
+class SlideShow {
+public:
+    typedef std::chrono::steady_clock clock;
+
+    struct Slide {
+        uint64_t    hash = 0;       // FNV-1a of the data
+        uint32_t    serviceid = 0;
+        std::string name;           // file name given by GetImage()
+        const char *data = nullptr; // in the pool
+        size_t      size = 0;
+        long        used = 0;       // LRU clock, 0: a free slot
+    };
+
+    /* slotsize: the largest slide in bytes, directory: "" keeps the *
+     * slides in memory only                                         */
+    SlideShow(size_t slotsize, const std::string &directory,
+              int slots = SLIDESHOW_SLOTS)
+        : m_slotsize(slotsize), m_pool(slotsize * (slots + 1)),
+          m_slides(slots), m_directory(directory) {
+        for (int s = 0; s < slots; s++) {
+            m_slides[s].name.reserve(SLIDESHOW_NAME_SIZE);
+            m_slides[s].data = &m_pool[s * slotsize];
+        }
+        m_next = &m_pool[slots * slotsize];
+        m_clock = 0;
+        m_scanned = false;
+        m_serviceid = 0;
+        m_interval = SLIDESHOW_MIN_INTERVAL;
+        m_poll = clock::now();
+    }
+
+    /* true if the board should be polled now */
+    bool Due(clock::time_point now) const {
+        return now >= m_poll;
+    }
+    /* A poll has finished: playing is false if no program with a
+     * slideshow is playing, then the board hasn't been asked at all. */
+    void Polled(clock::time_point now, bool playing, uint32_t serviceid,
+                bool newslide) {
+        if (!playing || newslide || serviceid != m_serviceid) {
+            m_interval = SLIDESHOW_MIN_INTERVAL;
+        } else if (m_interval < SLIDESHOW_MAX_INTERVAL) {
+            m_interval *= 2;
+        }
+        m_serviceid = serviceid;
+        m_poll = now + std::chrono::milliseconds(m_interval);
+    }
+    long Interval() const {
+        return m_interval;
+    }
+
+    /* Read the slide in the file path. *repeat is true if it has been
+     * cached already, then it isn't stored again. Returns nullptr with
+     * errno set if the file can't be read or is too large. */
+    const Slide *Load(const std::string &path, uint32_t serviceid,
+                      bool *repeat) {
+        size_t size;
+        uint64_t hash;
+        Slide *slide;
+        if (!ReadFile(path, &size)) {
+            return nullptr;
+        }
+        hash = Hash(m_next, size);
+        *repeat = true;
+        slide = Cached(hash, serviceid);
+        if (slide) {
+            slide->used = ++m_clock;
+            TouchFile(hash, serviceid);
+            return slide;
+        }
+        size_t slash = path.rfind('/');
+        std::string_view name(path);
+        name.remove_prefix(slash == std::string::npos ? 0 : slash + 1);
+        if (!TouchFile(hash, serviceid)) { // not even in the directory
+            *repeat = false;
+            WriteFile(hash, serviceid, size);
+        }
+        return Store(hash, serviceid, name, size);
+    }
+    /* The slide with hash from memory or from the directory, nullptr
+     * if it isn't cached. */
+    const Slide *Find(uint64_t hash) {
+        size_t size;
+        for (Slide &slide : m_slides) {
+            if (slide.used && slide.hash == hash) {
+                slide.used = ++m_clock;
+                TouchFile(hash, slide.serviceid);
+                return &slide;
+            }
+        }
+        ScanDirectory();
+        for (CacheFile &file : m_files) {
+            if (file.hash == hash) {
+                uint32_t serviceid = file.serviceid;
+                std::string path = FilePath(hash, serviceid);
+                if (!ReadFile(path, &size)) {
+                    return nullptr;
+                }
+                TouchFile(hash, serviceid);
+                return Store(hash, serviceid,
+                             std::string_view(path).substr(
+                                 m_directory.length() + 1), size);
+            }
+        }
+        return nullptr;
+    }
+    /* the most recently received or requested slide or nullptr */
+    const Slide *Last() const {
+        const Slide *last = nullptr;
+        for (const Slide &slide : m_slides) {
+            if (slide.used && (!last || slide.used > last->used)) {
+                last = &slide;
+            }
+        }
+        return last;
+    }
+
+    /* 16 hex digits */
+    static std::string HashText(uint64_t hash) {
+        char text[17];
+        snprintf(text, sizeof(text), "%016llx", (unsigned long long)hash);
+        return text;
+    }
+    static bool ParseHash(std::string_view text, uint64_t *hash) {
+        const char *end = text.data() + text.length();
+        std::from_chars_result r = std::from_chars(text.data(), end, *hash,
+                                                   16);
+        return text.length() && r.ec == std::errc() && r.ptr == end;
+    }
+
+private:
+    struct CacheFile {
+        uint64_t hash;
+        uint32_t serviceid;
+        long     used;   // LRU clock
+    };
+
+    static uint64_t Hash(const char *data, size_t size) {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ (uint8_t)data[i]) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    Slide *Cached(uint64_t hash, uint32_t serviceid) {
+        for (Slide &slide : m_slides) {
+            if (slide.used && slide.hash == hash &&
+                    slide.serviceid == serviceid) {
+                return &slide;
+            }
+        }
+        return nullptr;
+    }
+    /* The slide read into m_next replaces the least recently used one,
+     * whose slot is the next m_next. */
+    Slide *Store(uint64_t hash, uint32_t serviceid, std::string_view name,
+                 size_t size) {
+        Slide *victim = &m_slides[0];
+        for (Slide &slide : m_slides) {
+            if (slide.used < victim->used) {
+                victim = &slide;
+            }
+        }
+        char *data = m_next;
+        m_next = const_cast<char*>(victim->data);
+        victim->hash = hash;
+        victim->serviceid = serviceid;
+        victim->name.assign(name.substr(0, SLIDESHOW_NAME_SIZE));
+        victim->data = data;
+        victim->size = size;
+        victim->used = ++m_clock;
+        return victim;
+    }
+
+    /* read the file path into m_next */
+    bool ReadFile(const std::string &path, size_t *size) {
+        ssize_t n;
+        char extra;
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        *size = 0;
+        while (*size < m_slotsize &&
+               (n = ::read(fd, m_next + *size, m_slotsize - *size)) != 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                ::close(fd);
+                return false;
+            }
+            *size += n;
+        }
+        if (*size == m_slotsize && ::read(fd, &extra, 1) > 0) { // too large
+            ::close(fd);
+            errno = EFBIG;
+            return false;
+        }
+        ::close(fd);
+        return true;
+    }
+
+    std::string FilePath(uint64_t hash, uint32_t serviceid) const {
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx-%08x",
+                 (unsigned long long)hash, (unsigned)serviceid);
+        return m_directory + name;
+    }
+    /* the files of the last session, the oldest is used least recently */
+    void ScanDirectory() {
+        std::vector<std::pair<time_t, CacheFile>> found;
+        struct dirent *entry;
+        struct stat st;
+        DIR *dir;
+        if (m_scanned || m_directory.empty()) {
+            return;
+        }
+        m_scanned = true;
+        if (::mkdir(m_directory.c_str(), 0755) == 0 ||
+                !(dir = ::opendir(m_directory.c_str()))) {
+            return;
+        }
+        while ((entry = ::readdir(dir))) {
+            unsigned long long hash;
+            unsigned serviceid;
+            char end;
+            std::string path = m_directory + "/" + entry->d_name;
+            if (sscanf(entry->d_name, "%16llx-%8x%c", &hash, &serviceid,
+                       &end) == 2 && ::stat(path.c_str(), &st) == 0) {
+                found.push_back({st.st_mtime, {hash, serviceid, 0}});
+            }
+        }
+        ::closedir(dir);
+        std::sort(found.begin(), found.end(),
+                  [](const auto &a, const auto &b) {
+                      return a.first < b.first;
+                  });
+        for (auto &file : found) {
+            file.second.used = ++m_clock;
+            m_files.push_back(file.second);
+        }
+        while ((int)m_files.size() > SLIDESHOW_FILES) {
+            RemoveFile();
+        }
+    }
+    /* mark the file used, returns false if it isn't in the directory */
+    bool TouchFile(uint64_t hash, uint32_t serviceid) {
+        ScanDirectory();
+        for (CacheFile &file : m_files) {
+            if (file.hash == hash && file.serviceid == serviceid) {
+                file.used = ++m_clock;
+                // the modification time keeps the order for a restart
+                ::utimensat(AT_FDCWD, FilePath(hash, serviceid).c_str(),
+                            nullptr, 0);
+                return true;
+            }
+        }
+        return false;
+    }
+    /* store the slide in m_next as a file, the least recently used *
+     * file is removed if the directory is full                     */
+    void WriteFile(uint64_t hash, uint32_t serviceid, size_t size) {
+        std::string path = FilePath(hash, serviceid);
+        std::string temp = path + ".tmp";
+        size_t written = 0;
+        ssize_t n = 0;
+        int fd;
+        if (m_directory.empty()) {
+            return;
+        }
+        fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644);
+        if (fd < 0) {
+            return;
+        }
+        while (written < size &&
+               ((n = ::write(fd, m_next + written, size - written)) > 0 ||
+                (n < 0 && errno == EINTR))) {
+            written += n > 0 ? n : 0;
+        }
+        ::close(fd);
+        if (written < size || ::rename(temp.c_str(), path.c_str()) < 0) {
+            ::unlink(temp.c_str());
+            return;
+        }
+        m_files.push_back({hash, serviceid, ++m_clock});
+        while ((int)m_files.size() > SLIDESHOW_FILES) {
+            RemoveFile();
+        }
+    }
+    void RemoveFile() {
+        auto oldest = std::min_element(m_files.begin(), m_files.end(),
+            [](const CacheFile &a, const CacheFile &b) {
+                return a.used < b.used;
+            });
+        ::unlink(FilePath(oldest->hash, oldest->serviceid).c_str());
+        m_files.erase(oldest);
+    }
+
+    size_t                 m_slotsize;
+    std::vector<char>      m_pool;      // (slots + 1) * m_slotsize bytes
+    std::vector<Slide>     m_slides;    // cached in memory
+    char                  *m_next;      // the slot a new slide is read to
+    std::string            m_directory;
+    std::vector<CacheFile> m_files;     // cached in m_directory
+    bool                   m_scanned;   // m_files has been read
+    long                   m_clock;     // LRU clock of slides and files
+    uint32_t               m_serviceid; // of the last poll
+    long                   m_interval;  // ms
+    clock::time_point      m_poll;      // the next poll
+};
+
+/* append the base64 encoding of data to *out */
+inline void Base64(std::string_view data, std::string *out) {
+    static const char digits[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t i = 0;
+    out->reserve(out->length() + (data.length() + 2) / 3 * 4);
+    for (; i + 2 < data.length(); i += 3) {
+        uint32_t v = (uint8_t)data[i] << 16 | (uint8_t)data[i + 1] << 8 |
+                     (uint8_t)data[i + 2];
+        out->push_back(digits[v >> 18]);
+        out->push_back(digits[(v >> 12) & 63]);
+        out->push_back(digits[(v >> 6) & 63]);
+        out->push_back(digits[v & 63]);
+    }
+    if (i < data.length()) {
+        uint32_t v = (uint8_t)data[i] << 16;
+        if (i + 1 < data.length()) {
+            v |= (uint8_t)data[i + 1] << 8;
+        }
+        out->push_back(digits[v >> 18]);
+        out->push_back(digits[(v >> 12) & 63]);
+        out->push_back(i + 1 < data.length() ? digits[(v >> 6) & 63] : '=');
+        out->push_back('=');
+    }
+}
+
+#endif // DABD_SLIDESHOW_H
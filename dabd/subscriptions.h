@@ -0,0 +1,196 @@
+/*      dabd -- a DAB radio backend daemon for the Raspberry Pi
+ *                Copyright  (C) 2019 schlizbaeda
+ *
+ * dabd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License
+ * or any later version.
+ *
+ * subscriptions.h -- change-only push of radio properties.
+ *
+ * A client subscribes to a property once instead of asking for it
+ * again and again. Each subscribed property has a periodic reactor
+ * timer which starts a sample on the device worker. The result comes
+ * back to the main thread and is pushed to the client only if it
+ * differs from the last pushed value. A property is never sampled
+ * twice at the same time: a tick is skipped while the previous sample
+ * is still queued or running.
+ *
+ * Several clients (see controlsocket.h) may subscribe to the same
+ * property: it is sampled once at the shortest of their intervals and
+ * a change is pushed to each of them.
+ */
+
+#ifndef DABD_SUBSCRIPTIONS_H
+#define DABD_SUBSCRIPTIONS_H
+
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "jsonwriter.h"
+#include "reactor.h"
+
+#define SUBSCRIPTION_MIN_INTERVAL 100 // ms, protects the serial line
+
+
+class Subscriptions {
+public:
+    /* starts sampling property, SampleDone() has to be called later */
+    typedef std::function<void(const std::string &property)> Sampler;
+    /* sends a changed value to one subscribed client */
+    typedef std::function<void(int client,
+                               const std::string &property,
+                               const std::string &value)> Pusher;
+
+    Subscriptions(Reactor &reactor, Sampler sampler, Pusher pusher)
+        : m_reactor(reactor), m_sampler(sampler), m_pusher(pusher) {
+    }
+    ~Subscriptions() {
+        Clear();
+    }
+
+    /* Subscribe client to property or change its interval. The current
+     * value is sampled at once, a value known already is sent to the
+     * new subscriber immediately. */
+    void Subscribe(const std::string &property, long interval,
+                   int client = 0) {
+        if (interval < SUBSCRIPTION_MIN_INTERVAL) {
+            interval = SUBSCRIPTION_MIN_INTERVAL;
+        }
+        Subscription &sub = m_subscriptions[property];
+        bool subscribed = sub.clients.count(client) != 0;
+        sub.clients[client] = interval;
+        Retime(property, sub);
+        if (sub.known && !subscribed) {
+            m_pusher(client, property, sub.value);
+        }
+        Sample(property);
+    }
+    /* returns false if client hadn't subscribed property, "all" removes
+     * all subscriptions of client */
+    bool Unsubscribe(const std::string &property, int client = 0) {
+        if (property == "all") {
+            std::vector<std::string> properties;
+            for (auto &entry : m_subscriptions) {
+                if (entry.second.clients.count(client)) {
+                    properties.push_back(entry.first);
+                }
+            }
+            for (auto &subscribed : properties) {
+                Unsubscribe(subscribed, client);
+            }
+            return true;
+        }
+        auto it = m_subscriptions.find(property);
+        if (it == m_subscriptions.end() ||
+                it->second.clients.erase(client) == 0) {
+            return false;
+        }
+        if (it->second.clients.empty()) {
+            m_reactor.CancelTimer(it->second.timer);
+            m_subscriptions.erase(it);
+        } else {
+            Retime(property, it->second);
+        }
+        return true;
+    }
+    /* remove all subscriptions of all clients */
+    void Clear() {
+        for (auto &entry : m_subscriptions) {
+            m_reactor.CancelTimer(entry.second.timer);
+        }
+        m_subscriptions.clear();
+    }
+
+    /* The sample of property has finished. valid is false if the value
+     * couldn't be read (e.g. the serial connection is closed). */
+    void SampleDone(const std::string &property, bool valid,
+                    const std::string &value) {
+        auto it = m_subscriptions.find(property);
+        if (it == m_subscriptions.end()) {
+            return; // unsubscribed in the meantime
+        }
+        Subscription &sub = it->second;
+        sub.busy = false;
+        if (valid && (!sub.known || value != sub.value)) {
+            sub.value = value;
+            sub.known = true;
+            for (auto &subscriber : sub.clients) {
+                m_pusher(subscriber.first, property, value);
+            }
+        }
+    }
+
+    /* one line "<property> <interval>" per subscription of client */
+    void List(std::ostream &out, int client = 0) const {
+        for (auto &entry : m_subscriptions) {
+            auto it = entry.second.clients.find(client);
+            if (it != entry.second.clients.end()) {
+                out << "  " << entry.first << " " << it->second << "\n";
+            }
+        }
+    }
+    /* an array "subscriptions" of {"property", "interval"} of client */
+    void List(JsonWriter *json, int client = 0) const {
+        json->BeginArray("subscriptions");
+        for (auto &entry : m_subscriptions) {
+            auto it = entry.second.clients.find(client);
+            if (it != entry.second.clients.end()) {
+                json->BeginObject();
+                json->String("property", entry.first);
+                json->Int("interval", it->second);
+                json->EndObject();
+            }
+        }
+        json->EndArray();
+    }
+
+private:
+    struct Subscription {
+        std::map<int, long> clients;  // subscriber and its interval (ms)
+        long        interval = 0; // ms, the shortest of all clients
+        int         timer = 0;
+        bool        busy = false; // a sample is queued or running
+        bool        known = false;
+        std::string value;        // the last pushed value
+    };
+
+    /* sample at the shortest interval of all subscribers */
+    void Retime(const std::string &property, Subscription &sub) {
+        long interval = 0;
+        for (auto &subscriber : sub.clients) {
+            if (interval == 0 || subscriber.second < interval) {
+                interval = subscriber.second;
+            }
+        }
+        if (sub.timer && interval == sub.interval) {
+            return;
+        }
+        if (sub.timer) {
+            m_reactor.CancelTimer(sub.timer);
+        }
+        sub.interval = interval;
+        sub.timer = m_reactor.AddTimer(interval, [this, property]() {
+            Sample(property);
+        }, interval);
+    }
+
+    void Sample(const std::string &property) {
+        Subscription &sub = m_subscriptions[property];
+        if (sub.busy) {
+            return;
+        }
+        sub.busy = true;
+        m_sampler(property);
+    }
+
+    Reactor                            &m_reactor;
+    Sampler                             m_sampler;
+    Pusher                              m_pusher;
+    std::map<std::string, Subscription> m_subscriptions;
+};
+
+#endif // DABD_SUBSCRIPTIONS_H
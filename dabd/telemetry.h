@@ -0,0 +1,186 @@
+/*      dabd -- a DAB radio backend daemon for the Raspberry Pi
+ *                Copyright  (C) 2019 schlizbaeda
+ *
+ * dabd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License
+ * or any later version.
+ *
+ * telemetry.h -- the reception of the board over time.
+ *
+ * dabd samples the signal strength, the bit errors, the DAB signal
+ * quality, the data rate and the sampling rate once a second. Every
+ * sample goes into three rings of the same kind of bucket: one bucket
+ * per second, per minute and per hour. A bucket keeps the number of
+ * samples and the minimum, the sum and the maximum of each value, so
+ * it is merged with a sample in constant time and its average is
+ * sum/samples. The buckets of a ring are in time order, a time range
+ * is found by a binary search.
+ *
+ * The rings are allocated once: 3600 seconds, 1440 minutes and 168
+ * hours of 72 byte buckets are about 370 KB, however long dabd runs.
+ * A period without samples (serial port closed) has no bucket.
+ */
+
+#ifndef DABD_TELEMETRY_H
+#define DABD_TELEMETRY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <string_view>
+#include <vector>
+
+#define TELEMETRY_INTERVAL 1000 // ms between two samples
+
+enum TelemetryValue {
+    TELEMETRY_STRENGTH,     // GetSignalStrength()
+    TELEMETRY_BITERROR,     // its bitError
+    TELEMETRY_QUALITY,      // GetDABSignalQuality()
+    TELEMETRY_DATARATE,     // GetDataRate()
+    TELEMETRY_SAMPLINGRATE, // GetSamplingRate()
+    TELEMETRY_VALUES
+};
+
+enum TelemetryResolution {
+    TELEMETRY_SECONDS,
+    TELEMETRY_MINUTES,
+    TELEMETRY_HOURS,
+    TELEMETRY_RESOLUTIONS
+};
+
+
+class Telemetry {
+public:
+    struct Bucket {
+        int64_t  start;   // seconds since 1970
+        uint32_t samples;
+        int32_t  min[TELEMETRY_VALUES];
+        int32_t  sum[TELEMETRY_VALUES];
+        int32_t  max[TELEMETRY_VALUES];
+
+        int32_t Average(int value) const {
+            return samples ? sum[value] / (int32_t)samples : 0;
+        }
+    };
+
+    Telemetry() {
+        static const size_t sizes[TELEMETRY_RESOLUTIONS] = {3600, 1440, 168};
+        for (int r = 0; r < TELEMETRY_RESOLUTIONS; r++) {
+            m_rings[r].buckets.resize(sizes[r]);
+        }
+    }
+
+    /* the names of values and resolutions in commands and results */
+    static std::string_view ValueName(int value) {
+        static const std::string_view names[TELEMETRY_VALUES] = {
+            "strength", "biterror", "quality", "datarate", "samplingrate"
+        };
+        return names[value];
+    }
+    static std::string_view ResolutionName(int resolution) {
+        static const std::string_view names[TELEMETRY_RESOLUTIONS] = {
+            "s", "min", "h"
+        };
+        return names[resolution];
+    }
+    /* the resolution of name or -1 */
+    static int Resolution(std::string_view name) {
+        for (int r = 0; r < TELEMETRY_RESOLUTIONS; r++) {
+            if (name == ResolutionName(r)) {
+                return r;
+            }
+        }
+        return -1;
+    }
+    /* seconds of a bucket */
+    static int64_t Seconds(int resolution) {
+        static const int64_t seconds[TELEMETRY_RESOLUTIONS] = {1, 60, 3600};
+        return seconds[resolution];
+    }
+
+    /* merge the sample taken at time now into all resolutions */
+    void Add(time_t now, const int32_t values[TELEMETRY_VALUES]) {
+        for (int r = 0; r < TELEMETRY_RESOLUTIONS; r++) {
+            Ring &ring = m_rings[r];
+            int64_t start = (int64_t)now - (int64_t)now % Seconds(r);
+            if (!ring.count || Head(ring).start != start) {
+                if (ring.count && start < Head(ring).start) {
+                    continue; // the clock went back: keep the order
+                }
+                ring.next = (ring.next + 1) % ring.buckets.size();
+                ring.count += ring.count < ring.buckets.size();
+                Bucket &bucket = Head(ring);
+                bucket.start = start;
+                bucket.samples = 0;
+                for (int v = 0; v < TELEMETRY_VALUES; v++) {
+                    bucket.min[v] = bucket.max[v] = values[v];
+                    bucket.sum[v] = 0;
+                }
+            }
+            Bucket &bucket = Head(ring);
+            bucket.samples++;
+            for (int v = 0; v < TELEMETRY_VALUES; v++) {
+                bucket.min[v] = std::min(bucket.min[v], values[v]);
+                bucket.sum[v] += values[v];
+                bucket.max[v] = std::max(bucket.max[v], values[v]);
+            }
+        }
+    }
+    void Clear() {
+        for (Ring &ring : m_rings) {
+            ring.count = ring.next = 0;
+        }
+    }
+
+    /* the number of buckets of resolution */
+    size_t Size(int resolution) const {
+        return m_rings[resolution].count;
+    }
+    /* [*first, *last): the buckets of resolution between from and to */
+    void Range(int resolution, time_t from, time_t to,
+               size_t *first, size_t *last) const {
+        *first = Search(m_rings[resolution], (int64_t)from -
+                        (int64_t)from % Seconds(resolution));
+        *last = std::max(*first, Search(m_rings[resolution], to));
+    }
+    /* bucket i of resolution, the oldest is 0 */
+    const Bucket &Get(int resolution, size_t i) const {
+        const Ring &ring = m_rings[resolution];
+        return ring.buckets[Index(ring, i)];
+    }
+
+private:
+    struct Ring {
+        std::vector<Bucket> buckets;
+        size_t              count = 0;
+        size_t              next = 0;  // the bucket after the head
+    };
+
+    /* the bucket of ring in logical order */
+    static size_t Index(const Ring &ring, size_t i) {
+        size_t size = ring.buckets.size();
+        return (ring.next + size - ring.count + i) % size;
+    }
+    static Bucket &Head(Ring &ring) {
+        return ring.buckets[Index(ring, ring.count - 1)];
+    }
+    /* the first bucket starting at start or later */
+    static size_t Search(const Ring &ring, int64_t start) {
+        size_t low = 0;
+        size_t high = ring.count;
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            if (ring.buckets[Index(ring, mid)].start < start) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        return low;
+    }
+
+    Ring m_rings[TELEMETRY_RESOLUTIONS];
+};
+
+#endif // DABD_TELEMETRY_H
@@ -0,0 +1,161 @@
+/*      dabd -- a DAB radio backend daemon for the Raspberry Pi
+ *                Copyright  (C) 2019 schlizbaeda
+ *
+ * dabd is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published
+ * by the Free Software Foundation, either version 3 of the License
+ * or any later version.
+ *
+ * utf8conv.h -- conversion of the wchar_t strings returned by the
+ *               KeyStoneCOMM.h library into UTF-8.
+ *
+ * Most DAB labels are plain ASCII. They are narrowed four characters
+ * at a time (SSE2, NEON or a scalar loop). The first non-ASCII
+ * character hands the rest of the string over to libiconv. The iconv
+ * descriptor is opened once for the lifetime of the converter.
+ */
+
+#ifndef DABD_UTF8CONV_H
+#define DABD_UTF8CONV_H
+
+#include <cstring>
+
+#include <iconv.h>  // https://www.gnu.org/software/libiconv/
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+static_assert(sizeof(wchar_t) == 4, "wchar_t is expected to be UTF-32");
+
+
+class Utf8Converter {
+public:
+    Utf8Converter() {
+        m_cd = iconv_open("UTF-8", "WCHAR_T");
+        m_openerrno = m_cd == (iconv_t)-1 ? errno : 0;
+    }
+    ~Utf8Converter() {
+        if (m_cd != (iconv_t)-1) {
+            iconv_close(m_cd);
+        }
+    }
+    Utf8Converter(const Utf8Converter&) = delete;
+    Utf8Converter& operator=(const Utf8Converter&) = delete;
+
+    /* errno of iconv_open() or 0 if the descriptor is available */
+    int OpenError() const {
+        return m_openerrno;
+    }
+
+    /* Convert at most inlen characters up to the terminating L'\0'.
+     * outbuf is always terminated and truncated at a character
+     * boundary if outsize is too small. Returns the length of the
+     * UTF-8 string or -1 if the iconv conversion failed. */
+    int Convert(const wchar_t *inbuf, size_t inlen,
+                char *outbuf, size_t outsize) {
+        size_t i = 0;
+        size_t o = 0;
+
+        if (outsize == 0) {
+            return -1;
+        }
+        outsize--; // room for '\0'
+
+        /* ASCII fast path: 4 characters per iteration */
+        while (i + 4 <= inlen && o + 4 <= outsize &&
+               Narrow4(inbuf + i, outbuf + o)) {
+            i += 4;
+            o += 4;
+        }
+        /* remaining characters: ASCII one by one */
+        while (i < inlen && o < outsize &&
+               inbuf[i] > 0 && inbuf[i] < 0x80) {
+            outbuf[o++] = (char)inbuf[i++];
+        }
+        if (i < inlen && o < outsize && inbuf[i] != L'\0') {
+            /* non-ASCII character: convert the rest with iconv */
+            int len = ConvertIconv(inbuf + i, inlen - i,
+                                   outbuf + o, outsize - o);
+            if (len < 0) {
+                outbuf[o] = '\0';
+                return -1;
+            }
+            o += len;
+        }
+        outbuf[o] = '\0';
+        return (int)o;
+    }
+
+private:
+    /* Copy 4 characters if all of them are ASCII and none is L'\0' */
+    static bool Narrow4(const wchar_t *in, char *out) {
+#if defined(__SSE2__)
+        __m128i v = _mm_loadu_si128((const __m128i*)in);
+        __m128i ok = _mm_and_si128(_mm_cmpgt_epi32(v, _mm_setzero_si128()),
+                                   _mm_cmplt_epi32(v, _mm_set1_epi32(0x80)));
+        if (_mm_movemask_epi8(ok) != 0xFFFF) {
+            return false;
+        }
+        v = _mm_packs_epi32(v, v);
+        v = _mm_packus_epi16(v, v);
+        int packed = _mm_cvtsi128_si32(v);
+        std::memcpy(out, &packed, 4);
+        return true;
+#elif defined(__ARM_NEON)
+        uint32x4_t v = vld1q_u32((const uint32_t*)in);
+        uint32x4_t ok = vandq_u32(vcgtq_u32(v, vdupq_n_u32(0)),
+                                  vcltq_u32(v, vdupq_n_u32(0x80)));
+        uint32x2_t all = vpmin_u32(vget_low_u32(ok), vget_high_u32(ok));
+        all = vpmin_u32(all, all);
+        if (vget_lane_u32(all, 0) != 0xFFFFFFFF) {
+            return false;
+        }
+        uint16x4_t v16 = vmovn_u32(v);
+        uint8x8_t v8 = vmovn_u16(vcombine_u16(v16, v16));
+        uint32_t packed = vget_lane_u32(vreinterpret_u32_u8(v8), 0);
+        std::memcpy(out, &packed, 4);
+        return true;
+#else
+        unsigned int any = (unsigned int)in[0] | (unsigned int)in[1] |
+                           (unsigned int)in[2] | (unsigned int)in[3];
+        if ((any & ~0x7Fu) || !in[0] || !in[1] || !in[2] || !in[3]) {
+            return false;
+        }
+        out[0] = (char)in[0];
+        out[1] = (char)in[1];
+        out[2] = (char)in[2];
+        out[3] = (char)in[3];
+        return true;
+#endif
+    }
+
+    int ConvertIconv(const wchar_t *inbuf, size_t inlen,
+                     char *outbuf, size_t outsize) {
+        size_t len = 0;
+        if (m_cd == (iconv_t)-1) {
+            return -1;
+        }
+        while (len < inlen && inbuf[len] != L'\0') { // the real length
+            len++;
+        }
+        char *inptr = (char*)inbuf;
+        char *outptr = outbuf;
+        size_t inbytesleft = len * sizeof(wchar_t);
+        size_t outbytesleft = outsize;
+        iconv(m_cd, nullptr, nullptr, nullptr, nullptr); // reset state
+        if (iconv(m_cd, &inptr, &inbytesleft,
+                  &outptr, &outbytesleft) == (size_t)-1 &&
+                errno != E2BIG) { // E2BIG: truncated output is fine
+            return -1;
+        }
+        return (int)(outptr - outbuf);
+    }
+
+    iconv_t m_cd;
+    int     m_openerrno;
+};
+
+#endif // DABD_UTF8CONV_H